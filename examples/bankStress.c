@@ -0,0 +1,171 @@
+/*
+ * bankStress.c:
+ *	Hammer one GPIO bank from several threads at once and check that
+ *	no thread's update is lost. A plain memory word stands in for the
+ *	bank data register, so this runs anywhere - no hardware needed.
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define	MAX_THREADS	32
+#define	ROUNDS		200
+#define	COUNT		20000
+
+// Modes
+
+#define	MODE_PLAIN	0	// Unprotected read-modify-write, for comparison
+#define	MODE_LOCKED	1	// asus_reg_update, uncached
+#define	MODE_SHADOW	2	// asus_reg_update, cached
+
+static volatile unsigned int reg ;
+static unsigned int shadow ;
+static int lock ;
+
+static int mode ;
+static int numThreads ;
+
+struct worker
+{
+  pthread_t    thread ;
+  unsigned int bits ;		// The pins this thread owns
+  unsigned int expect ;		// What it last wrote to them
+  unsigned int seed ;
+} ;
+
+static struct worker workers [MAX_THREADS] ;
+
+
+/*
+ * writer:
+ *	Randomly set, clear and toggle our own bits, remembering what they
+ *	should end up as.
+ *********************************************************************************
+ */
+
+static void *writer (void *arg)
+{
+  struct worker *w = (struct worker *)arg ;
+  unsigned int r, mask, clr, xor ;
+  int i ;
+
+  for (i = 0 ; i < COUNT ; ++i)
+  {
+    r    = rand_r (&w->seed) ;
+    mask = w->bits & r ;
+    switch ((r >> 30) & 3)
+    {
+      case 0:  clr = mask ; xor = mask ; break ;	// set
+      case 1:  clr = mask ; xor = 0    ; break ;	// clear
+      default: clr = 0    ; xor = mask ; break ;	// toggle
+    }
+    w->expect = (w->expect & ~clr) ^ xor ;
+
+    if (mode == MODE_PLAIN)
+      reg = (reg & ~clr) ^ xor ;
+    else
+      asus_reg_update (&reg, (mode == MODE_SHADOW) ? &shadow : NULL, &lock, clr, xor) ;
+  }
+  return NULL ;
+}
+
+
+/*
+ * runMode:
+ *	Do all the rounds in one mode, returning how many of them ended up
+ *	with the register not matching what the threads wrote.
+ *********************************************************************************
+ */
+
+static int runMode (int m)
+{
+  int round, i, bad ;
+  unsigned int want ;
+
+  mode = m ;
+  bad  = 0 ;
+
+  for (round = 0 ; round < ROUNDS ; ++round)
+  {
+    reg    = 0 ;
+    shadow = 0 ;
+
+    for (i = 0 ; i < numThreads ; ++i)
+    {
+      workers [i].expect = 0 ;
+      workers [i].seed   = round * MAX_THREADS + i + 1 ;
+      pthread_create (&workers [i].thread, NULL, writer, &workers [i]) ;
+    }
+
+    want = 0 ;
+    for (i = 0 ; i < numThreads ; ++i)
+    {
+      pthread_join (workers [i].thread, NULL) ;
+      want |= workers [i].expect ;
+    }
+
+    if ((reg != want) || ((m == MODE_SHADOW) && (shadow != want)))
+      ++bad ;
+  }
+  return bad ;
+}
+
+
+int main (int argc, char *argv [])
+{
+  int i, bad, locked, shadowed ;
+
+  numThreads = (argc > 1) ? atoi (argv [1]) : 4 ;
+  if ((numThreads < 2) || (numThreads > MAX_THREADS))
+  {
+    fprintf (stderr, "Usage: %s [threads 2-%d]\n", argv [0], MAX_THREADS) ;
+    return 1 ;
+  }
+
+// Share the 32 bits of the bank out between the threads
+
+  for (i = 0 ; i < 32 ; ++i)
+    workers [i % numThreads].bits |= 1 << i ;
+
+  printf ("Bank stress test: %d threads, %d rounds of %d writes each\n", numThreads, ROUNDS, COUNT) ;
+
+  bad = runMode (MODE_PLAIN) ;
+  printf ("  plain read-modify-write: %3d rounds lost updates (not thread safe)\n", bad) ;
+
+  locked = runMode (MODE_LOCKED) ;
+  printf ("  locked update:           %3d rounds lost updates\n", locked) ;
+
+  shadowed = runMode (MODE_SHADOW) ;
+  printf ("  shadow update:           %3d rounds lost updates\n", shadowed) ;
+
+  if ((locked != 0) || (shadowed != 0))
+  {
+    printf ("FAIL\n") ;
+    return 1 ;
+  }
+  printf ("OK\n") ;
+  return 0 ;
+}
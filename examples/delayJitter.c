@@ -0,0 +1,193 @@
+/*
+ * delayJitter.c:
+ *	How close delayMicroseconds () gets to the time asked for, and how
+ *	much CPU it burns doing it, against the old way: a gettimeofday ()
+ *	spin under 100uS and one nanosleep () otherwise. Results go to
+ *	stdout as JSON, one entry per method and delay, with the lateness
+ *	in nS as percentiles and the CPU time as a percentage of the time
+ *	spent waiting.
+ *
+ *	Runs against the simulated registers too (WIRINGPI_SIM=).
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+
+static int samplesPerDelay = 1000 ;
+static int results = 0 ;
+
+static const unsigned int delays [] = { 5, 20, 50, 100, 200, 500, 1000, 5000, 0 } ;
+
+
+/*
+ * The old delayMicroseconds
+ *********************************************************************************
+ */
+
+static void oldDelay (unsigned int howLong)
+{
+  struct timeval tNow, tLong, tEnd ;
+  struct timespec sleeper ;
+
+  if (howLong < 100)
+  {
+    gettimeofday (&tNow, NULL) ;
+    tLong.tv_sec  = howLong / 1000000 ;
+    tLong.tv_usec = howLong % 1000000 ;
+    timeradd (&tNow, &tLong, &tEnd) ;
+    while (timercmp (&tNow, &tEnd, <))
+      gettimeofday (&tNow, NULL) ;
+    return ;
+  }
+  sleeper.tv_sec  = howLong / 1000000 ;
+  sleeper.tv_nsec = (long)(howLong % 1000000) * 1000L ;
+  nanosleep (&sleeper, NULL) ;
+}
+
+struct method
+{
+  const char *name ;
+  void (*fn)(unsigned int howLong) ;
+} ;
+
+static struct method methods [] =
+{
+  { "nanosleep",         oldDelay          },
+  { "delayMicroseconds", delayMicroseconds },
+  { NULL,                NULL              },
+} ;
+
+
+/*
+ * Timing
+ *********************************************************************************
+ */
+
+static double clockNs (clockid_t clock)
+{
+  struct timespec ts ;
+
+  clock_gettime (clock, &ts) ;
+  return (double)ts.tv_sec * 1.0e9 + (double)ts.tv_nsec ;
+}
+
+static int cmpDouble (const void *a, const void *b)
+{
+  double x = *(const double *)a ;
+  double y = *(const double *)b ;
+
+  return (x > y) - (x < y) ;
+}
+
+static double percentile (const double *sorted, int n, double p)
+{
+  int i = (int)(p * (n - 1) + 0.5) ;
+
+  return sorted [i] ;
+}
+
+
+/*
+ * jitterOne:
+ *	Time one method at one delay and print the JSON entry for it.
+ *********************************************************************************
+ */
+
+static void jitterOne (struct method *m, unsigned int howLong, double *samples)
+{
+  double start, wall, cpu, sum ;
+  int i ;
+
+  sum = 0.0 ;
+  wall = clockNs (CLOCK_MONOTONIC) ;
+  cpu  = clockNs (CLOCK_THREAD_CPUTIME_ID) ;
+  for (i = 0 ; i < samplesPerDelay ; ++i)
+  {
+    start = clockNs (CLOCK_MONOTONIC) ;
+    m->fn (howLong) ;
+    samples [i] = clockNs (CLOCK_MONOTONIC) - start - howLong * 1000.0 ;
+    sum += samples [i] ;
+  }
+  cpu  = clockNs (CLOCK_THREAD_CPUTIME_ID) - cpu ;
+  wall = clockNs (CLOCK_MONOTONIC) - wall ;
+  qsort (samples, samplesPerDelay, sizeof (double), cmpDouble) ;
+
+  printf ("%s\n    { \"method\": \"%s\", \"delay_us\": %u, \"unit\": \"ns late\", ",
+	(results++ == 0) ? "" : ",", m->name, howLong) ;
+  printf ("\"min\": %.0f, \"p50\": %.0f, \"p99\": %.0f, \"max\": %.0f, \"mean\": %.0f, \"cpu_pct\": %.1f }",
+	samples [0],
+	percentile (samples, samplesPerDelay, 0.50),
+	percentile (samples, samplesPerDelay, 0.99),
+	samples [samplesPerDelay - 1],
+	sum / samplesPerDelay,
+	100.0 * cpu / wall) ;
+  fflush (stdout) ;
+}
+
+
+static void usage (const char *prog)
+{
+  fprintf (stderr, "Usage: %s [-n samplesPerDelay]\n", prog) ;
+  exit (EXIT_FAILURE) ;
+}
+
+
+int main (int argc, char *argv [])
+{
+  struct method *m ;
+  double *samples ;
+  int opt, d ;
+
+  while ((opt = getopt (argc, argv, "n:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': samplesPerDelay = atoi (optarg) ; break ;
+      default:  usage (argv [0]) ;
+    }
+  }
+  if (samplesPerDelay < 1)
+    usage (argv [0]) ;
+
+  if ((samples = malloc (samplesPerDelay * sizeof (double))) == NULL)
+  {
+    fprintf (stderr, "%s: Out of memory\n", argv [0]) ;
+    return EXIT_FAILURE ;
+  }
+
+  if (wiringPiSetupGpio () < 0)
+    return EXIT_FAILURE ;
+
+  printf ("{\n  \"bench\": \"delayJitter\",\n  \"samplesPerDelay\": %d,\n  \"results\": [", samplesPerDelay) ;
+  for (d = 0 ; delays [d] != 0 ; ++d)
+    for (m = methods ; m->name != NULL ; ++m)
+      jitterOne (m, delays [d], samples) ;
+  printf ("\n  ]\n}\n") ;
+
+  free (samples) ;
+  return 0 ;
+}
@@ -0,0 +1,107 @@
+/*
+ * edgeLatch.c:
+ *	Check the GPIO controller's edge latch: edges are caught without
+ *	being looked at, seen with one read of the bank, and only the ones
+ *	acknowledged are cleared.
+ *
+ *	Drives the pin it latches, so run it with WIRINGPI_SIM= set, where
+ *	the outputs loop back to the inputs.
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// GPIO5_B0 and GPIO5_B1: bank 5, bits 8 and 9
+
+#define	PIN_A		160
+#define	PIN_B		161
+#define	BANK		5
+#define	BIT_A		(1 << 8)
+#define	BIT_B		(1 << 9)
+
+static int failed = 0 ;
+
+
+static void check (int ok, const char *what)
+{
+  printf ("  %-50s %s\n", what, ok ? "ok" : "FAIL") ;
+  if (!ok)
+    ++failed ;
+}
+
+
+int main (void)
+{
+  int i ;
+
+  if (wiringPiSetupGpio () < 0)
+    return 1 ;
+
+  pinMode (PIN_A, OUTPUT) ;
+  pinMode (PIN_B, OUTPUT) ;
+  digitalWrite (PIN_A, LOW) ;
+  digitalWrite (PIN_B, HIGH) ;
+
+  printf ("Edge latch\n") ;
+  check (edgeLatchSetup (PIN_A, INT_EDGE_RISING) == 0, "rising on A") ;
+  check (edgeLatchSetup (PIN_B, INT_EDGE_FALLING) == 0, "falling on B") ;
+  check ((edgeLatchRead (BANK) & (BIT_A | BIT_B)) == 0, "nothing latched yet") ;
+
+// Pulses nobody polls for are still there afterwards
+
+  for (i = 0 ; i < 3 ; ++i)
+  {
+    digitalWrite (PIN_A, HIGH) ;
+    digitalWrite (PIN_A, LOW) ;
+  }
+  check ((edgeLatchRead (BANK) & (BIT_A | BIT_B)) == BIT_A, "pulses on A latched") ;
+
+  digitalWrite (PIN_B, LOW) ;
+  check ((edgeLatchRead (BANK) & (BIT_A | BIT_B)) == (BIT_A | BIT_B), "and the fall on B") ;
+
+// Acknowledging one leaves the other
+
+  edgeLatchAck (BANK, BIT_A) ;
+  check ((edgeLatchRead (BANK) & (BIT_A | BIT_B)) == BIT_B, "ack A, B still latched") ;
+  digitalWrite (PIN_B, HIGH) ;
+  edgeLatchAck (BANK, BIT_B) ;
+  check ((edgeLatchRead (BANK) & (BIT_A | BIT_B)) == 0, "rise on B ignored, ack B") ;
+
+// Stopped: no more edges
+
+  edgeLatchSetup (PIN_A, INT_EDGE_SETUP) ;
+  digitalWrite (PIN_A, HIGH) ;
+  check ((edgeLatchRead (BANK) & BIT_A) == 0, "stopped") ;
+
+  setGpioDebounce (PIN_A, 1) ;
+  setGpioDebounce (PIN_A, 0) ;
+
+  if (failed)
+  {
+    printf ("FAIL\n") ;
+    return 1 ;
+  }
+  printf ("OK\n") ;
+  return 0 ;
+}
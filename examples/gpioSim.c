@@ -0,0 +1,212 @@
+/*
+ * gpioSim.c:
+ *	Check the GPIO character device backend against a gpio-sim chip:
+ *	lines 0-7 are written as outputs and read back from the simulator,
+ *	lines 8-15 are inputs driven through the simulator's pulls, and the
+ *	edges on them are caught with wiringPiISR, waitForInterrupt,
+ *	waitForInterruptAny and the event rings.
+ *	gpio/test_gpiosim.sh sets the chip up and runs it.
+ *
+ *	Usage: gpioSim <chip> <sim dir>
+ *	e.g.   gpioSim gpiochip2 /sys/devices/platform/gpio-sim.0/gpiochip2
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *simDir ;
+static volatile int edges = 0 ;
+static int failed = 0 ;
+
+
+static void check (int ok, const char *what)
+{
+  printf ("  %-50s %s\n", what, ok ? "ok" : "FAIL") ;
+  if (!ok)
+    ++failed ;
+}
+
+static void rising (void)
+{
+  ++edges ;
+}
+
+
+// The simulator's side of a line
+
+static int simValue (int line)
+{
+  char fName [256] ;
+  int value = -1 ;
+  FILE *f ;
+
+  sprintf (fName, "%s/sim_gpio%d/value", simDir, line) ;
+  if ((f = fopen (fName, "r")) == NULL)
+    return -1 ;
+  if (fscanf (f, "%d", &value) != 1)
+    value = -1 ;
+  fclose (f) ;
+  return value ;
+}
+
+static void simPull (int line, int high)
+{
+  char fName [256] ;
+  FILE *f ;
+
+  sprintf (fName, "%s/sim_gpio%d/pull", simDir, line) ;
+  if ((f = fopen (fName, "w")) == NULL)
+    return ;
+  fprintf (f, "%s\n", high ? "pull-up" : "pull-down") ;
+  fclose (f) ;
+  delay (1) ;
+}
+
+
+int main (int argc, char *argv [])
+{
+  struct wpiEventRing *ring, *small ;
+  struct wpiEdgeEvent events [16] ;
+  int outs [8], ins [8] ;
+  int waits [3] = { 12, 13, 14 }, fired [3] ;
+  uint64_t values ;
+  int i, n, ok ;
+
+  if (argc != 3)
+  {
+    fprintf (stderr, "Usage: %s <chip> <sim dir>\n", argv [0]) ;
+    return 1 ;
+  }
+  simDir = argv [2] ;
+
+  if (wiringPiSetupGpioDevice (argv [1]) < 0)
+    return 1 ;
+
+  for (i = 0 ; i < 8 ; ++i)
+  {
+    outs [i] = i ;
+    ins  [i] = i + 8 ;
+    pinMode (ins [i], INPUT) ;
+  }
+
+  printf ("GPIO character device on %s\n", argv [1]) ;
+
+// Outputs: one write for all 8, checked line by line
+
+  printf ("Outputs:\n") ;
+  ok = (digitalWritePins (outs, 8, 0xA5) == 0) ;
+  for (i = 0 ; i < 8 ; ++i)
+    if (simValue (i) != ((0xA5 >> i) & 1))
+      ok = 0 ;
+  check (ok, "digitalWritePins 0xA5") ;
+
+  digitalWrite (0, LOW) ;
+  digitalWrite (1, HIGH) ;
+  check ((simValue (0) == 0) && (simValue (1) == 1), "digitalWrite") ;
+
+// Inputs: set line by line, one read for all 8
+
+  printf ("Inputs:\n") ;
+  for (i = 0 ; i < 8 ; ++i)
+    simPull (ins [i], (0x3C >> i) & 1) ;
+  ok = (digitalReadPins (ins, 8, &values) == 0) ;
+  check (ok && (values == 0x3C), "digitalReadPins 0x3C") ;
+  check ((digitalRead (10) == HIGH) && (digitalRead (8) == LOW), "digitalRead") ;
+
+// Interrupts
+
+  printf ("Interrupts:\n") ;
+  simPull (8, 0) ;
+  wiringPiISR (8, INT_EDGE_RISING, rising) ;
+  simPull (8, 1) ;
+  simPull (8, 0) ;
+  simPull (8, 1) ;
+  delay (50) ;
+  check (edges == 2, "wiringPiISR: 2 rising edges") ;
+  check (wiringPiISRTime (8) != 0, "with a kernel timestamp") ;
+
+  simPull (9, 0) ;
+  (void)waitForInterrupt (9, 0) ;	// Sets the edges up
+  simPull (9, 1) ;
+  check (waitForInterrupt (9, 100) == 1, "waitForInterrupt: edge") ;
+  check (waitForInterrupt (9, 10) == 0, "waitForInterrupt: timeout") ;
+
+  for (i = 0 ; i < 3 ; ++i)
+    simPull (waits [i], 0) ;
+  (void)waitForInterruptAny (waits, 3, 0, fired) ;
+  simPull (12, 1) ;
+  simPull (14, 1) ;
+  delay (10) ;
+  n = waitForInterruptAny (waits, 3, 100, fired) ;
+  check ((n == 2) && (fired [0] == 12) && (fired [1] == 14), "waitForInterruptAny: 12 and 14") ;
+  check (waitForInterruptAny (waits, 3, 10, fired) == 0, "waitForInterruptAny: timeout") ;
+
+  simPull (8, 0) ;			// Still caught after 9 was reconfigured
+  simPull (8, 1) ;
+  delay (50) ;
+  check (edges == 3, "wiringPiISR still running") ;
+
+// Event rings: every edge, in order, and the ones that didn't fit counted
+
+  printf ("Event rings:\n") ;
+  ring  = wpiEventRingOpen (64) ;
+  small = wpiEventRingOpen (2) ;
+  simPull (10, 0) ;
+  simPull (11, 0) ;
+  wpiEventRingAddPin (ring,  10, INT_EDGE_BOTH) ;
+  wpiEventRingAddPin (small, 11, INT_EDGE_RISING) ;
+
+  for (i = 0 ; i < 6 ; ++i)
+  {
+    simPull (10, !(i & 1)) ;
+    simPull (11, !(i & 1)) ;
+  }
+  check (wpiEventRingWait (ring, 100) == 1, "wpiEventRingWait") ;
+  delay (50) ;
+
+  n  = wpiEventRingRead (ring, events, 16) ;
+  ok = (n == 6) ;
+  for (i = 0 ; ok && (i < n) ; ++i)
+    if ((events [i].pin != 10) || (events [i].level != !(i & 1)) ||
+	(events [i].edge != ((i & 1) ? INT_EDGE_FALLING : INT_EDGE_RISING)) ||
+	((i > 0) && (events [i].timestamp <= events [i - 1].timestamp)))
+      ok = 0 ;
+  check (ok, "6 edges, in order, with levels") ;
+  check (wpiEventRingOverflow (ring) == 0, "no overflow") ;
+
+  n = wpiEventRingRead (small, events, 16) ;
+  check ((n == 2) && (wpiEventRingOverflow (small) == 1), "3 rising edges into 2: 1 overflow") ;
+
+  wpiEventRingClose (ring) ;
+  wpiEventRingClose (small) ;
+
+  if (failed)
+  {
+    printf ("FAIL\n") ;
+    return 1 ;
+  }
+  printf ("OK\n") ;
+  return 0 ;
+}
@@ -0,0 +1,228 @@
+/*
+ * isrBench.c:
+ *	Compare the two ways of dispatching pin interrupts: a thread per pin
+ *	blocked in poll (), as wiringPiISR used to do, and the single epoll
+ *	dispatcher it uses now. Pipes stand in for the /sys/class/gpio value
+ *	files, so this runs anywhere. Every round "fires" all the pins at
+ *	once and waits for every callback, like several inputs changing
+ *	together.
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+
+#define	MAX_PINS	64
+#define	ROUNDS		2000
+
+static int numPins ;
+static int pipes [MAX_PINS][2] ;
+static volatile int fired ;
+
+
+// The "ISR": count it
+
+static void callback (void)
+{
+  __atomic_add_fetch (&fired, 1, __ATOMIC_RELEASE) ;
+}
+
+
+/*
+ * Thread per pin
+ *********************************************************************************
+ */
+
+static void *pinThread (void *arg)
+{
+  struct pollfd polls ;
+  uint8_t c ;
+
+  polls.fd     = pipes [(intptr_t)arg][0] ;
+  polls.events = POLLIN ;
+
+  for (;;)
+  {
+    if (poll (&polls, 1, -1) < 0)
+      continue ;
+    if (read (polls.fd, &c, 1) != 1)	// Closed: done
+      break ;
+    callback () ;
+  }
+  return NULL ;
+}
+
+
+/*
+ * One epoll dispatcher
+ *********************************************************************************
+ */
+
+static int epfd ;
+
+static void *dispatcher (void *arg)
+{
+  struct epoll_event events [16] ;
+  int n, i, closed = 0 ;
+  uint8_t c ;
+
+  while (closed < numPins)
+  {
+    if ((n = epoll_wait (epfd, events, 16, -1)) < 0)
+      continue ;
+    for (i = 0 ; i < n ; ++i)
+    {
+      if (read (events [i].data.fd, &c, 1) != 1)
+      {
+	epoll_ctl (epfd, EPOLL_CTL_DEL, events [i].data.fd, NULL) ;
+	++closed ;
+	continue ;
+      }
+      callback () ;
+    }
+  }
+  return NULL ;
+}
+
+
+/*
+ * Measuring
+ *********************************************************************************
+ */
+
+static double nowUs (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (double)ts.tv_sec * 1.0e6 + (double)ts.tv_nsec / 1.0e3 ;
+}
+
+static long procStatus (const char *field)
+{
+  char line [128] ;
+  long value = -1 ;
+  FILE *f ;
+
+  if ((f = fopen ("/proc/self/status", "r")) == NULL)
+    return -1 ;
+  while (fgets (line, sizeof (line), f) != NULL)
+    if (strncmp (line, field, strlen (field)) == 0)
+      value = atol (line + strlen (field) + 1) ;
+  fclose (f) ;
+  return value ;
+}
+
+
+/*
+ * run:
+ *	Fire every pin, wait for all the callbacks; ROUNDS times. Report
+ *	the rate and what the model costs in threads and memory.
+ *********************************************************************************
+ */
+
+static void run (const char *name, int perPin)
+{
+  pthread_t threads [MAX_PINS] ;
+  struct epoll_event ev ;
+  int i, round, nThreads, want ;
+  long threadsNow, vmNow, vmBase ;
+  double start, took ;
+
+  for (i = 0 ; i < numPins ; ++i)
+    if (pipe (pipes [i]) < 0)
+    {
+      perror ("pipe") ;
+      exit (EXIT_FAILURE) ;
+    }
+
+  vmBase = procStatus ("VmSize:") ;
+  fired  = 0 ;
+
+  if (perPin)
+  {
+    for (i = 0 ; i < numPins ; ++i)
+      pthread_create (&threads [i], NULL, pinThread, (void *)(intptr_t)i) ;
+    nThreads = numPins ;
+  }
+  else
+  {
+    epfd = epoll_create1 (0) ;
+    for (i = 0 ; i < numPins ; ++i)
+    {
+      ev.events  = EPOLLIN ;
+      ev.data.fd = pipes [i][0] ;
+      epoll_ctl (epfd, EPOLL_CTL_ADD, pipes [i][0], &ev) ;
+    }
+    pthread_create (&threads [0], NULL, dispatcher, NULL) ;
+    nThreads = 1 ;
+  }
+
+  threadsNow = procStatus ("Threads:") ;
+  vmNow      = procStatus ("VmSize:") ;
+
+  start = nowUs () ;
+  for (round = 0 ; round < ROUNDS ; ++round)
+  {
+    want = (round + 1) * numPins ;
+    for (i = 0 ; i < numPins ; ++i)
+      (void)write (pipes [i][1], "x", 1) ;
+    while (__atomic_load_n (&fired, __ATOMIC_ACQUIRE) < want)
+      sched_yield () ;
+  }
+  took = nowUs () - start ;
+
+  for (i = 0 ; i < numPins ; ++i)	// Closing the pipes stops the threads
+    close (pipes [i][1]) ;
+  for (i = 0 ; i < nThreads ; ++i)
+    pthread_join (threads [i], NULL) ;
+  for (i = 0 ; i < numPins ; ++i)
+    close (pipes [i][0]) ;
+  if (!perPin)
+    close (epfd) ;
+
+  printf ("  %-16s %3ld threads  %7ld KB VM  %8.0f events/s  %6.2f uS/round\n",
+	name, threadsNow, vmNow - vmBase, numPins * ROUNDS / (took / 1.0e6), took / ROUNDS) ;
+}
+
+
+int main (int argc, char *argv [])
+{
+  numPins = (argc > 1) ? atoi (argv [1]) : 20 ;
+  if ((numPins < 1) || (numPins > MAX_PINS))
+  {
+    fprintf (stderr, "Usage: %s [pins 1-%d]\n", argv [0], MAX_PINS) ;
+    return 1 ;
+  }
+
+  printf ("Interrupt dispatch: %d pins all firing, %d rounds\n", numPins, ROUNDS) ;
+  run ("epoll",          0) ;	// First, or it reuses the freed stacks
+  run ("thread per pin", 1) ;
+  return 0 ;
+}
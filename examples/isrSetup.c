@@ -0,0 +1,86 @@
+/*
+ * isrSetup.c:
+ *	Time how long wiringPiISR takes to set up each pin - export, edge
+ *	and hooking it into the dispatcher - and, for comparison, how long
+ *	the same setup takes by running "gpio edge" as a separate process.
+ *	Needs the board (and root or the gpio group).
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// wiringPi pins 0-7
+
+#define	PINS	8
+
+static void dummy (void) {}
+
+
+int main (void)
+{
+  unsigned int start, took, total ;
+  char pinS [8] ;
+  pid_t pid ;
+  int pin ;
+
+  if (wiringPiSetup () < 0)
+    return 1 ;
+
+  printf ("wiringPiISR setup time, uS:\n") ;
+  total = 0 ;
+  for (pin = 0 ; pin < PINS ; ++pin)
+  {
+    start = micros () ;
+    wiringPiISR (pin, INT_EDGE_BOTH, dummy) ;
+    took = micros () - start ;
+    total += took ;
+    printf ("  pin %d: %6u\n", pin, took) ;
+  }
+  printf ("  total: %6u\n", total) ;
+
+  if (access ("/usr/local/bin/gpio", X_OK) != 0)
+    return 0 ;
+
+  printf ("gpio edge, uS:\n") ;
+  total = 0 ;
+  for (pin = 0 ; pin < PINS ; ++pin)
+  {
+    sprintf (pinS, "%d", wpiPinToGpio (pin)) ;
+    start = micros () ;
+    if ((pid = fork ()) == 0)
+    {
+      execl ("/usr/local/bin/gpio", "gpio", "edge", pinS, "both", (char *)NULL) ;
+      _exit (1) ;
+    }
+    waitpid (pid, NULL, 0) ;
+    took = micros () - start ;
+    total += took ;
+    printf ("  pin %d: %6u\n", pin, took) ;
+  }
+  printf ("  total: %6u\n", total) ;
+
+  return 0 ;
+}
@@ -0,0 +1,165 @@
+/*
+ * pwmSync.c:
+ *	Check the register sequence of a synchronised PWM commit. The
+ *	writes pwmCommit () would make are planned against a plain memory
+ *	buffer standing in for the PWM block and checked: every restarted
+ *	channel is stopped before anything is set up, the restarts come
+ *	last and back to back, and a value-only change is just the duty
+ *	stores.
+ *
+ *	Needs PWM2 and PWM3 in PWM mode, so run it on the board or with
+ *	WIRINGPI_SIM= set.
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// PWM2 and PWM3: GPIO7_C6 and GPIO7_C7, channels 2 and 3
+
+#define	PIN_A		238
+#define	PIN_B		239
+#define	CHAN_A		2
+#define	CHAN_B		3
+
+#define	CTR(n)		((0x10 * (n) + 0x0C) / 4)
+#define	PERIOD(n)	((0x10 * (n) + 0x04) / 4)
+#define	DUTY(n)		((0x10 * (n) + 0x08) / 4)
+
+#define	CTR_RUN		0x13		// Enabled, continuous, inactive high
+
+static unsigned int block [1024] ;
+static int failed = 0 ;
+
+
+static void check (int ok, const char *what)
+{
+  printf ("  %-50s %s\n", what, ok ? "ok" : "FAIL") ;
+  if (!ok)
+    ++failed ;
+}
+
+
+/*
+ * plan:
+ *	Plan the staged writes against the buffer, check the ordering rules
+ *	and apply them to it. Returns the number of writes.
+ *********************************************************************************
+ */
+
+static int plan (struct asus_pwm_op *ops)
+{
+  int count, i, firstSetup, lastStop, firstStart, ordered, unique ;
+  unsigned int seen [1024] ;
+
+  count = asus_pwm_plan (block, ops) ;
+
+  firstSetup = firstStart = count ;
+  lastStop   = -1 ;
+  for (i = 0 ; i < count ; ++i)
+  {
+    if ((ops [i].offset & 0x0F) != 0x0C)
+    {
+      if (firstSetup == count)
+	firstSetup = i ;
+    }
+    else if ((ops [i].value & 1) == 0)
+      lastStop = i ;
+    else if (firstStart == count)
+      firstStart = i ;
+  }
+
+  ordered = (lastStop < firstSetup) && (lastStop < firstStart) ;
+  for (i = firstStart ; i < count ; ++i)		// Starts are last and together
+    if (((ops [i].offset & 0x0F) != 0x0C) || ((ops [i].value & 1) == 0))
+      ordered = 0 ;
+  check (ordered, "stops first, starts last and back to back") ;
+
+  unique = 1 ;
+  memset (seen, 0, sizeof (seen)) ;			// No register written twice,
+  for (i = 0 ; i < count ; ++i)				//  bar CTR's stop and start
+    if (++seen [ops [i].offset / 4] > (((ops [i].offset & 0x0F) == 0x0C) ? 2 : 1))
+      unique = 0 ;
+  check (unique, "no redundant writes") ;
+
+  asus_pwm_apply (block, ops, count) ;
+  return count ;
+}
+
+
+int main (void)
+{
+  struct asus_pwm_op ops [ASUS_PWM_MAX_OPS] ;
+  int count ;
+
+  if (wiringPiSetupGpio () < 0)
+    return 1 ;
+
+  pinMode (PIN_A, PWM_OUTPUT) ;
+  pinMode (PIN_B, PWM_OUTPUT) ;
+
+  printf ("Synchronised PWM commit\n") ;
+
+// Both channels from scratch: period, value and clock
+
+  printf ("Start two channels:\n") ;
+  pwmStage (PIN_A, 1000, 250, 4) ;
+  pwmStage (PIN_B, 1000, 500, 4) ;
+  count = plan (ops) ;
+  check (count == 8, "2 stops, 2 periods, 2 duties, 2 starts") ;
+  check ((block [PERIOD (CHAN_A)] == 1000) && (block [DUTY (CHAN_A)] == 750), "channel 2 period and duty") ;
+  check ((block [PERIOD (CHAN_B)] == 1000) && (block [DUTY (CHAN_B)] == 500), "channel 3 period and duty") ;
+  check ((block [CTR (CHAN_A)] == (CTR_RUN | (2 << 16) | (1 << 9))) && (block [CTR (CHAN_A)] == block [CTR (CHAN_B)]),
+	"both running with the new clock") ;
+  pwmCommit () ;
+
+// Value only: just the duty stores
+
+  printf ("Change both values:\n") ;
+  pwmStage (PIN_A, -1, 100, -1) ;
+  pwmStage (PIN_B, -1, 900, -1) ;
+  count = plan (ops) ;
+  check ((count == 2) && (ops [0].offset / 4 == DUTY (CHAN_A)) && (ops [1].offset / 4 == DUTY (CHAN_B)),
+	"2 duty writes, no restart") ;
+  check ((block [DUTY (CHAN_A)] == 900) && (block [DUTY (CHAN_B)] == 100), "new duties") ;
+  pwmCommit () ;
+
+// New period on one channel: it restarts and keeps its value
+
+  printf ("Change one period:\n") ;
+  pwmStage (PIN_A, 2000, -1, -1) ;
+  count = plan (ops) ;
+  check (count == 4, "stop, period, duty, start") ;
+  check ((block [PERIOD (CHAN_A)] == 2000) && (block [DUTY (CHAN_A)] == 1900), "value kept") ;
+  check (block [PERIOD (CHAN_B)] == 1000, "other channel untouched") ;
+  pwmCommit () ;
+
+  if (failed)
+  {
+    printf ("FAIL\n") ;
+    return 1 ;
+  }
+  printf ("OK\n") ;
+  return 0 ;
+}
@@ -0,0 +1,220 @@
+/*
+ * rtJitter.c:
+ *	How late a periodic thread wakes up, first as piThreadCreate ()
+ *	starts it by default, then with the real-time configuration:
+ *	SCHED_FIFO, pinned to one CPU (ideally one kept free with
+ *	isolcpus=), memory locked and a small stack. Each wakeup is an
+ *	absolute clock_nanosleep (), with no spinning to hide the latency.
+ *	Results go to stdout as JSON, the lateness in nS as percentiles.
+ *
+ *	Needs root for the real-time run to mean anything; without it the
+ *	settings that fail are reported and the run goes ahead anyway. The
+ *	policy the thread really ran under is in each result.
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+static int samples  = 10000 ;
+static int interval = 1000 ;		// uS
+static int cpu      = -1 ;
+static int priority = 80 ;
+static int results  = 0 ;
+
+static double *lateness ;
+static int policy, rtPriority ;		// What the thread ran with
+
+
+/*
+ * Timing
+ *********************************************************************************
+ */
+
+static uint64_t monoNs (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
+
+static int cmpDouble (const void *a, const void *b)
+{
+  double x = *(const double *)a ;
+  double y = *(const double *)b ;
+
+  return (x > y) - (x < y) ;
+}
+
+static double percentile (const double *sorted, int n, double p)
+{
+  int i = (int)(p * (n - 1) + 0.5) ;
+
+  return sorted [i] ;
+}
+
+
+/*
+ * measure:
+ *	The thread: wake up every interval and note how late it was.
+ *********************************************************************************
+ */
+
+static PI_THREAD (measure)
+{
+  struct sched_param param ;
+  struct timespec ts ;
+  uint64_t next = monoNs () + 10000000ULL ;
+  int i ;
+
+  policy     = sched_getscheduler (0) ;
+  rtPriority = (sched_getparam (0, &param) == 0) ? param.sched_priority : -1 ;
+
+  for (i = 0 ; i < samples ; ++i)
+  {
+    ts.tv_sec  = next / 1000000000ULL ;
+    ts.tv_nsec = next % 1000000000ULL ;
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+    lateness [i] = (double)(monoNs () - next) ;
+    next += interval * 1000ULL ;
+  }
+
+  return NULL ;
+}
+
+static const char *policyName (int p)
+{
+  switch (p)
+  {
+    case SCHED_OTHER: return "SCHED_OTHER" ;
+    case SCHED_FIFO:  return "SCHED_FIFO" ;
+    case SCHED_RR:    return "SCHED_RR" ;
+    default:          return "unknown" ;
+  }
+}
+
+
+/*
+ * runOne:
+ *	Measure with the current WPI_THREAD_USER configuration - the one
+ *	piThreadCreate () uses - and print the JSON entry for it.
+ *********************************************************************************
+ */
+
+static void runOne (const char *name)
+{
+  pthread_t thread ;
+  double sum = 0.0 ;
+  int i, err ;
+
+  if ((err = wpiThreadCreate (&thread, WPI_THREAD_USER, measure, NULL)) != 0)
+  {
+    fprintf (stderr, "rtJitter: unable to start the thread: %s\n", strerror (err)) ;
+    exit (EXIT_FAILURE) ;
+  }
+  pthread_join (thread, NULL) ;
+
+  if ((err = wpiThreadSchedError (WPI_THREAD_USER)) != 0)
+    fprintf (stderr, "rtJitter: %s: the thread couldn't take its scheduling: %s\n", name, strerror (err)) ;
+
+  for (i = 0 ; i < samples ; ++i)
+    sum += lateness [i] ;
+  qsort (lateness, samples, sizeof (double), cmpDouble) ;
+
+  printf ("%s\n    { \"config\": \"%s\", \"policy\": \"%s\", \"priority\": %d, \"interval_us\": %d, \"unit\": \"ns late\", ",
+	(results++ == 0) ? "" : ",", name, policyName (policy), rtPriority, interval) ;
+  printf ("\"min\": %.0f, \"p50\": %.0f, \"p99\": %.0f, \"p999\": %.0f, \"max\": %.0f, \"mean\": %.0f }",
+	lateness [0],
+	percentile (lateness, samples, 0.50),
+	percentile (lateness, samples, 0.99),
+	percentile (lateness, samples, 0.999),
+	lateness [samples - 1],
+	sum / samples) ;
+  fflush (stdout) ;
+}
+
+
+static void usage (const char *prog)
+{
+  fprintf (stderr, "Usage: %s [-c cpu] [-p priority] [-i intervalUs] [-n samples]\n", prog) ;
+  exit (EXIT_FAILURE) ;
+}
+
+
+int main (int argc, char *argv [])
+{
+  struct wpiThreadConfig cfg ;
+  int opt ;
+
+  while ((opt = getopt (argc, argv, "c:p:i:n:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'c': cpu      = atoi (optarg) ; break ;
+      case 'p': priority = atoi (optarg) ; break ;
+      case 'i': interval = atoi (optarg) ; break ;
+      case 'n': samples  = atoi (optarg) ; break ;
+      default:  usage (argv [0]) ;
+    }
+  }
+  if ((samples < 1) || (interval < 1) || (cpu < -1) || (cpu > 63))
+    usage (argv [0]) ;
+
+  if ((lateness = malloc (samples * sizeof (double))) == NULL)
+  {
+    fprintf (stderr, "%s: Out of memory\n", argv [0]) ;
+    return EXIT_FAILURE ;
+  }
+
+  if (wiringPiSetupGpio () < 0)
+    return EXIT_FAILURE ;
+
+  printf ("{\n  \"bench\": \"rtJitter\",\n  \"samples\": %d,\n  \"cpu\": %d,\n  \"results\": [", samples, cpu) ;
+
+  runOne ("default") ;
+
+  wpiThreadConfigGet (WPI_THREAD_USER, &cfg) ;
+  cfg.policy    = WPI_SCHED_FIFO ;
+  cfg.priority  = priority ;
+  cfg.cpus      = (cpu < 0) ? 0 : 1ULL << cpu ;
+  cfg.stackSize = 64 * 1024 ;
+  if (wpiThreadConfigSet (WPI_THREAD_USER, &cfg) < 0)
+    fprintf (stderr, "rtJitter: unable to set the real-time configuration: %s\n", strerror (errno)) ;
+  if (wpiMemoryLock (256 * 1024) < 0)
+    fprintf (stderr, "rtJitter: unable to lock memory: %s\n", strerror (errno)) ;
+
+  runOne ("realtime") ;
+
+  printf ("\n  ]\n}\n") ;
+
+  free (lateness) ;
+  return 0 ;
+}
@@ -36,18 +36,25 @@ int scale [8] = { 262, 294, 330, 349, 392, 440, 494, 525 } ;
 
 int main ()
 {
+  struct softToneNote notes [8] ;
   int i ;
 
   wiringPiSetup () ;
 
   softToneCreate (PIN) ;
 
+  for (i = 0 ; i < 8 ; ++i)
+  {
+    notes [i].freq     = scale [i] ;
+    notes [i].duration = 500 ;
+  }
+
   for (;;)
   {
-    for (i = 0 ; i < 8 ; ++i)
+    softToneQueue (PIN, notes, 8) ;
+    while (softToneQueued (PIN) > 0)
     {
-      printf ("%3d\n", i) ;
-      softToneWrite (PIN, scale [i]) ;
+      printf ("%3d\n", 8 - softToneQueued (PIN)) ;
       delay (500) ;
     }
   }
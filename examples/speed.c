@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #define	FAST_COUNT	10000000
 #define	SLOW_COUNT	 1000000
@@ -57,10 +58,63 @@ void speedTest (int pin, int maxCount)
   printf (": %7d/sec\n", perSec) ;
 }
 
+void speedTestHandle (int pin, int maxCount)
+{
+  int count, sum, perSec, i ;
+  unsigned int start, end ;
+  wpiPinHandle h ;
+
+  h   = wpiPinOpen (pin) ;
+  sum = 0 ;
+
+  for (i = 0 ; i < PASSES ; ++i)
+  {
+    start = millis () ;
+    for (count = 0 ; count < maxCount ; ++count)
+      wpiHandleWrite (h, 1) ;
+    end = millis () ;
+    printf (" %6d", end - start) ;
+    fflush (stdout) ;
+    sum += (end - start) ;
+  }
+
+  wpiHandleWrite (h, 0) ;
+  printf (". Av: %6dmS", sum / PASSES) ;
+  perSec = (int)(double)maxCount / (double)((double)sum / (double)PASSES) * 1000.0 ;
+  printf (": %7d/sec\n", perSec) ;
+}
+
+
+/*
+ * sysExport:
+ *	Export a GPIO as an output in /sys/class/gpio for the sys mode test
+ *********************************************************************************
+ */
+
+static int sysExport (int gpio)
+{
+  char fName [64] ;
+  FILE *fd ;
+
+  sprintf (fName, "/sys/class/gpio/gpio%d/direction", gpio) ;
+  if (access (fName, W_OK) != 0)
+  {
+    if ((fd = fopen ("/sys/class/gpio/export", "w")) == NULL)
+      return 0 ;
+    fprintf (fd, "%d\n", gpio) ;
+    fclose (fd) ;
+  }
+  if ((fd = fopen (fName, "w")) == NULL)
+    return 0 ;
+  fprintf (fd, "out\n") ;
+  fclose (fd) ;
+  return 1 ;
+}
+
 
 int main (void)
 {
-  printf ("Raspberry Pi wiringPi GPIO speed test program\n") ;
+  printf ("Tinker Board wiringPi GPIO speed test program\n") ;
   printf ("=============================================\n") ;
 
 // Start the standard way
@@ -70,7 +124,12 @@ int main (void)
   pinMode (7, OUTPUT) ;
   speedTest (7, FAST_COUNT) ;
 
-// GPIO
+// Pre-resolved pin handle
+
+  printf ("\nPin handle method: (%8d iterations)\n", FAST_COUNT) ;
+  speedTestHandle (7, FAST_COUNT) ;
+
+// GPIO: wiringPi pin 7 and physical pin 7 are GPIO0_C1, CPU GPIO 17
 
   printf ("\nNative GPIO method: (%8d iterations)\n", FAST_COUNT) ;
   wiringPiSetupGpio () ;
@@ -86,7 +145,11 @@ int main (void)
 
 // Switch to SYS mode:
 
-  system ("/usr/local/bin/gpio export 17 out") ;
+  if (!sysExport (17))
+  {
+    printf ("\n/sys/class/gpio method: Unable to export GPIO 17 - skipped\n") ;
+    return 0 ;
+  }
   printf ("\n/sys/class/gpio method: (%8d iterations)\n", SLOW_COUNT) ;
   wiringPiSetupSys () ;
   speedTest (17, SLOW_COUNT) ;
@@ -0,0 +1,349 @@
+/*
+ * wpiBench.c:
+ *	Micro-benchmarks for the core GPIO calls, in each of the pin
+ *	numbering modes. Results go to stdout as JSON, one entry per call
+ *	and mode, with the per operation time in nS as percentiles over
+ *	many timed batches - so releases can be compared by a script.
+ *	Progress and notes go to stderr.
+ *
+ *	Then the cost of finding an extension pin's node, with 1, 8 and
+ *	64 nodes set up: wiringPiFindNode (), a digitalRead through it,
+ *	and the old walk of wiringPiNodes for comparison. The pin looked
+ *	up is on the first node, at the end of the list.
+ *
+ *	Runs against the simulated registers too (WIRINGPI_SIM=), so it
+ *	can be used without a board.
+ *
+ * Copyright (c) 2012-2013 Gordon Henderson. <projects@drogon.net>
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <wiringPi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#define	DEF_BATCHES	  200
+#define	DEF_OPS		 1000
+
+// Expander pins: a dummy node held in memory
+
+#define	NODE_BASE	  600	// Above the on-board range (PI_GPIO_MASK)
+#define	NODE_PINS	   16
+
+static int batches = DEF_BATCHES ;
+static int opsPerBatch = DEF_OPS ;
+static int results = 0 ;
+
+static volatile int sink ;
+
+// The pins used in each mode: an output and a PWM capable pin
+
+struct benchMode
+{
+  const char *name ;
+  int (*setup)(void) ;
+  int out ;
+  int pwm ;
+} ;
+
+static struct benchMode modes [] =
+{
+  { "wpi",  wiringPiSetup,      7,  23 },	// GPIO0_C1, GPIO7_C6/PWM2
+  { "gpio", wiringPiSetupGpio, 17, 238 },
+  { "phys", wiringPiSetupPhys,  7,  33 },
+  { "sys",  wiringPiSetupSys,  17,  -1 },
+  { NULL,   NULL,               0,   0 },
+} ;
+
+static int benchOut ;
+static int benchPwm ;
+
+
+/*
+ * The dummy expander node
+ *********************************************************************************
+ */
+
+static void dummyPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  if (mode == OUTPUT)
+    node->data1 |=  (1 << (pin - node->pinBase)) ;
+  else
+    node->data1 &= ~(1 << (pin - node->pinBase)) ;
+}
+
+static void dummyPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int pud)
+{
+  node->data2 = pud ;
+}
+
+static int dummyDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  return (node->data0 >> (pin - node->pinBase)) & 1 ;
+}
+
+static void dummyDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  if (value == LOW)
+    node->data0 &= ~(1 << (pin - node->pinBase)) ;
+  else
+    node->data0 |=  (1 << (pin - node->pinBase)) ;
+}
+
+static void dummyPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  node->data3 = value ;
+}
+
+static void dummySetup (int pinBase)
+{
+  struct wiringPiNodeStruct *node ;
+
+  if (wiringPiFindNode (pinBase) != NULL)
+    return ;
+
+  node = wiringPiNewNode (pinBase, NODE_PINS) ;
+  node->pinMode         = dummyPinMode ;
+  node->pullUpDnControl = dummyPullUpDnControl ;
+  node->digitalRead     = dummyDigitalRead ;
+  node->digitalWrite    = dummyDigitalWrite ;
+  node->pwmWrite        = dummyPwmWrite ;
+}
+
+
+/*
+ * The operations
+ *********************************************************************************
+ */
+
+static void opWrite     (int i) { digitalWrite (benchOut, i & 1) ; }
+static void opRead      (int i) { sink = digitalRead (benchOut) ; }
+static void opPinMode   (int i) { pinMode (benchOut, OUTPUT) ; }
+static void opPud       (int i) { pullUpDnControl (benchOut, (i & 1) ? PUD_UP : PUD_DOWN) ; }
+static void opPwm       (int i) { pwmWrite (benchPwm, i & 1023) ; }
+static void opGetAlt    (int i) { sink = getAlt (benchOut) ; }
+static void opWriteByte (int i) { digitalWriteByte (i & 0xFF) ; }
+
+static void opNodeWrite (int i) { digitalWrite (NODE_BASE + (i & 15), i & 1) ; }
+static void opNodeRead  (int i) { sink = digitalRead (NODE_BASE + (i & 15)) ; }
+static void opNodeMode  (int i) { pinMode (NODE_BASE + (i & 15), OUTPUT) ; }
+static void opNodePud   (int i) { pullUpDnControl (NODE_BASE + (i & 15), PUD_OFF) ; }
+static void opNodePwm   (int i) { pwmWrite (NODE_BASE + (i & 15), i & 1023) ; }
+
+static void opFindNode  (int i) { sink = (wiringPiFindNode (NODE_BASE + (i & 15)) != NULL) ; }
+
+static void opListWalk  (int i)
+{
+  struct wiringPiNodeStruct *node ;
+  int pin = NODE_BASE + (i & 15) ;
+
+  for (node = wiringPiNodes ; node != NULL ; node = node->next)
+    if ((pin >= node->pinBase) && (pin <= node->pinMax))
+      break ;
+  sink = (node != NULL) ;
+}
+
+struct benchOp
+{
+  const char *name ;
+  void (*fn)(int i) ;
+  int needsPwm ;
+} ;
+
+static struct benchOp ops [] =
+{
+  { "digitalWrite",           opWrite,     0 },
+  { "digitalRead",            opRead,      0 },
+  { "pinMode",                opPinMode,   0 },
+  { "pullUpDnControl",        opPud,       0 },
+  { "pwmWrite",               opPwm,       1 },
+  { "getAlt",                 opGetAlt,    0 },
+  { "digitalWriteByte",       opWriteByte, 0 },
+  { "node.digitalWrite",      opNodeWrite, 0 },
+  { "node.digitalRead",       opNodeRead,  0 },
+  { "node.pinMode",           opNodeMode,  0 },
+  { "node.pullUpDnControl",   opNodePud,   0 },
+  { "node.pwmWrite",          opNodePwm,   0 },
+  { NULL,                     NULL,        0 },
+} ;
+
+static struct benchOp nodeOps [] =
+{
+  { "wiringPiFindNode",       opFindNode,  0 },
+  { "node.digitalRead",       opNodeRead,  0 },
+  { "listWalk",               opListWalk,  0 },
+  { NULL,                     NULL,        0 },
+} ;
+
+static const int nodeCounts [] = { 1, 8, 64, 0 } ;
+
+
+/*
+ * Timing
+ *********************************************************************************
+ */
+
+static double nowNs (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (double)ts.tv_sec * 1.0e9 + (double)ts.tv_nsec ;
+}
+
+static int cmpDouble (const void *a, const void *b)
+{
+  double x = *(const double *)a ;
+  double y = *(const double *)b ;
+
+  return (x > y) - (x < y) ;
+}
+
+static double percentile (const double *sorted, int n, double p)
+{
+  int i = (int)(p * (n - 1) + 0.5) ;
+
+  return sorted [i] ;
+}
+
+
+/*
+ * benchOne:
+ *	Time batches of one operation and print the JSON entry for it.
+ *********************************************************************************
+ */
+
+static void benchOne (const char *mode, struct benchOp *op, double *samples)
+{
+  int b, i ;
+  double start, sum ;
+
+  for (i = 0 ; i < opsPerBatch ; ++i)	// Warm up
+    op->fn (i) ;
+
+  sum = 0.0 ;
+  for (b = 0 ; b < batches ; ++b)
+  {
+    start = nowNs () ;
+    for (i = 0 ; i < opsPerBatch ; ++i)
+      op->fn (i) ;
+    samples [b] = (nowNs () - start) / opsPerBatch ;
+    sum += samples [b] ;
+  }
+  qsort (samples, batches, sizeof (double), cmpDouble) ;
+
+  printf ("%s\n    { \"op\": \"%s\", \"mode\": \"%s\", \"unit\": \"ns/op\", ",
+	(results++ == 0) ? "" : ",", op->name, mode) ;
+  printf ("\"min\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f, \"mean\": %.2f }",
+	samples [0],
+	percentile (samples, batches, 0.50),
+	percentile (samples, batches, 0.90),
+	percentile (samples, batches, 0.99),
+	samples [batches - 1],
+	sum / batches) ;
+  fflush (stdout) ;
+}
+
+
+static void usage (const char *prog)
+{
+  fprintf (stderr, "Usage: %s [-b batches] [-n opsPerBatch]\n", prog) ;
+  exit (EXIT_FAILURE) ;
+}
+
+
+int main (int argc, char *argv [])
+{
+  struct benchMode *m ;
+  struct benchOp *op ;
+  double *samples ;
+  char fName [64] ;
+  int opt, n, nodes ;
+
+  while ((opt = getopt (argc, argv, "b:n:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'b': batches     = atoi (optarg) ; break ;
+      case 'n': opsPerBatch = atoi (optarg) ; break ;
+      default:  usage (argv [0]) ;
+    }
+  }
+  if ((batches < 1) || (opsPerBatch < 1))
+    usage (argv [0]) ;
+
+  if ((samples = malloc (batches * sizeof (double))) == NULL)
+  {
+    fprintf (stderr, "%s: Out of memory\n", argv [0]) ;
+    return EXIT_FAILURE ;
+  }
+
+  printf ("{\n  \"bench\": \"wpiBench\",\n  \"simulated\": %s,\n  \"batches\": %d,\n  \"opsPerBatch\": %d,\n  \"results\": [",
+	(getenv ("WIRINGPI_SIM") != NULL) ? "true" : "false", batches, opsPerBatch) ;
+
+  for (m = modes ; m->name != NULL ; ++m)
+  {
+    if (m->setup == wiringPiSetupSys)	// Needs the pin exported
+    {
+      sprintf (fName, "/sys/class/gpio/gpio%d/value", m->out) ;
+      if (access (fName, W_OK) != 0)
+      {
+	fprintf (stderr, "wpiBench: %s mode skipped - export GPIO %d as an output first\n", m->name, m->out) ;
+	continue ;
+      }
+    }
+
+    fprintf (stderr, "wpiBench: %s mode\n", m->name) ;
+    m->setup () ;
+    dummySetup (NODE_BASE) ;
+    benchOut = m->out ;
+    benchPwm = m->pwm ;
+
+    pinMode (benchOut, OUTPUT) ;
+    if (benchPwm != -1)
+      pinMode (benchPwm, PWM_OUTPUT) ;
+
+    for (op = ops ; op->name != NULL ; ++op)
+    {
+      if (op->needsPwm && (benchPwm == -1))
+	continue ;
+      benchOne (m->name, op, samples) ;
+    }
+
+    digitalWrite (benchOut, LOW) ;
+  }
+
+  fprintf (stderr, "wpiBench: node lookup\n") ;
+  for (nodes = 1, n = 0 ; nodeCounts [n] != 0 ; ++n)
+  {
+    for ( ; nodes < nodeCounts [n] ; ++nodes)
+      dummySetup (NODE_BASE + nodes * NODE_PINS) ;
+    sprintf (fName, "nodes-%d", nodeCounts [n]) ;
+    for (op = nodeOps ; op->name != NULL ; ++op)
+      benchOne (fName, op, samples) ;
+  }
+
+  printf ("\n  ]\n}\n") ;
+  free (samples) ;
+  return 0 ;
+}
@@ -952,7 +952,7 @@ static void doAwrite (int argc, char *argv [])
 
 static void doWriteByte (int argc, char *argv [])
 {
-  int val ;
+  int val, pin, phys ;
 
   if (argc != 3)
   {
@@ -962,6 +962,22 @@ static void doWriteByte (int argc, char *argv [])
 
   val = (int)strtol (argv [2], NULL, 0) ;
 
+// The byte goes to wiringPi pins 0-7, make sure they are outputs
+
+  for (pin = 0 ; pin < 8 ; ++pin)
+  {
+    /**/ if (wpMode == WPI_MODE_PINS)
+      pinMode (pin, OUTPUT) ;
+    else if (wpMode == WPI_MODE_GPIO)
+      pinMode (wpiPinToGpio (pin), OUTPUT) ;
+    else if (wpMode == WPI_MODE_PHYS)
+    {
+      for (phys = 1 ; phys <= 40 ; ++phys)
+	if (physPinToGpio (phys) == wpiPinToGpio (pin))
+	  pinMode (phys, OUTPUT) ;
+    }
+  }
+
   digitalWriteByte (val) ;
 }
 
@@ -1279,7 +1295,7 @@ int main (int argc, char *argv [])
     return 0 ;
   }
 
-  if (geteuid () != 0)
+  if ((geteuid () != 0) && (getenv ("WIRINGPI_SIM") == NULL))	// Simulated registers need no root
   {
     fprintf (stderr, "%s: Must be root to run. Program should be suid root. This is an error.\n", argv [0]) ;
     return 1 ;
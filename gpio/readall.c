@@ -37,6 +37,10 @@
 
 extern int wpMode ;
 
+// Tinker: the header is sampled once, all pins at the same instant
+
+static struct wpiPinLevels physLevels ;
+
 static const char *asusPinModeToString (int mode)
 {
   if (mode == SERIAL)
@@ -202,6 +206,21 @@ int getAndTranslateAlt(int pin)
     return ret;
 }
 
+/*
+ * readallValue:
+ *        The value of a pin, from the snapshot on the Tinker Board
+ *********************************************************************************
+ */
+
+static int readallValue (int pin, int physPin, int model)
+{
+  if (model == PI_MODEL_TB)
+    return (int)((physLevels.phys >> physPin) & 1) ;
+  else
+    return digitalRead (pin) ;
+}
+
+
 /*
  * readallPhys:
  *        Given a physical pin output the data on it and the next pin:
@@ -235,7 +254,7 @@ static void readallPhys (int physPin, int model)
    else
      printf (" | %4s", alts [getAlt (pin)]) ;
 
-   printf (" | %d", digitalRead (pin)) ;
+   printf (" | %d", readallValue (pin, physPin, model)) ;
   }
 
 // Pin numbers:
@@ -257,7 +276,7 @@ static void readallPhys (int physPin, int model)
     else
       pin = physToWpi [physPin] ;
 
-   printf (" | %d", digitalRead (pin)) ;
+   printf (" | %d", readallValue (pin, physPin, model)) ;
    //printf (" |     ") ;
    if (model == PI_MODEL_TB)
      printf (" | %-4s", asusPinModeToString(getPinMode (pin))) ;
@@ -363,6 +382,9 @@ void piPlusReadall (int model)
 {
   int pin ;
 
+  if (model == PI_MODEL_TB)
+    (void)digitalReadAll (&physLevels) ;
+
   plus2header (model) ;
 
   printf (" | CPU | wPi |   Name  | Mode | V | Physical | V | Mode | Name    | wPi | CPU |\n") ;
@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# test_gpiosim.sh:
+#	Test the GPIO character device backend on a gpio-sim chip: makes a
+#	16 line chip through configfs, runs examples/gpioSim on it and takes
+#	it down again. Needs root and a kernel with gpio-sim.
+#################################################################################
+# This file is part of wiringPi:
+#	Wiring Compatable library for the Raspberry Pi
+#
+#    wiringPi is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU Lesser General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    wiringPi is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU Lesser General Public License for more details.
+#
+#    You should have received a copy of the GNU Lesser General Public License
+#    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+#################################################################################
+
+SIM=/sys/kernel/config/gpio-sim/wpitest
+TEST=${1:-../examples/gpioSim}
+
+modprobe gpio-sim 2> /dev/null
+mountpoint -q /sys/kernel/config || mount -t configfs none /sys/kernel/config 2> /dev/null
+
+if [ ! -d /sys/kernel/config/gpio-sim ];
+then
+  echo "gpio-sim not available - skipped"
+  exit 0
+fi
+
+mkdir $SIM $SIM/bank0 || exit 1
+echo 16 > $SIM/bank0/num_lines
+echo 1  > $SIM/live
+
+CHIP=`cat $SIM/bank0/chip_name`
+DEV=`cat $SIM/dev_name`
+
+$TEST $CHIP /sys/devices/platform/$DEV/$CHIP
+RESULT=$?
+
+echo 0 > $SIM/live
+rmdir $SIM/bank0 $SIM
+
+exit $RESULT
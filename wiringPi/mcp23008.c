@@ -139,11 +139,11 @@ int mcp23008Setup (const int pinBase, const int i2cAddress)
   node = wiringPiNewNode (pinBase, 8) ;
 
   node->fd              = fd ;
+  node->data2           = wiringPiI2CReadReg8 (fd, MCP23x08_OLAT) ;
   node->pinMode         = myPinMode ;
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = wiringPiI2CReadReg8 (fd, MCP23x08_OLAT) ;
 
   return 0 ;
 }
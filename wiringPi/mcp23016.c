@@ -154,11 +154,11 @@ int mcp23016Setup (const int pinBase, const int i2cAddress)
   node = wiringPiNewNode (pinBase, 16) ;
 
   node->fd              = fd ;
+  node->data2           = wiringPiI2CReadReg8 (fd, MCP23016_OLAT0) ;
+  node->data3           = wiringPiI2CReadReg8 (fd, MCP23016_OLAT1) ;
   node->pinMode         = myPinMode ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = wiringPiI2CReadReg8 (fd, MCP23016_OLAT0) ;
-  node->data3           = wiringPiI2CReadReg8 (fd, MCP23016_OLAT1) ;
 
   return 0 ;
 }
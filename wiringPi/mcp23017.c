@@ -184,12 +184,12 @@ int mcp23017Setup (const int pinBase, const int i2cAddress)
   node = wiringPiNewNode (pinBase, 16) ;
 
   node->fd              = fd ;
+  node->data2           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATA) ;
+  node->data3           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATB) ;
   node->pinMode         = myPinMode ;
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATA) ;
-  node->data3           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATB) ;
 
   return 0 ;
 }
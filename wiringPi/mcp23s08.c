@@ -179,11 +179,11 @@ int mcp23s08Setup (const int pinBase, const int spiPort, const int devId)
 
   node->data0           = spiPort ;
   node->data1           = devId ;
+  node->data2           = readByte (spiPort, devId, MCP23x08_OLAT) ;
   node->pinMode         = myPinMode ;
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = readByte (spiPort, devId, MCP23x08_OLAT) ;
 
   return 0 ;
 }
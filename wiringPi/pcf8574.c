@@ -117,10 +117,10 @@ int pcf8574Setup (const int pinBase, const int i2cAddress)
   node = wiringPiNewNode (pinBase, 8) ;
 
   node->fd           = fd ;
+  node->data2        = wiringPiI2CRead (fd) ;
   node->pinMode      = myPinMode ;
   node->digitalRead  = myDigitalRead ;
   node->digitalWrite = myDigitalWrite ;
-  node->data2        = wiringPiI2CRead (fd) ;
 
   return 0 ;
 }
@@ -2,6 +2,8 @@
  * piHiPri:
  *	Simple way to get your program running at high priority
  *	with realtime schedulling.
+ *	Also the scheduling, CPU affinity and stack configuration of
+ *	the threads wiringPi starts, and memory locking.
  *
  *	Copyright (c) 2012 Gordon Henderson
  ***********************************************************************
@@ -26,9 +28,78 @@
 
 #include <sched.h>
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <alloca.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include "wiringPi.h"
 
+#ifndef	SCHED_DEADLINE
+#define	SCHED_DEADLINE	6
+#endif
+
+// Threads of ours that are running, so a new configuration can be
+//	applied to them as well as to those started after it
+
+#define	MAX_RUNNING	32
+
+// The kernel's struct sched_attr, for SCHED_DEADLINE
+
+struct schedAttr
+{
+  uint32_t size ;
+  uint32_t policy ;
+  uint64_t flags ;
+  int32_t  nice ;
+  uint32_t priority ;
+  uint64_t runtime ;
+  uint64_t deadline ;
+  uint64_t period ;
+} ;
+
+// The defaults are what each thread used to set for itself. The soft
+//	PWM, tone and servo engines need very little stack. The ISR
+//	dispatchers run your code, so they get more - but still a bounded
+//	amount rather than the system default (often 8MiB, and all of it
+//	locked by wpiMemoryLock). An ISR that needs more stack wants
+//	wpiThreadConfigSet (WPI_THREAD_ISR, ...) with a bigger stackSize,
+//	or 0 for the system default, before the first wiringPiISR.
+
+static struct wpiThreadConfig configs [WPI_THREAD_CLASSES] =
+{
+  { WPI_SCHED_RR,      90, 0, 0, 0, 0, 64 * 1024  },	// softPwm
+  { WPI_SCHED_RR,      50, 0, 0, 0, 0, 64 * 1024  },	// softTone
+  { WPI_SCHED_RR,      50, 0, 0, 0, 0, 64 * 1024  },	// softServo
+  { WPI_SCHED_RR,      55, 0, 0, 0, 0, 256 * 1024 },	// ISR dispatchers
+  { WPI_SCHED_INHERIT,  0, 0, 0, 0, 0, 0          },	// piThreadCreate
+} ;
+
+// Why the last thread of each class to take its scheduling couldn't,
+//	as an errno, or 0 if it could
+
+static int schedErrors [WPI_THREAD_CLASSES] ;
+
+struct running
+{
+  pid_t tid ;				// 0 if the slot's free
+  int   cls ;
+} ;
+
+static struct running running [MAX_RUNNING] ;
+static pthread_mutex_t configMutex = PTHREAD_MUTEX_INITIALIZER ;
+
+struct start
+{
+  int     cls ;
+  void *(*fn)(void *) ;
+  void   *arg ;
+} ;
+
 
 /*
  * piHiPri:
@@ -49,3 +120,269 @@ int piHiPri (const int pri)
 
   return sched_setscheduler (0, SCHED_RR, &sched) ;
 }
+
+
+/*
+ * applySched:
+ *	Put a thread under a configuration's scheduling policy. The CPU
+ *	affinity is set separately: when the thread is created, or by
+ *	wpiThreadConfigSet.
+ *********************************************************************************
+ */
+
+static int applySched (pid_t tid, const struct wpiThreadConfig *c)
+{
+  struct sched_param param ;
+  struct schedAttr attr ;
+  int policy ;
+
+  memset (&param, 0, sizeof (param)) ;
+
+  switch (c->policy)
+  {
+    case WPI_SCHED_OTHER:
+      return sched_setscheduler (tid, SCHED_OTHER, &param) ;
+
+    case WPI_SCHED_FIFO:
+    case WPI_SCHED_RR:
+      policy = (c->policy == WPI_SCHED_FIFO) ? SCHED_FIFO : SCHED_RR ;
+      /**/ if (c->priority < sched_get_priority_min (policy))
+	param.sched_priority = sched_get_priority_min (policy) ;
+      else if (c->priority > sched_get_priority_max (policy))
+	param.sched_priority = sched_get_priority_max (policy) ;
+      else
+	param.sched_priority = c->priority ;
+      return sched_setscheduler (tid, policy, &param) ;
+
+    case WPI_SCHED_DEADLINE:
+      memset (&attr, 0, sizeof (attr)) ;
+      attr.size     = sizeof (attr) ;
+      attr.policy   = SCHED_DEADLINE ;
+      attr.runtime  = c->runtime ;
+      attr.deadline = c->deadline ;
+      attr.period   = c->period ;
+#ifdef	SYS_sched_setattr
+      return syscall (SYS_sched_setattr, tid, &attr, 0) ;
+#else
+      errno = ENOSYS ;
+      return -1 ;
+#endif
+  }
+
+  return 0 ;				// WPI_SCHED_INHERIT
+}
+
+static void cpuMask (uint64_t mask, cpu_set_t *cpus)
+{
+  int cpu ;
+
+  CPU_ZERO (cpus) ;
+  for (cpu = 0 ; cpu < 64 ; ++cpu)
+    if (mask & (1ULL << cpu))
+      CPU_SET (cpu, cpus) ;
+}
+
+
+/*
+ * wpiThreadConfigSet: wpiThreadConfigGet:
+ *	Set or get the configuration of a class of threads (WPI_THREAD_*).
+ *	Threads of the class that are already running get the new policy
+ *	and affinity straight away; the stack size is for those started
+ *	after. Returns -1 (with errno) if it couldn't be applied to one
+ *	that's running - usually because we're not root.
+ *********************************************************************************
+ */
+
+int wpiThreadConfigSet (int cls, const struct wpiThreadConfig *cfg)
+{
+  cpu_set_t cpus ;
+  int i, res = 0 ;
+
+  if ((cls < 0) || (cls >= WPI_THREAD_CLASSES))
+    return wiringPiFailure (WPI_ALMOST, "wpiThreadConfigSet: no such thread class (%d)\n", cls) ;
+  if ((cfg->policy < WPI_SCHED_INHERIT) || (cfg->policy > WPI_SCHED_DEADLINE))
+    return wiringPiFailure (WPI_ALMOST, "wpiThreadConfigSet: no such policy (%d)\n", cfg->policy) ;
+  if ((cfg->policy == WPI_SCHED_DEADLINE) &&
+	((cfg->runtime == 0) || (cfg->runtime > cfg->deadline) || ((cfg->period != 0) && (cfg->deadline > cfg->period))))
+    return wiringPiFailure (WPI_ALMOST, "wpiThreadConfigSet: need runtime <= deadline <= period\n") ;
+
+  pthread_mutex_lock (&configMutex) ;
+  configs [cls] = *cfg ;
+  for (i = 0 ; i < MAX_RUNNING ; ++i)
+  {
+    if ((running [i].tid == 0) || (running [i].cls != cls))
+      continue ;
+    if (cfg->cpus != 0)
+    {
+      cpuMask (cfg->cpus, &cpus) ;
+      if (sched_setaffinity (running [i].tid, sizeof (cpus), &cpus) < 0)
+	res = -1 ;
+    }
+    if (applySched (running [i].tid, cfg) < 0)
+    {
+      schedErrors [cls] = errno ;
+      res = -1 ;
+    }
+  }
+  pthread_mutex_unlock (&configMutex) ;
+
+  return res ;
+}
+
+int wpiThreadConfigGet (int cls, struct wpiThreadConfig *cfg)
+{
+  if ((cls < 0) || (cls >= WPI_THREAD_CLASSES))
+    return -1 ;
+
+  pthread_mutex_lock (&configMutex) ;
+  *cfg = configs [cls] ;
+  pthread_mutex_unlock (&configMutex) ;
+
+  return 0 ;
+}
+
+
+/*
+ * wpiThreadSchedError:
+ *	0 if the last thread of the class to start took its scheduling,
+ *	else the errno it failed with (EPERM if we're not root).
+ *********************************************************************************
+ */
+
+int wpiThreadSchedError (int cls)
+{
+  int err ;
+
+  if ((cls < 0) || (cls >= WPI_THREAD_CLASSES))
+    return EINVAL ;
+
+  pthread_mutex_lock (&configMutex) ;
+  err = schedErrors [cls] ;
+  pthread_mutex_unlock (&configMutex) ;
+
+  return err ;
+}
+
+
+/*
+ * threadStart: threadEnd:
+ *	Every thread we start begins here: it takes its class's scheduling
+ *	and goes on the running list until it ends. A thread that can't
+ *	take its scheduling - usually because we're not root - still runs,
+ *	as the threads always have, and the failure is kept for
+ *	wpiThreadSchedError.
+ *********************************************************************************
+ */
+
+static void threadEnd (void *slot)
+{
+  pthread_mutex_lock (&configMutex) ;
+  ((struct running *)slot)->tid = 0 ;
+  pthread_mutex_unlock (&configMutex) ;
+}
+
+static void *threadStart (void *arg)
+{
+  struct start start = *(struct start *)arg ;
+  struct running *slot = NULL ;
+  pid_t tid = syscall (SYS_gettid) ;
+  void *res ;
+  int i ;
+
+  free (arg) ;
+
+  pthread_mutex_lock (&configMutex) ;
+  schedErrors [start.cls] = (applySched (tid, &configs [start.cls]) < 0) ? errno : 0 ;
+  for (i = 0 ; (i < MAX_RUNNING) && (slot == NULL) ; ++i)
+    if (running [i].tid == 0)
+    {
+      slot      = &running [i] ;
+      slot->tid = tid ;
+      slot->cls = start.cls ;
+    }
+  pthread_mutex_unlock (&configMutex) ;
+
+  if (slot == NULL)
+    return start.fn (start.arg) ;
+
+  pthread_cleanup_push (threadEnd, slot) ;
+  res = start.fn (start.arg) ;
+  pthread_cleanup_pop (1) ;
+
+  return res ;
+}
+
+
+/*
+ * wpiThreadCreate:
+ *	Start a thread of the given class, with its stack size, CPU
+ *	affinity and scheduling. With a NULL thread it's detached.
+ *********************************************************************************
+ */
+
+int wpiThreadCreate (pthread_t *thread, int cls, void *(*fn)(void *), void *arg)
+{
+  struct wpiThreadConfig cfg ;
+  struct start *start ;
+  pthread_attr_t attr ;
+  pthread_t myThread ;
+  cpu_set_t cpus ;
+  int res ;
+
+  if (wpiThreadConfigGet (cls, &cfg) < 0)
+    return EINVAL ;
+  if ((start = malloc (sizeof (*start))) == NULL)
+    return ENOMEM ;
+  start->cls = cls ;
+  start->fn  = fn ;
+  start->arg = arg ;
+
+  pthread_attr_init (&attr) ;
+  if (cfg.stackSize != 0)
+    pthread_attr_setstacksize (&attr, (cfg.stackSize < PTHREAD_STACK_MIN) ? PTHREAD_STACK_MIN : cfg.stackSize) ;
+  if (cfg.cpus != 0)
+  {
+    cpuMask (cfg.cpus, &cpus) ;
+    pthread_attr_setaffinity_np (&attr, sizeof (cpus), &cpus) ;
+  }
+  if (thread == NULL)
+    pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED) ;
+
+  res = pthread_create ((thread == NULL) ? &myThread : thread, &attr, threadStart, start) ;
+  pthread_attr_destroy (&attr) ;
+  if (res != 0)
+    free (start) ;
+
+  return res ;
+}
+
+
+/*
+ * wpiMemoryLock:
+ *	Lock all our memory, and all we map from now on (including the
+ *	stacks of threads started after), into RAM, so a page fault never
+ *	holds up a time critical thread. The calling thread's stack is
+ *	faulted in to the given depth first, as it's grown on demand.
+ *********************************************************************************
+ */
+
+static void __attribute__ ((noinline)) prefaultStack (size_t depth)
+{
+  volatile unsigned char *stack = alloca (depth) ;
+  size_t page = sysconf (_SC_PAGESIZE) ;
+  size_t i ;
+
+  for (i = 0 ; i < depth ; i += page)
+    stack [i] = 0 ;
+}
+
+int wpiMemoryLock (size_t stackPrefault)
+{
+  if (mlockall (MCL_CURRENT | MCL_FUTURE) < 0)
+    return -1 ;
+
+  if (stackPrefault != 0)
+    prefaultStack (stackPrefault) ;
+
+  return 0 ;
+}
@@ -32,15 +32,13 @@ static pthread_mutex_t piMutexes [4] ;
 
 /*
  * piThreadCreate:
- *	Create and start a thread
+ *	Create and start a thread, configured as a WPI_THREAD_USER one
  *********************************************************************************
  */
 
 int piThreadCreate (void *(*fn)(void *))
 {
-  pthread_t myThread ;
-
-  return pthread_create (&myThread, NULL, fn, NULL) ;
+  return wpiThreadCreate (NULL, WPI_THREAD_USER, fn, NULL) ;
 }
 
 /*
@@ -1,6 +1,6 @@
 /*
  * softPwm.c:
- *	Provide 2 channels of software driven PWM.
+ *	Provide many channels of software driven PWM, all from one thread.
  *	Copyright (c) 2012-2014 Gordon Henderson
  ***********************************************************************
  * This file is part of wiringPi:
@@ -23,6 +23,7 @@
  */
 
 #include <stdio.h>
+#include <time.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
@@ -32,8 +33,10 @@
 //	This is more than the number of Pi pins because we can actually softPwm
 //	pins that are on GPIO expanders. It's not that efficient and more than 1 or
 //	2 pins on e.g. (SPI) mcp23s17 won't really be that effective, however...
+//	MAX_CHANNELS of them can be running at once.
 
 #define	MAX_PINS	1024
+#define	MAX_CHANNELS	64
 
 // The PWM Frequency is derived from the "pulse time" below. Essentially,
 //	the frequency is a function of the range and this pulse time.
@@ -43,51 +46,264 @@
 //
 //	It's possible to get a higher frequency by lowering the pulse time,
 //	however CPU uage will skyrocket as wiringPi uses a hard-loop to time
-//	periods under 100µS - this is because the Linux timer calls are just
-//	accurate at all, and have an overhead.
+//	periods under about 100µS (the overshoot measured at setup) - this is
+//	because the Linux timer calls are just accurate at all, and have an
+//	overhead.
 //
 //	Another way to increase the frequency is to reduce the range - however
 //	that reduces the overall output accuracy...
 
 #define	PULSE_TIME	1
 
-static volatile int marks         [MAX_PINS] ;
-static volatile int range         [MAX_PINS] ;
-static volatile pthread_t threads [MAX_PINS] ;
-static volatile int newPin = -1 ;
+// Edges less than half a pulse apart are made together
+
+#define	COALESCE	(PULSE_TIME * 500)
+
+// The engine:
+//	One thread runs every channel. The edges still to come are kept in a
+//	heap ordered by time (the timeline), one per running channel: its
+//	fall, or the start of its next period. The thread sleeps until the
+//	first, then makes every edge that's due with one write per GPIO bank.
+//	A channel at 0 or 100% has nothing in the timeline and costs nothing
+//	until it's written to; new values are picked up at the start of a
+//	period. The thread holds engineMutex while it's making edges, but not
+//	while it waits.
+
+struct channel
+{
+  wpiPinHandle pin ;
+  int          range ;
+  volatile int mark ;			// As last written
+  int          live ;			// This period's mark
+  int          level ;
+  volatile int idle ;			// Not in the timeline
+  uint64_t     start ;			// Of this period, CLOCK_MONOTONIC nS
+  volatile unsigned int overruns ;
+} ;
+
+#define	EDGE_FALL	0
+#define	EDGE_PERIOD	1
+
+struct edge
+{
+  uint64_t when ;
+  int      chan ;
+  int      what ;
+} ;
+
+static struct channel channels [MAX_CHANNELS] ;
+static int chanOf [MAX_PINS] ;		// Channel + 1, 0 if none
+
+static struct edge timeline [MAX_CHANNELS] ;
+static int edges = 0 ;
+
+static pthread_mutex_t engineMutex = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  engineCond  = PTHREAD_COND_INITIALIZER ;
+static int engineRunning = 0 ;
+static volatile int rescan = 0 ;		// An idle channel was written
+
+
+static uint64_t monoNow (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
 
 
 /*
- * softPwmThread:
- *	Thread to do the actual PWM output
+ * edgePush: edgePop: edgeDrop:
+ *	The timeline: a binary heap, earliest edge first.
  *********************************************************************************
  */
 
-static PI_THREAD (softPwmThread)
+static void edgePush (uint64_t when, int chan, int what)
 {
-  int pin, mark, space ;
-  struct sched_param param ;
+  struct edge e ;
+  int i = edges++, parent ;
 
-  param.sched_priority = sched_get_priority_max (SCHED_RR) ;
-  pthread_setschedparam (pthread_self (), SCHED_RR, &param) ;
+  e.when = when ;
+  e.chan = chan ;
+  e.what = what ;
 
-  pin    = newPin ;
-  newPin = -1 ;
+  for ( ; i > 0 ; i = parent)
+  {
+    parent = (i - 1) / 2 ;
+    if (timeline [parent].when <= when)
+      break ;
+    timeline [i] = timeline [parent] ;
+  }
+  timeline [i] = e ;
+}
 
-  piHiPri (90) ;
+static struct edge edgePop (void)
+{
+  struct edge top = timeline [0] ;
+  struct edge last = timeline [--edges] ;
+  int i = 0, child ;
 
   for (;;)
   {
-    mark  = marks [pin] ;
-    space = range [pin] - mark ;
+    if ((child = 2 * i + 1) >= edges)
+      break ;
+    if ((child + 1 < edges) && (timeline [child + 1].when < timeline [child].when))
+      ++child ;
+    if (last.when <= timeline [child].when)
+      break ;
+    timeline [i] = timeline [child] ;
+    i = child ;
+  }
+  if (edges > 0)
+    timeline [i] = last ;
+
+  return top ;
+}
+
+static void edgeDrop (int chan)
+{
+  struct edge keep [MAX_CHANNELS] ;
+  int i, n = 0 ;
+
+  for (i = 0 ; i < edges ; ++i)
+    if (timeline [i].chan != chan)
+      keep [n++] = timeline [i] ;
+  edges = 0 ;
+  for (i = 0 ; i < n ; ++i)
+    edgePush (keep [i].when, keep [i].chan, keep [i].what) ;
+}
+
+
+/*
+ * setLevel:
+ *	Change a channel's output, if it needs it. On-board pins are
+ *	gathered into their bank's masks, to go out together.
+ *********************************************************************************
+ */
+
+static void setLevel (struct channel *c, int level, unsigned int *bankSet, unsigned int *bankClr)
+{
+  if (c->level == level)
+    return ;
+  c->level = level ;
+
+  if (c->pin.bank == NULL)
+    digitalWrite (c->pin.pin, level) ;
+  else if (level == HIGH)
+    bankSet [c->pin.bankNo] |= c->pin.mask ;
+  else
+    bankClr [c->pin.bankNo] |= c->pin.mask ;
+}
+
+
+/*
+ * startPeriod:
+ *	Start a period of a channel at the given time, with its latest mark.
+ *	At 0 or 100% it goes idle - unless it's been written again while
+ *	going, when the next pass picks it up.
+ *********************************************************************************
+ */
+
+static void startPeriod (int chan, uint64_t at, unsigned int *bankSet, unsigned int *bankClr)
+{
+  struct channel *c = &channels [chan] ;
+  int mark = c->mark ;
+
+  c->live  = mark ;
+  c->start = at ;
+  setLevel (c, (mark > 0) ? HIGH : LOW, bankSet, bankClr) ;
+
+  if ((mark > 0) && (mark < c->range))
+  {
+    c->idle = 0 ;
+    edgePush (at + (uint64_t)mark * PULSE_TIME * 1000, chan, EDGE_FALL) ;
+    return ;
+  }
+
+  __atomic_store_n (&c->idle, 1, __ATOMIC_SEQ_CST) ;
+  if (__atomic_load_n (&c->mark, __ATOMIC_SEQ_CST) != mark)
+    rescan = 1 ;
+}
+
+
+/*
+ * runEdges:
+ *	Make every edge that's due by the given time, and start any idle
+ *	channels that have new values.
+ *********************************************************************************
+ */
+
+static void runEdges (uint64_t upTo)
+{
+  unsigned int bankSet [GPIO_BANK] = { 0 } ;
+  unsigned int bankClr [GPIO_BANK] = { 0 } ;
+  struct channel *c ;
+  struct edge e ;
+  uint64_t period, now = monoNow () ;
+  int chan, bank ;
+
+  if (rescan)
+  {
+    rescan = 0 ;
+    for (chan = 0 ; chan < MAX_CHANNELS ; ++chan)
+      if ((channels [chan].range != 0) && channels [chan].idle && (channels [chan].mark != channels [chan].live))
+	startPeriod (chan, now, bankSet, bankClr) ;
+  }
+
+  while ((edges > 0) && (timeline [0].when <= upTo))
+  {
+    e = edgePop () ;
+    c = &channels [e.chan] ;
+    if (e.what == EDGE_FALL)
+    {
+      setLevel (c, LOW, bankSet, bankClr) ;
+      edgePush (c->start + (uint64_t)c->range * PULSE_TIME * 1000, e.chan, EDGE_PERIOD) ;
+    }
+    else
+    {
+      period = (uint64_t)c->range * PULSE_TIME * 1000 ;
+      if (now >= e.when + period)		// Missed some: skip them
+      {
+	c->overruns += (now - e.when) / period ;
+	e.when      += (now - e.when) / period * period ;
+      }
+      startPeriod (e.chan, e.when, bankSet, bankClr) ;
+    }
+  }
+
+  for (bank = 0 ; bank < GPIO_BANK ; ++bank)
+    if (bankSet [bank] | bankClr [bank])
+      digitalWriteBank (bank, bankSet [bank], bankClr [bank]) ;
+}
+
+
+/*
+ * softPwmThread:
+ *	Thread to do the actual PWM output
+ *********************************************************************************
+ */
 
-    if (mark != 0)
-      digitalWrite (pin, HIGH) ;
-    delayMicroseconds (mark * PULSE_TIME) ;
+static PI_THREAD (softPwmThread)
+{
+  uint64_t when ;
 
-    if (space != 0)
-      digitalWrite (pin, LOW) ;
-    delayMicroseconds (space * PULSE_TIME) ;
+  pthread_mutex_lock (&engineMutex) ;
+  for (;;)
+  {
+    if (rescan)
+      runEdges (0) ;
+    if (edges == 0)
+    {
+      pthread_cond_wait (&engineCond, &engineMutex) ;
+      continue ;
+    }
+
+    when = timeline [0].when ;
+    pthread_mutex_unlock (&engineMutex) ;
+    wpiWaitUntil (when) ;
+    pthread_mutex_lock (&engineMutex) ;
+
+    runEdges (when + COALESCE) ;
   }
 
   return NULL ;
@@ -97,70 +313,133 @@ static PI_THREAD (softPwmThread)
 /*
  * softPwmWrite:
  *	Write a PWM value to the given pin
+ *	It's used from the start of the pin's next period. A pin at 0 or
+ *	100% has no periods going, so it wakes the thread.
  *********************************************************************************
  */
 
 void softPwmWrite (int pin, int value)
 {
+  struct channel *c ;
+  int chan ;
+
   pin &= (MAX_PINS - 1) ;
+  if ((chan = chanOf [pin] - 1) < 0)
+    return ;
+  c = &channels [chan] ;
 
   /**/ if (value < 0)
     value = 0 ;
-  else if (value > range [pin])
-    value = range [pin] ;
+  else if (value > c->range)
+    value = c->range ;
 
-  marks [pin] = value ;
+  __atomic_store_n (&c->mark, value, __ATOMIC_SEQ_CST) ;
+  if (__atomic_load_n (&c->idle, __ATOMIC_SEQ_CST) && (value != c->live))
+  {
+    pthread_mutex_lock (&engineMutex) ;
+    rescan = 1 ;
+    pthread_cond_signal (&engineCond) ;
+    pthread_mutex_unlock (&engineMutex) ;
+  }
 }
 
 
 /*
  * softPwmCreate:
- *	Create a new softPWM thread.
+ *	Add a pin to the softPWM thread, starting it if need be.
  *********************************************************************************
  */
 
 int softPwmCreate (int pin, int initialValue, int pwmRange)
 {
-  int res ;
-  pthread_t myThread ;
+  struct channel *c ;
+  int chan, res = 0 ;
 
-  if (range [pin] != 0)	// Already running on this pin
+  if ((pin < 0) || (pin >= MAX_PINS) || (pwmRange <= 0))
     return -1 ;
-
-  if (range <= 0)
+  if (chanOf [pin] != 0)	// Already running on this pin
     return -1 ;
 
-  pinMode      (pin, OUTPUT) ;
+  pinMode      (pin, OUTPUT) ;	// Outside the lock: it calls softPwmStop
   digitalWrite (pin, LOW) ;
 
-  marks [pin] = initialValue ;
-  range [pin] = pwmRange ;
+  pthread_mutex_lock (&engineMutex) ;
 
-  newPin = pin ;
-  res    = pthread_create (&myThread, NULL, softPwmThread, NULL) ;
+  if (chanOf [pin] != 0)	// Beaten to it
+  {
+    pthread_mutex_unlock (&engineMutex) ;
+    return -1 ;
+  }
+  for (chan = 0 ; (chan < MAX_CHANNELS) && (channels [chan].range != 0) ; ++chan)
+    ;
+  if (chan == MAX_CHANNELS)
+  {
+    pthread_mutex_unlock (&engineMutex) ;
+    return -1 ;
+  }
 
-  while (newPin != -1)
-    delay (1) ;
+  /**/ if (initialValue < 0)
+    initialValue = 0 ;
+  else if (initialValue > pwmRange)
+    initialValue = pwmRange ;
+
+  c = &channels [chan] ;
+  c->pin      = wpiPinOpen (pin) ;
+  c->range    = pwmRange ;
+  c->mark     = initialValue ;
+  c->live     = -1 ;			// So it's started
+  c->level    = LOW ;
+  c->idle     = 1 ;
+  c->overruns = 0 ;
+  chanOf [pin] = chan + 1 ;
+
+  if (!engineRunning)
+  {
+    if ((res = wpiThreadCreate (NULL, WPI_THREAD_SOFTPWM, softPwmThread, NULL)) == 0)
+      engineRunning = 1 ;
+  }
+  rescan = 1 ;
+  pthread_cond_signal (&engineCond) ;
 
-  threads [pin] = myThread ;
+  pthread_mutex_unlock (&engineMutex) ;
 
   return res ;
 }
 
 
+/*
+ * softPwmOverruns:
+ *	How many periods on the pin have been missed.
+ *********************************************************************************
+ */
+
+unsigned int softPwmOverruns (int pin)
+{
+  int chan = chanOf [pin & (MAX_PINS - 1)] - 1 ;
+
+  return (chan < 0) ? 0 : channels [chan].overruns ;
+}
+
+
 /*
  * softPwmStop:
- *	Stop an existing softPWM thread
+ *	Take a pin off the softPWM thread
  *********************************************************************************
  */
 
 void softPwmStop (int pin)
 {
-  if (range [pin] != 0)
+  int chan ;
+
+  pin &= (MAX_PINS - 1) ;
+
+  pthread_mutex_lock (&engineMutex) ;
+  if ((chan = chanOf [pin] - 1) >= 0)
   {
-    pthread_cancel (threads [pin]) ;
-    pthread_join   (threads [pin], NULL) ;
-    range [pin] = 0 ;
+    edgeDrop (chan) ;
+    channels [chan].range = 0 ;
+    chanOf [pin] = 0 ;
     digitalWrite (pin, LOW) ;
   }
+  pthread_mutex_unlock (&engineMutex) ;
 }
@@ -29,6 +29,7 @@ extern "C" {
 extern int  softPwmCreate (int pin, int value, int range) ;
 extern void softPwmWrite  (int pin, int value) ;
 extern void softPwmStop   (int pin) ;
+extern unsigned int softPwmOverruns (int pin) ;
 
 #ifdef __cplusplus
 }
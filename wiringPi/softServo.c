@@ -23,10 +23,7 @@
  ***********************************************************************
  */
 
-//#include <stdio.h>
 #include <string.h>
-#include <time.h>
-#include <sys/time.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
@@ -50,103 +47,153 @@
 // In practice we have a total slot width of about 20mS - so we're sending 50
 //	updates per second to each servo.
 //
-// In this code, we don't need to be too fussy about the gap as we're not doing
-//	the multipexing, but it does need to be at least 10mS, and preferably 16
-//	from what I've been able to determine.
-
-// WARNING:
-//	This code is really experimental. It was written in response to some people
-//	asking for a servo driver, however while it works, there is too much
-//	jitter to successfully drive a small servo - I have tried it with a micro
-//	servo and it worked, but the servo ran hot due to the jitter in the signal
-//	being sent to it.
+// In this code we do a bit of the multiplexing ourselves: the 20mS frame is
+//	cut into SLOTS time-slots of 2.5mS, and each servo gets one, so no more
+//	than MAX_SERVOS / SLOTS pulses are ever going at once. The servos of a
+//	slot all start together, with one write per GPIO bank, and the ends of
+//	their pulses that land in the same microsecond go out together too.
+//	The frames and edges are all absolute times, so the loop's overhead
+//	doesn't add jitter or drift.
 //
-//	If you want servo control for the Pi, then use the servoblaster kernel
-//	module.
+// A pin that can do hardware PWM (PWM2 and PWM3 on the Tinker Board) isn't
+//	in the frame at all: the PWM controller is set to a 20mS period and
+//	makes the pulses itself.
 
-#define	MAX_SERVOS	8
+#define	MAX_PINS	1024
+#define	MAX_SERVOS	64
+#define	SLOTS		8
 
-static int pinMap     [MAX_SERVOS] ;	// Keep track of our pins
-static int pulseWidth [MAX_SERVOS] ;	// microseconds
+#define	FRAME		20000			// uS
+#define	SLOT_TIME	(FRAME / SLOTS)
+
+// Hardware PWM: 74.25MHz / 74, just over 1MHz, so a count is about 1uS
+
+#define	HW_DIVISOR	74
+#define	HW_COUNTS(us)	((int)((us) * 74250000ULL / HW_DIVISOR / 1000000ULL))
+
+struct servo
+{
+  wpiPinHandle pin ;
+  int          hardware ;
+  int          slot ;
+  int          gen ;			// Bumped when it's taken away
+  volatile int width ;			// Pulse, uS; 0 if not in use
+} ;
+
+struct edge
+{
+  unsigned int at ;			// uS into the frame
+  int          servo ;
+  int          gen ;
+  int          level ;
+} ;
+
+static struct servo servos [MAX_SERVOS] ;
+static int servoOf [MAX_PINS] ;		// Servo + 1, 0 if none
+static int slotUse [SLOTS] ;
+static int running = 0 ;		// Servos in the frame
+
+static pthread_mutex_t servoMutex = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  servoCond  = PTHREAD_COND_INITIALIZER ;
+static int engineRunning = 0 ;
+static volatile unsigned int overruns ;
 
 
 /*
- * softServoThread:
- *	Thread to do the actual Servo PWM output
+ * frameEdges:
+ *	The edges of one frame, sorted by time, rises before falls.
+ *	Called with servoMutex held.
  *********************************************************************************
  */
 
-static PI_THREAD (softServoThread)
+static int frameEdges (struct edge *edges)
 {
-  register int i, j, k, m, tmp ;
-  int lastDelay, pin, servo ;
+  struct edge e ;
+  int servo, n = 0, i, j ;
 
-  int myDelays [MAX_SERVOS] ;
-  int myPins   [MAX_SERVOS] ;
+  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+  {
+    if ((servos [servo].width == 0) || servos [servo].hardware)
+      continue ;
+    e.servo = servo ;
+    e.gen   = servos [servo].gen ;
+    e.at    = servos [servo].slot * SLOT_TIME ;
+    e.level = HIGH ;
+    edges [n++] = e ;
+    e.at   += servos [servo].width ;
+    e.level = LOW ;
+    edges [n++] = e ;
+  }
 
-  struct timeval  tNow, tStart, tPeriod, tGap, tTotal ;
-  struct timespec tNs ;
+  for (i = 1 ; i < n ; ++i)		// Insertion sort, it's mostly in order
+  {
+    e = edges [i] ;
+    for (j = i ; (j > 0) && ((edges [j - 1].at > e.at) ||
+	((edges [j - 1].at == e.at) && (edges [j - 1].level < e.level))) ; --j)
+      edges [j] = edges [j - 1] ;
+    edges [j] = e ;
+  }
 
-  tTotal.tv_sec  =    0 ;
-  tTotal.tv_usec = 8000 ;
+  return n ;
+}
 
-  piHiPri (50) ;
 
+/*
+ * softServoThread:
+ *	Thread to do the actual Servo PWM output
+ *********************************************************************************
+ */
+
+static PI_THREAD (softServoThread)
+{
+  struct edge edges [2 * MAX_SERVOS] ;
+  unsigned int bankSet [GPIO_BANK], bankClr [GPIO_BANK] ;
+  struct wpiPeriodic frame ;
+  struct servo *s ;
+  unsigned int at ;
+  int n, i, bank ;
+
+  pthread_mutex_lock (&servoMutex) ;
   for (;;)
   {
-    gettimeofday (&tStart, NULL) ;
+    while (running == 0)
+      pthread_cond_wait (&servoCond, &servoMutex) ;
 
-    memcpy (myDelays, pulseWidth, sizeof (myDelays)) ;
-    memcpy (myPins,   pinMap,     sizeof (myPins)) ;
+    frame = wpiPeriodicStart ((uint64_t)FRAME * 1000) ;
+    while (running != 0)
+    {
+      n = frameEdges (edges) ;
 
-// Sort the delays (& pins), shortest first
+      for (i = 0 ; i < n ; )
+      {
+	pthread_mutex_unlock (&servoMutex) ;
+	wpiWaitUntil (frame.start + (uint64_t)edges [i].at * 1000) ;
+	pthread_mutex_lock (&servoMutex) ;
 
-    for (m = MAX_SERVOS / 2 ; m > 0 ; m /= 2 )
-      for (j = m ; j < MAX_SERVOS ; ++j)
-	for (i = j - m ; i >= 0 ; i -= m)
+	memset (bankSet, 0, sizeof (bankSet)) ;
+	memset (bankClr, 0, sizeof (bankClr)) ;
+	for (at = edges [i].at ; (i < n) && (edges [i].at == at) ; ++i)
 	{
-	  k = i + m ;
-	  if (myDelays [k] >= myDelays [i])
-	    break ;
-	  else // Swap
-	  {
-	    tmp = myDelays [i] ; myDelays [i] = myDelays [k] ; myDelays [k] = tmp ;
-	    tmp = myPins   [i] ; myPins   [i] = myPins   [k] ; myPins   [k] = tmp ;
-	  }
+	  s = &servos [edges [i].servo] ;
+	  if (s->gen != edges [i].gen)			// Taken away
+	    continue ;
+	  if (s->pin.bank == NULL)
+	    digitalWrite (s->pin.pin, edges [i].level) ;
+	  else if (edges [i].level == HIGH)
+	    bankSet [s->pin.bankNo] |= s->pin.mask ;
+	  else
+	    bankClr [s->pin.bankNo] |= s->pin.mask ;
 	}
-
-// All on
-
-    lastDelay = 0 ;
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
-
-      digitalWrite (pin, HIGH) ;
-      myDelays [servo] = myDelays [servo] - lastDelay ;
-      lastDelay += myDelays [servo] ;
-    }
-
-// Now loop, turning them all off as required
-
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
-
-      delayMicroseconds (myDelays [servo]) ;
-      digitalWrite (pin, LOW) ;
+	for (bank = 0 ; bank < GPIO_BANK ; ++bank)
+	  if (bankSet [bank] | bankClr [bank])
+	    digitalWriteBank (bank, bankSet [bank], bankClr [bank]) ;
+      }
+
+      pthread_mutex_unlock (&servoMutex) ;
+      if (wpiWaitNextPeriod (&frame) != 0)
+	++overruns ;
+      pthread_mutex_lock (&servoMutex) ;
     }
-
-// Wait until the end of an 8mS time-slot
-
-    gettimeofday (&tNow, NULL) ;
-    timersub (&tNow, &tStart, &tPeriod) ;
-    timersub (&tTotal, &tPeriod, &tGap) ;
-    tNs.tv_sec  = tGap.tv_sec ;
-    tNs.tv_nsec = tGap.tv_usec * 1000 ;
-    nanosleep (&tNs, NULL) ;
   }
 
   return NULL ;
@@ -156,56 +203,150 @@ static PI_THREAD (softServoThread)
 /*
  * softServoWrite:
  *	Write a Servo value to the given pin
+ *	-250 to 1250, i.e. a pulse of 750 to 2250uS. It's used from the
+ *	next frame.
  *********************************************************************************
  */
 
 void softServoWrite (int servoPin, int value)
 {
+  struct servo *s ;
   int servo ;
 
-  servoPin &= 63 ;
+  if ((servo = servoOf [servoPin & (MAX_PINS - 1)] - 1) < 0)
+    return ;
+  s = &servos [servo] ;
 
   /**/ if (value < -250)
     value = -250 ;
   else if (value > 1250)
     value = 1250 ;
 
-  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    if (pinMap [servo] == servoPin)
-      pulseWidth [servo] = value + 1000 ; // uS
+  s->width = value + 1000 ;	// uS
+  if (s->hardware)
+    pwmWrite (s->pin.pin, HW_COUNTS (s->width)) ;
+}
+
+
+/*
+ * softServoAdd: softServoStop:
+ *	Start or stop driving a servo on a pin, at the mid point to begin
+ *	with. Starts the servo thread the first time.
+ *********************************************************************************
+ */
+
+int softServoAdd (int pin)
+{
+  struct servo *s ;
+  int servo, slot, i ;
+
+  if ((pin < 0) || (pin >= MAX_PINS))
+    return -1 ;
+
+  pthread_mutex_lock (&servoMutex) ;
+
+  for (servo = 0 ; (servo < MAX_SERVOS) && (servos [servo].width != 0) ; ++servo)
+    ;
+  if ((servo == MAX_SERVOS) || (servoOf [pin] != 0))	// Full, or already going
+  {
+    pthread_mutex_unlock (&servoMutex) ;
+    return -1 ;
+  }
+
+  s = &servos [servo] ;
+  s->pin      = wpiPinOpen (pin) ;
+  s->hardware = 0 ;
+  s->width    = 1500 ;		// Mid point
+
+#ifdef	TINKER_BOARD
+  s->hardware = pwmCapable (pin) ;	// HW_COUNTS is the RK3288's clock
+#endif
+
+  if (s->hardware)
+  {
+    pinMode (pin, PWM_OUTPUT) ;
+    if (pwmStage (pin, HW_COUNTS (FRAME), HW_COUNTS (s->width), HW_DIVISOR) < 0)
+      s->hardware = 0 ;		// Not in this mode: into the frame with it
+    else
+      pwmCommit () ;
+  }
+
+  if (!s->hardware)
+  {
+    pinMode      (pin, OUTPUT) ;
+    digitalWrite (pin, LOW) ;
+
+    for (slot = 0, i = 1 ; i < SLOTS ; ++i)	// The least used slot
+      if (slotUse [i] < slotUse [slot])
+	slot = i ;
+    ++slotUse [slot] ;
+    s->slot = slot ;
+    ++running ;
+  }
+  servoOf [pin] = servo + 1 ;
+
+  if (!engineRunning && (wpiThreadCreate (NULL, WPI_THREAD_SOFTSERVO, softServoThread, NULL) == 0))
+    engineRunning = 1 ;
+  pthread_cond_signal (&servoCond) ;
+
+  pthread_mutex_unlock (&servoMutex) ;
+
+  return engineRunning ? 0 : -1 ;
+}
+
+void softServoStop (int pin)
+{
+  struct servo *s ;
+  int servo ;
+
+  pin &= (MAX_PINS - 1) ;
+
+  pthread_mutex_lock (&servoMutex) ;
+  if ((servo = servoOf [pin] - 1) >= 0)
+  {
+    s = &servos [servo] ;
+    if (!s->hardware)
+    {
+      --slotUse [s->slot] ;
+      --running ;
+    }
+    ++s->gen ;
+    s->width = 0 ;
+    servoOf [pin] = 0 ;
+    pinMode      (pin, OUTPUT) ;
+    digitalWrite (pin, LOW) ;
+  }
+  pthread_mutex_unlock (&servoMutex) ;
+}
+
+
+/*
+ * softServoOverruns:
+ *	How many frames have started late.
+ *********************************************************************************
+ */
+
+unsigned int softServoOverruns (void)
+{
+  return overruns ;
 }
 
 
 /*
  * softServoSetup:
  *	Setup the software servo system
+ *	The original 8 servo interface: pins of -1 are left out.
  *********************************************************************************
  */
 
 int softServoSetup (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7)
 {
-  int servo ;
+  int pins [8] = { p0, p1, p2, p3, p4, p5, p6, p7 } ;
+  int i, res = 0 ;
 
-  if (p0 != -1) { pinMode (p0, OUTPUT) ; digitalWrite (p0, LOW) ; }
-  if (p1 != -1) { pinMode (p1, OUTPUT) ; digitalWrite (p1, LOW) ; }
-  if (p2 != -1) { pinMode (p2, OUTPUT) ; digitalWrite (p2, LOW) ; }
-  if (p3 != -1) { pinMode (p3, OUTPUT) ; digitalWrite (p3, LOW) ; }
-  if (p4 != -1) { pinMode (p4, OUTPUT) ; digitalWrite (p4, LOW) ; }
-  if (p5 != -1) { pinMode (p5, OUTPUT) ; digitalWrite (p5, LOW) ; }
-  if (p6 != -1) { pinMode (p6, OUTPUT) ; digitalWrite (p6, LOW) ; }
-  if (p7 != -1) { pinMode (p7, OUTPUT) ; digitalWrite (p7, LOW) ; }
-
-  pinMap [0] = p0 ;
-  pinMap [1] = p1 ;
-  pinMap [2] = p2 ;
-  pinMap [3] = p3 ;
-  pinMap [4] = p4 ;
-  pinMap [5] = p5 ;
-  pinMap [6] = p6 ;
-  pinMap [7] = p7 ;
+  for (i = 0 ; i < 8 ; ++i)
+    if ((pins [i] != -1) && (softServoAdd (pins [i]) < 0))
+      res = -1 ;
 
-  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    pulseWidth [servo] = 1500 ;		// Mid point
-  
-  return piThreadCreate (softServoThread) ;
+  return res ;
 }
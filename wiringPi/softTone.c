@@ -27,55 +27,287 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
+#include <time.h>
 #include <pthread.h>
 
 #include "wiringPi.h"
 #include "softTone.h"
 
-#define	MAX_PINS	64
+// MAX_PINS:
+//	This is more than the number of Pi pins because we can actually softTone
+//	pins that are on GPIO expanders, and on the Tinker Board pins are
+//	CPU GPIO numbers in GPIO mode - up to 257.
+//	MAX_TONES of them can be sounding at once.
 
-#define	PULSE_TIME	100
+#define	MAX_PINS	1024
+#define	MAX_TONES	32
 
-static int freqs         [MAX_PINS] ;
-static pthread_t threads [MAX_PINS] ;
+// Notes waiting to be played on each pin (a power of 2)
 
-static int newPin = -1 ;
+#define	MAX_NOTES	64
+
+#define	MAX_FREQ	10000
+
+// Edges less than this many nS apart are made together
+
+#define	COALESCE	2000
+
+// Waits longer than this are made on the condition variable, so a
+//	write can cut them short; the last of it is left to wpiWaitUntil
+
+#define	WAKE_EARLY	200000
+
+// The engine:
+//	One thread sounds every tone. Each tone keeps a phase count - the
+//	number of half periods since it started - and its next edge is
+//	worked out from that and the start time, rather than added on to
+//	the last one, so the pitch never drifts and a late edge doesn't
+//	push the rest back. Every second of a tone is exactly 2 * freq
+//	half periods, so the start moves on a second at a time to keep the
+//	phase - and the sums done with it - small however long it sounds.
+//	Notes end at absolute times too, the next one in the queue
+//	starting exactly where the last stopped.
+//	The thread sleeps until the first edge or note end that's due,
+//	then makes everything due with one write per GPIO bank. With
+//	nothing sounding and no notes queued it waits on the condition
+//	variable and uses no CPU at all.
+//	Pins that can do hardware PWM are given the tone to make with
+//	pwmToneWrite (); the thread only changes their notes.
+
+struct tone
+{
+  wpiPinHandle pin ;
+  int          pinNo ;
+  int          used ;
+  int          hardware ;
+  int          freq ;			// Sounding now, 0 for silence
+  int          level ;
+  uint64_t     start ;			// Of this freq, CLOCK_MONOTONIC nS
+  uint64_t     phase ;			// Half periods since start
+  uint64_t     nextEdge ;		// 0 for none
+  uint64_t     noteEnd ;		// 0 if it goes on until changed
+  int          written ;		// By softToneWrite, -1 for none
+  struct softToneNote notes [MAX_NOTES] ;
+  unsigned int head, tail ;
+  unsigned int overruns ;
+} ;
+
+static struct tone tones [MAX_TONES] ;
+static int toneOf [MAX_PINS] ;		// Tone + 1, 0 if none
+
+static pthread_mutex_t engineMutex = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  engineCond ;
+static int engineRunning = 0 ;
+
+
+static uint64_t monoNow (void)
+{
+  struct timespec ts ;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts) ;
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
 
 
 /*
- * softToneThread:
- *	Thread to do the actual PWM output
+ * setLevel:
+ *	Change a tone's output, if it needs it. On-board pins are gathered
+ *	into their bank's masks, to go out together.
  *********************************************************************************
  */
 
-static PI_THREAD (softToneThread)
+static void setLevel (struct tone *t, int level, unsigned int *bankSet, unsigned int *bankClr)
+{
+  if (t->level == level)
+    return ;
+  t->level = level ;
+
+  if (t->pin.bank == NULL)
+    digitalWrite (t->pin.pin, level) ;
+  else if (level == HIGH)
+    bankSet [t->pin.bankNo] |= t->pin.mask ;
+  else
+    bankClr [t->pin.bankNo] |= t->pin.mask ;
+}
+
+
+/*
+ * setFreq:
+ *	Start sounding a frequency on a tone at the given time, until the
+ *	given end (0 for ever).
+ *********************************************************************************
+ */
+
+static void setFreq (struct tone *t, int freq, uint64_t at, uint64_t end, unsigned int *bankSet, unsigned int *bankClr)
+{
+  t->noteEnd = end ;
+
+  if (t->hardware)
+  {
+    if (freq != t->freq)
+      pwmToneWrite (t->pinNo, freq) ;
+    t->freq = freq ;
+    return ;
+  }
+
+  t->freq  = freq ;
+  t->start = at ;
+  t->phase = 0 ;
+  if (freq == 0)
+  {
+    t->nextEdge = 0 ;
+    setLevel (t, LOW, bankSet, bankClr) ;
+  }
+  else
+  {
+    t->nextEdge = at + 500000000ULL / freq ;
+    setLevel (t, HIGH, bankSet, bankClr) ;
+  }
+}
+
+
+/*
+ * nextNote:
+ *	Start the next queued note at the given time, or go quiet if
+ *	there's none.
+ *********************************************************************************
+ */
+
+static void nextNote (struct tone *t, uint64_t at, unsigned int *bankSet, unsigned int *bankClr)
+{
+  struct softToneNote *n ;
+
+  if (t->head == t->tail)
+  {
+    setFreq (t, 0, at, 0, bankSet, bankClr) ;
+    return ;
+  }
+
+  n = &t->notes [t->tail++ & (MAX_NOTES - 1)] ;
+  setFreq (t, n->freq, at, at + (uint64_t)n->duration * 1000000ULL, bankSet, bankClr) ;
+}
+
+
+/*
+ * runTone:
+ *	Bring a tone up to the given time: pick up a write, move on past
+ *	notes that have ended and make its edges that are due.
+ *********************************************************************************
+ */
+
+static void runTone (struct tone *t, uint64_t now, uint64_t upTo, unsigned int *bankSet, unsigned int *bankClr)
+{
+  uint64_t half, perSec, gone, due, secs ;
+
+  if (t->written >= 0)
+  {
+    setFreq (t, t->written, now, 0, bankSet, bankClr) ;
+    t->written = -1 ;
+  }
+
+  while ((t->noteEnd != 0) && (t->noteEnd <= upTo))
+    nextNote (t, t->noteEnd, bankSet, bankClr) ;
+
+  if ((t->noteEnd == 0) && (t->head != t->tail))	// Queued on a quiet or written pin
+    nextNote (t, now, bankSet, bankClr) ;
+
+  if ((t->nextEdge == 0) || (t->nextEdge > upTo))
+    return ;
+
+  half   = 500000000ULL / t->freq ;
+  perSec = 2 * t->freq ;
+  ++t->phase ;
+  if (now >= t->nextEdge + half)		// Missed some: skip them
+  {
+    gone = now - t->start ;
+    due  = gone / 1000000000ULL * perSec + gone % 1000000000ULL * perSec / 1000000000ULL ;
+    t->overruns += due - t->phase ;
+    t->phase     = due ;
+  }
+  if (t->phase >= perSec)			// Move the start on whole seconds
+  {
+    secs      = t->phase / perSec ;
+    t->start += secs * 1000000000ULL ;
+    t->phase -= secs * perSec ;
+  }
+  setLevel (t, (t->phase & 1) ? LOW : HIGH, bankSet, bankClr) ;
+  t->nextEdge = t->start + (t->phase + 1) * 1000000000ULL / (2 * t->freq) ;
+}
+
+
+/*
+ * runTones:
+ *	Do everything that's due by the given time, then return when the
+ *	next thing is due (0 if nothing is).
+ *********************************************************************************
+ */
+
+static uint64_t runTones (uint64_t upTo)
 {
-  int pin, freq, halfPeriod ;
-  struct sched_param param ;
+  unsigned int bankSet [GPIO_BANK] = { 0 } ;
+  unsigned int bankClr [GPIO_BANK] = { 0 } ;
+  uint64_t next = 0, now = monoNow () ;
+  struct tone *t ;
+  int bank ;
+
+  if (upTo < now)
+    upTo = now ;
+
+  for (t = tones ; t < &tones [MAX_TONES] ; ++t)
+  {
+    if (!t->used)
+      continue ;
+    runTone (t, now, upTo, bankSet, bankClr) ;
+
+    if ((t->nextEdge != 0) && ((next == 0) || (t->nextEdge < next)))
+      next = t->nextEdge ;
+    if ((t->noteEnd != 0) && ((next == 0) || (t->noteEnd < next)))
+      next = t->noteEnd ;
+  }
 
-  param.sched_priority = sched_get_priority_max (SCHED_RR) ;
-  pthread_setschedparam (pthread_self (), SCHED_RR, &param) ;
+  for (bank = 0 ; bank < GPIO_BANK ; ++bank)
+    if (bankSet [bank] | bankClr [bank])
+      digitalWriteBank (bank, bankSet [bank], bankClr [bank]) ;
 
-  pin    = newPin ;
-  newPin = -1 ;
+  return next ;
+}
+
+
+/*
+ * softToneThread:
+ *	Thread to do the actual tone output
+ *********************************************************************************
+ */
 
-  piHiPri (50) ;
+static PI_THREAD (softToneThread)
+{
+  struct timespec ts ;
+  uint64_t when, upTo = 0 ;
 
+  pthread_mutex_lock (&engineMutex) ;
   for (;;)
   {
-    freq = freqs [pin] ;
-    if (freq == 0)
-      delay (1) ;
-    else
+    if ((when = runTones (upTo)) == 0)
     {
-      halfPeriod = 500000 / freq ;
-
-      digitalWrite (pin, HIGH) ;
-      delayMicroseconds (halfPeriod) ;
+      upTo = 0 ;
+      pthread_cond_wait (&engineCond, &engineMutex) ;
+      continue ;
+    }
 
-      digitalWrite (pin, LOW) ;
-      delayMicroseconds (halfPeriod) ;
+    if (when > monoNow () + WAKE_EARLY)
+    {
+      upTo       = 0 ;
+      ts.tv_sec  = (when - WAKE_EARLY) / 1000000000ULL ;
+      ts.tv_nsec = (when - WAKE_EARLY) % 1000000000ULL ;
+      pthread_cond_timedwait (&engineCond, &engineMutex, &ts) ;
+      continue ;
     }
+
+    pthread_mutex_unlock (&engineMutex) ;
+    wpiWaitUntil (when) ;
+    pthread_mutex_lock (&engineMutex) ;
+    upTo = when + COALESCE ;
   }
 
   return NULL ;
@@ -85,66 +317,219 @@ static PI_THREAD (softToneThread)
 /*
  * softToneWrite:
  *	Write a frequency value to the given pin
+ *	It's sounded straight away, until it's written again or notes are
+ *	queued, and anything already queued on the pin is dropped.
  *********************************************************************************
  */
 
 void softToneWrite (int pin, int freq)
 {
-  pin &= 63 ;
+  int tone ;
+
+  pin &= (MAX_PINS - 1) ;
 
   /**/ if (freq < 0)
     freq = 0 ;
-  else if (freq > 5000)	// Max 5KHz
-    freq = 5000 ;
+  else if (freq > MAX_FREQ)
+    freq = MAX_FREQ ;
+
+  pthread_mutex_lock (&engineMutex) ;
+  if ((tone = toneOf [pin] - 1) >= 0)
+  {
+    tones [tone].written = freq ;
+    tones [tone].head    = tones [tone].tail ;
+    pthread_cond_signal (&engineCond) ;
+  }
+  pthread_mutex_unlock (&engineMutex) ;
+}
+
+
+/*
+ * softToneQueue:
+ *	Add notes to the end of the pin's queue, to be played one after
+ *	the other. A frequency of 0 is a rest. If the pin is sounding a
+ *	tone from softToneWrite () that's ended, and the first note starts
+ *	straight away. Returns how many were queued, which is less than
+ *	asked for if the queue filled up, or -1 if the pin isn't a
+ *	softTone pin.
+ *********************************************************************************
+ */
+
+int softToneQueue (int pin, const struct softToneNote *notes, int count)
+{
+  struct tone *t ;
+  struct softToneNote *n ;
+  int tone, i ;
+
+  pin &= (MAX_PINS - 1) ;
+
+  pthread_mutex_lock (&engineMutex) ;
+  if ((tone = toneOf [pin] - 1) < 0)
+  {
+    pthread_mutex_unlock (&engineMutex) ;
+    return -1 ;
+  }
+
+  t = &tones [tone] ;
+  t->written = -1 ;
+  for (i = 0 ; (i < count) && (t->head - t->tail < MAX_NOTES) ; ++i)
+  {
+    n = &t->notes [t->head++ & (MAX_NOTES - 1)] ;
+    n->freq     = (notes [i].freq < 0) ? 0 : (notes [i].freq > MAX_FREQ) ? MAX_FREQ : notes [i].freq ;
+    n->duration = (notes [i].duration < 0) ? 0 : notes [i].duration ;
+  }
+  if (i > 0)
+    pthread_cond_signal (&engineCond) ;
+  pthread_mutex_unlock (&engineMutex) ;
+
+  return i ;
+}
+
+
+/*
+ * softToneQueued:
+ *	How many notes on the pin are still to play, counting the one
+ *	that's sounding.
+ *********************************************************************************
+ */
 
-  freqs [pin] = freq ;
+int softToneQueued (int pin)
+{
+  struct tone *t ;
+  int tone, count = 0 ;
+
+  pin &= (MAX_PINS - 1) ;
+
+  pthread_mutex_lock (&engineMutex) ;
+  if ((tone = toneOf [pin] - 1) >= 0)
+  {
+    t = &tones [tone] ;
+    count = t->head - t->tail ;
+    if (t->noteEnd != 0)
+      ++count ;
+  }
+  pthread_mutex_unlock (&engineMutex) ;
+
+  return count ;
 }
 
 
 /*
  * softToneCreate:
- *	Create a new tone thread.
+ *	Add a pin to the tone thread, starting it if need be.
  *********************************************************************************
  */
 
 int softToneCreate (int pin)
 {
-  int res ;
-  pthread_t myThread ;
-
-  pinMode      (pin, OUTPUT) ;
-  digitalWrite (pin, LOW) ;
+  pthread_condattr_t attr ;
+  struct tone *t ;
+  int tone, hardware = 0, res = 0 ;
 
-  if (threads [pin] != 0)
+  if ((pin < 0) || (pin >= MAX_PINS))
+    return -1 ;
+  if (toneOf [pin] != 0)	// Already running on this pin
     return -1 ;
 
-  freqs [pin] = 0 ;
+#ifdef	TINKER_BOARD
+  hardware = pwmCapable (pin) ;
+#endif
+
+  if (hardware)			// Outside the lock: it calls softToneStop
+  {
+    pinMode      (pin, PWM_OUTPUT) ;
+    pwmToneWrite (pin, 0) ;
+  }
+  else
+  {
+    pinMode      (pin, OUTPUT) ;
+    digitalWrite (pin, LOW) ;
+  }
+
+  pthread_mutex_lock (&engineMutex) ;
+
+  if (toneOf [pin] != 0)	// Beaten to it
+  {
+    pthread_mutex_unlock (&engineMutex) ;
+    return -1 ;
+  }
+  for (tone = 0 ; (tone < MAX_TONES) && tones [tone].used ; ++tone)
+    ;
+  if (tone == MAX_TONES)
+  {
+    pthread_mutex_unlock (&engineMutex) ;
+    return -1 ;
+  }
 
-  newPin = pin ;
-  res    = pthread_create (&myThread, NULL, softToneThread, NULL) ;
+  t = &tones [tone] ;
+  t->pin      = wpiPinOpen (pin) ;
+  t->pinNo    = pin ;
+  t->used     = 1 ;
+  t->hardware = hardware ;
+  t->freq     = 0 ;
+  t->level    = LOW ;
+  t->nextEdge = 0 ;
+  t->noteEnd  = 0 ;
+  t->written  = -1 ;
+  t->head     = 0 ;
+  t->tail     = 0 ;
+  t->overruns = 0 ;
+  toneOf [pin] = tone + 1 ;
+
+  if (!engineRunning)
+  {
+    pthread_condattr_init     (&attr) ;
+    pthread_condattr_setclock (&attr, CLOCK_MONOTONIC) ;
+    pthread_cond_init         (&engineCond, &attr) ;
+    pthread_condattr_destroy  (&attr) ;
 
-  while (newPin != -1)
-    delay (1) ;
+    if ((res = wpiThreadCreate (NULL, WPI_THREAD_SOFTTONE, softToneThread, NULL)) == 0)
+      engineRunning = 1 ;
+  }
 
-  threads [pin] = myThread ;
+  pthread_mutex_unlock (&engineMutex) ;
 
   return res ;
 }
 
 
+/*
+ * softToneOverruns:
+ *	How many half periods on the pin have been missed.
+ *********************************************************************************
+ */
+
+unsigned int softToneOverruns (int pin)
+{
+  int tone = toneOf [pin & (MAX_PINS - 1)] - 1 ;
+
+  return (tone < 0) ? 0 : tones [tone].overruns ;
+}
+
+
 /*
  * softToneStop:
- *	Stop an existing softTone thread
+ *	Take a pin off the tone thread
  *********************************************************************************
  */
 
 void softToneStop (int pin)
 {
-  if (threads [pin] != 0)
+  struct tone *t ;
+  int tone ;
+
+  pin &= (MAX_PINS - 1) ;
+
+  pthread_mutex_lock (&engineMutex) ;
+  if ((tone = toneOf [pin] - 1) >= 0)
   {
-    pthread_cancel (threads [pin]) ;
-    pthread_join   (threads [pin], NULL) ;
-    threads [pin] = 0 ;
-    digitalWrite (pin, LOW) ;
+    t = &tones [tone] ;
+    if (t->hardware)
+      pwmToneWrite (pin, 0) ;
+    else
+      digitalWrite (pin, LOW) ;
+    t->used = 0 ;
+    toneOf [pin] = 0 ;
   }
+  pthread_mutex_unlock (&engineMutex) ;
 }
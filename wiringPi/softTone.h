@@ -30,9 +30,23 @@
 extern "C" {
 #endif
 
+// softToneNote:
+//	One note of a melody: a frequency in Hz (0 for a rest) and how
+//	long it lasts in mS. Queueing notes ends a tone from softToneWrite (),
+//	and softToneWrite () drops any notes still queued.
+
+struct softToneNote
+{
+  int freq ;
+  int duration ;
+} ;
+
 extern int  softToneCreate (int pin) ;
 extern void softToneStop   (int pin) ;
 extern void softToneWrite  (int pin, int freq) ;
+extern int  softToneQueue  (int pin, const struct softToneNote *notes, int count) ;
+extern int  softToneQueued (int pin) ;
+extern unsigned int softToneOverruns (int pin) ;
 
 #ifdef __cplusplus
 }
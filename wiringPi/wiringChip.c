@@ -0,0 +1,776 @@
+/*
+ * wiringChip.c:
+ *	GPIO access through the Linux GPIO character device (/dev/gpiochipN,
+ *	uAPI v2) - the replacement for /sys/class/gpio.
+ *
+ *	Every line we use on a chip is held in one line request, so a whole
+ *	bank can be read or written with a single ioctl, and the request fd
+ *	delivers edges with kernel timestamps. Changing how a line is set
+ *	up is done on the request as it stands; only adding a line to a
+ *	chip means re-requesting it, which briefly releases the lines
+ *	already held.
+ *
+ *	Copyright (c) 2012-2015 Gordon Henderson
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as
+ *    published by the Free Software Foundation, either version 3 of the
+ *    License, or (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with wiringPi.
+ *    If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "wiringPi.h"
+#include "wiringChip.h"
+
+#ifdef	GPIO_V2_GET_LINE_IOCTL
+
+// One chip per Tinker Board bank, GPIO0 to GPIO8
+
+#define	CHIP_MAX	9
+#define	CHIP_GPIOS	512
+#define	CHIP_LINES	GPIO_V2_LINES_MAX
+#define	CHIP_EVENTS	16
+
+#define	LINE_DIRECTION	(GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_OUTPUT)
+#define	LINE_EDGES	(GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING)
+#define	LINE_BIAS	(GPIO_V2_LINE_FLAG_BIAS_PULL_UP | GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN | \
+			 GPIO_V2_LINE_FLAG_BIAS_DISABLED)
+
+struct chip
+{
+  int      fd ;				// /dev/gpiochipN
+  int      base ;			// gpio number of line 0
+  int      lines ;
+  int      req ;			// Line request, -1 when nothing is held
+  int      num ;			// Lines in the request
+  uint32_t offsets [CHIP_LINES] ;	// By request index
+  uint64_t flags   [CHIP_LINES] ;
+  uint64_t outputs ;			// Output values, a bit per request index
+} ;
+
+static struct chip chips [CHIP_MAX] ;
+static int numChips = 0 ;
+
+// gpio number to chip and to request index, both + 1 so 0 is "none"
+
+static unsigned char chipOf  [CHIP_GPIOS] ;
+static unsigned char indexOf [CHIP_GPIOS] ;
+
+static void (*notify)(int fd) = NULL ;
+static void (*notifyOld)(int fd) = NULL ;
+
+static pthread_mutex_t chipMutex = PTHREAD_MUTEX_INITIALIZER ;
+
+
+/*
+ * chipFor:
+ *	The chip a gpio is on, or NULL
+ *********************************************************************************
+ */
+
+static struct chip *chipFor (int gpio)
+{
+  if ((gpio < 0) || (gpio >= CHIP_GPIOS) || (chipOf [gpio] == 0))
+    return NULL ;
+  return &chips [chipOf [gpio] - 1] ;
+}
+
+
+/*
+ * chipConfig:
+ *	Build the line config for everything held on a chip: one flags
+ *	attribute per distinct set of flags and one for the output values.
+ *********************************************************************************
+ */
+
+static int chipConfig (struct chip *c, struct gpio_v2_line_config *cfg)
+{
+  uint64_t outMask = 0 ;
+  unsigned int a ;
+  int i ;
+
+  memset (cfg, 0, sizeof (*cfg)) ;
+
+  for (i = 0 ; i < c->num ; ++i)
+  {
+    for (a = 0 ; a < cfg->num_attrs ; ++a)
+      if (cfg->attrs [a].attr.flags == c->flags [i])
+	break ;
+    if (a == cfg->num_attrs)
+    {
+      if (a == GPIO_V2_LINE_NUM_ATTRS_MAX - 1)	// Keep one for the values
+	return -EINVAL ;
+      cfg->attrs [a].attr.id    = GPIO_V2_LINE_ATTR_ID_FLAGS ;
+      cfg->attrs [a].attr.flags = c->flags [i] ;
+      ++cfg->num_attrs ;
+    }
+    cfg->attrs [a].mask |= 1ULL << i ;
+    if (c->flags [i] & GPIO_V2_LINE_FLAG_OUTPUT)
+      outMask |= 1ULL << i ;
+  }
+
+  if (outMask != 0)
+  {
+    a = cfg->num_attrs++ ;
+    cfg->attrs [a].attr.id     = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES ;
+    cfg->attrs [a].attr.values = c->outputs ;
+    cfg->attrs [a].mask        = outMask ;
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * chipRequest:
+ *	(Re-)request every line held on a chip. The old request is taken
+ *	out of whatever is watching it first, and its fd number is kept -
+ *	on /dev/null until the new request is moved onto it - so something
+ *	part way through reading it can't end up reading another file.
+ *	Request fds don't block: there may be nothing left to read by the
+ *	time a reader gets to one.
+ *********************************************************************************
+ */
+
+static int chipGetLines (struct chip *c)
+{
+  struct gpio_v2_line_request req ;
+  int err ;
+
+  memset (&req, 0, sizeof (req)) ;
+  memcpy (req.offsets, c->offsets, c->num * sizeof (uint32_t)) ;
+  strcpy (req.consumer, "wiringPi") ;
+  req.num_lines = c->num ;
+  if ((err = chipConfig (c, &req.config)) < 0)
+    return err ;
+
+  if (ioctl (c->fd, GPIO_V2_GET_LINE_IOCTL, &req) < 0)
+    return -errno ;
+
+  fcntl (req.fd, F_SETFL, O_NONBLOCK) ;
+  return req.fd ;
+}
+
+static int chipRequest (struct chip *c)
+{
+  int fd, keep = -1 ;
+
+  if (c->req >= 0)
+  {
+    if (notifyOld != NULL)
+      notifyOld (c->req) ;
+    if (((fd = open ("/dev/null", O_RDONLY | O_CLOEXEC)) >= 0) && (dup3 (fd, c->req, O_CLOEXEC) >= 0))
+      keep = c->req ;
+    else
+      close (c->req) ;
+    if (fd >= 0)
+      close (fd) ;
+    c->req = -1 ;
+  }
+
+  if (c->num == 0)
+    fd = 0 ;
+  else if ((fd = chipGetLines (c)) >= 0)
+  {
+    if ((keep >= 0) && (dup3 (fd, keep, O_CLOEXEC) >= 0))
+    {
+      close (fd) ;
+      fd   = keep ;
+      keep = -1 ;
+    }
+    c->req = fd ;
+    if (notify != NULL)
+      notify (c->req) ;
+  }
+
+  if (keep >= 0)
+    close (keep) ;
+  return (fd < 0) ? fd : 0 ;
+}
+
+
+/*
+ * chipLine:
+ *	The request index of a gpio, adding it (as-is) if it's not held
+ *********************************************************************************
+ */
+
+static int chipLine (struct chip *c, int gpio)
+{
+  int i ;
+
+  if (indexOf [gpio] != 0)
+    return indexOf [gpio] - 1 ;
+  if (c->num == CHIP_LINES)
+    return -ENOSPC ;
+
+  i = c->num++ ;
+  c->offsets [i] = gpio - c->base ;
+  c->flags   [i] = 0 ;
+  c->outputs    &= ~(1ULL << i) ;
+  indexOf [gpio] = i + 1 ;
+  return i ;
+}
+
+
+/*
+ * chipCommit:
+ *	Apply a chip's new line table: a reconfigure of the request when no
+ *	line was added, so the lines held carry on undisturbed, else a new
+ *	request. On failure the old table, and the old request, are put back.
+ *********************************************************************************
+ */
+
+static void chipRestore (struct chip *c, const struct chip *old)
+{
+  int i, req = c->req ;
+
+  for (i = old->num ; i < c->num ; ++i)
+    indexOf [c->base + c->offsets [i]] = 0 ;
+  *c = *old ;
+  c->req = req ;
+}
+
+static int chipCommit (struct chip *c, const struct chip *old)
+{
+  struct gpio_v2_line_config cfg ;
+  int err ;
+
+  if ((c->num == old->num) && (c->req >= 0))
+  {
+    if ((err = chipConfig (c, &cfg)) == 0)
+      if ((err = ioctl (c->req, GPIO_V2_LINE_SET_CONFIG_IOCTL, &cfg)) < 0)
+	err = -errno ;
+    if (err < 0)
+      chipRestore (c, old) ;
+    return err ;
+  }
+
+  if ((err = chipRequest (c)) == 0)
+    return 0 ;
+
+  chipRestore (c, old) ;
+  chipRequest (c) ;
+  return err ;
+}
+
+
+/*
+ * chipSet:
+ *	Change the flags of one line
+ *********************************************************************************
+ */
+
+static int chipSet (int gpio, uint64_t clear, uint64_t set)
+{
+  struct chip *c, old ;
+  int i ;
+
+  if ((c = chipFor (gpio)) == NULL)
+    return -ENODEV ;
+
+  old = *c ;
+  if ((i = chipLine (c, gpio)) < 0)
+    return i ;
+
+  c->flags [i] = (c->flags [i] & ~clear) | set ;
+
+  if ((c->num == old.num) && (c->req >= 0) && (c->flags [i] == old.flags [i]))
+    return 0 ;
+  return chipCommit (c, &old) ;
+}
+
+
+/*
+ * chipAddLines:
+ *	Make sure all of a set of gpios are held, requesting the missing
+ *	ones with the given flags - once per chip, not once per line.
+ *********************************************************************************
+ */
+
+static int chipAddLines (const int *gpios, int n, uint64_t flags, uint64_t values)
+{
+  struct chip *c, old [CHIP_MAX] ;
+  int added [CHIP_MAX] ;
+  int k, i, ci, err = 0 ;
+
+  memset (added, 0, sizeof (added)) ;
+
+  for (k = 0 ; k < n ; ++k)
+  {
+    if ((c = chipFor (gpios [k])) == NULL)
+    {
+      err = -ENODEV ;
+      break ;
+    }
+    if (indexOf [gpios [k]] != 0)
+      continue ;
+
+    ci = c - chips ;
+    if (!added [ci])
+    {
+      old [ci]   = *c ;
+      added [ci] = 1 ;
+    }
+    if ((i = chipLine (c, gpios [k])) < 0)
+    {
+      err = i ;
+      break ;
+    }
+    c->flags [i] = flags ;
+    if (values & (1ULL << k))
+      c->outputs |= 1ULL << i ;
+  }
+
+  for (ci = 0 ; ci < numChips ; ++ci)
+  {
+    if (!added [ci])
+      continue ;
+    if (err < 0)
+      chipRestore (&chips [ci], &old [ci]) ;
+    else
+      err = chipCommit (&chips [ci], &old [ci]) ;
+  }
+
+  return err ;
+}
+
+
+/*
+ * chipInfo:
+ *	Name, label and size of a chip
+ *********************************************************************************
+ */
+
+static int chipInfo (const char *path, struct gpiochip_info *info)
+{
+  int fd, err = 0 ;
+
+  if ((fd = open (path, O_RDWR | O_CLOEXEC)) < 0)
+    return -errno ;
+  if (ioctl (fd, GPIO_GET_CHIPINFO_IOCTL, info) < 0)
+    err = -errno ;
+  close (fd) ;
+  return err ;
+}
+
+
+/*
+ * chipAttach:
+ *	Open a chip and give its lines gpio numbers from base
+ *********************************************************************************
+ */
+
+static int chipAttach (const char *path, int base, struct gpiochip_info *info)
+{
+  struct chip *c ;
+  int fd, i, lines ;
+
+  if (numChips == CHIP_MAX)
+    return -ENOSPC ;
+
+  if ((fd = open (path, O_RDWR | O_CLOEXEC)) < 0)
+    return -errno ;
+
+  if (ioctl (fd, GPIO_GET_CHIPINFO_IOCTL, info) < 0)
+  {
+    i = -errno ;
+    close (fd) ;
+    return i ;
+  }
+
+  if ((lines = info->lines) > CHIP_GPIOS - base)
+    lines = CHIP_GPIOS - base ;
+  if (lines <= 0)
+  {
+    close (fd) ;
+    return -ERANGE ;
+  }
+
+  c = &chips [numChips++] ;
+  memset (c, 0, sizeof (*c)) ;
+  c->fd    = fd ;
+  c->base  = base ;
+  c->lines = lines ;
+  c->req   = -1 ;
+
+  for (i = 0 ; i < lines ; ++i)
+    chipOf [base + i] = numChips ;
+
+  return 0 ;
+}
+
+
+/*
+ * wpiChipOpen:
+ *	Open the GPIO chips. Given a chip (a number or a path) its lines
+ *	become gpios 0 up. Given NULL, the Tinker Board banks are found by
+ *	their labels, gpio0 to gpio8, and numbered as the rest of wiringPi
+ *	numbers them.
+ *********************************************************************************
+ */
+
+int wpiChipOpen (const char *chip)
+{
+  struct gpiochip_info info ;
+  char path [64] ;
+  int i, bank, err ;
+
+  wpiChipClose () ;
+
+  pthread_mutex_lock (&chipMutex) ;
+
+  if (chip != NULL)
+  {
+    if (isdigit ((unsigned char)*chip))
+      snprintf (path, sizeof (path), "/dev/gpiochip%s", chip) ;
+    else
+      snprintf (path, sizeof (path), "%s", chip) ;
+    err = chipAttach (path, 0, &info) ;
+    pthread_mutex_unlock (&chipMutex) ;
+    return err ;
+  }
+
+  for (i = 0 ; i < 32 ; ++i)
+  {
+    snprintf (path, sizeof (path), "/dev/gpiochip%d", i) ;
+    if (chipInfo (path, &info) < 0)
+      continue ;
+    if ((sscanf (info.label, "gpio%d", &bank) != 1) || (bank < 0) || (bank >= CHIP_MAX))
+      continue ;
+    chipAttach (path, (bank == 0) ? 0 : 24 + 32 * (bank - 1), &info) ;
+  }
+
+  err = 0 ;
+  if (numChips == 0)
+    err = chipAttach ("/dev/gpiochip0", 0, &info) ;
+
+  pthread_mutex_unlock (&chipMutex) ;
+  return err ;
+}
+
+
+/*
+ * wpiChipClose:
+ *	Release everything
+ *********************************************************************************
+ */
+
+void wpiChipClose (void)
+{
+  int i ;
+
+  pthread_mutex_lock (&chipMutex) ;
+
+  for (i = 0 ; i < numChips ; ++i)
+  {
+    if (chips [i].req >= 0)
+      close (chips [i].req) ;
+    close (chips [i].fd) ;
+  }
+  numChips = 0 ;
+  memset (chipOf,  0, sizeof (chipOf)) ;
+  memset (indexOf, 0, sizeof (indexOf)) ;
+
+  pthread_mutex_unlock (&chipMutex) ;
+}
+
+
+/*
+ * wpiChipNotify:
+ *	Have a function called with each new line request fd, so it can be
+ *	watched for events, and one with a request fd that's about to be
+ *	replaced, to stop watching it. The new request may come back on
+ *	the same fd number.
+ *********************************************************************************
+ */
+
+void wpiChipNotify (void (*newRequest)(int fd), void (*oldRequest)(int fd))
+{
+  notify    = newRequest ;
+  notifyOld = oldRequest ;
+}
+
+
+/*
+ * wpiChipMode: wpiChipPull: wpiChipEdge:
+ *	Set the direction, bias and edge detection of a line
+ *********************************************************************************
+ */
+
+int wpiChipMode (int gpio, int mode)
+{
+  int err ;
+
+  pthread_mutex_lock (&chipMutex) ;
+  if (mode == OUTPUT)
+    err = chipSet (gpio, LINE_DIRECTION | LINE_EDGES, GPIO_V2_LINE_FLAG_OUTPUT) ;
+  else
+    err = chipSet (gpio, LINE_DIRECTION, GPIO_V2_LINE_FLAG_INPUT) ;
+  pthread_mutex_unlock (&chipMutex) ;
+  return err ;
+}
+
+int wpiChipPull (int gpio, int pud)
+{
+  struct chip *c ;
+  uint64_t set ;
+  int err ;
+
+  if (pud == PUD_UP)
+    set = GPIO_V2_LINE_FLAG_BIAS_PULL_UP ;
+  else if (pud == PUD_DOWN)
+    set = GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN ;
+  else
+    set = GPIO_V2_LINE_FLAG_BIAS_DISABLED ;
+
+  pthread_mutex_lock (&chipMutex) ;
+
+// Bias needs a direction: input, unless it's already something
+
+  if (((c = chipFor (gpio)) != NULL) &&
+      ((indexOf [gpio] == 0) || ((c->flags [indexOf [gpio] - 1] & LINE_DIRECTION) == 0)))
+    set |= GPIO_V2_LINE_FLAG_INPUT ;
+
+  err = chipSet (gpio, LINE_BIAS, set) ;
+  pthread_mutex_unlock (&chipMutex) ;
+  return err ;
+}
+
+int wpiChipEdge (int gpio, int edge)
+{
+  uint64_t set = GPIO_V2_LINE_FLAG_INPUT ;
+  int err ;
+
+  if ((edge == INT_EDGE_RISING) || (edge == INT_EDGE_BOTH))
+    set |= GPIO_V2_LINE_FLAG_EDGE_RISING ;
+  if ((edge == INT_EDGE_FALLING) || (edge == INT_EDGE_BOTH))
+    set |= GPIO_V2_LINE_FLAG_EDGE_FALLING ;
+
+  pthread_mutex_lock (&chipMutex) ;
+  err = chipSet (gpio, LINE_DIRECTION | LINE_EDGES, set) ;
+  pthread_mutex_unlock (&chipMutex) ;
+  return err ;
+}
+
+
+/*
+ * wpiChipRead: wpiChipWrite:
+ *	One line. A line that isn't held yet is taken as it is to read it,
+ *	and as an output to write it. Writing a line held as an input just
+ *	sets the value it will have as an output.
+ *********************************************************************************
+ */
+
+int wpiChipRead (int gpio)
+{
+  return wpiChipReadPins (&gpio, 1, NULL) ;
+}
+
+int wpiChipWrite (int gpio, int value)
+{
+  return wpiChipWritePins (&gpio, 1, value ? 1 : 0) ;
+}
+
+
+/*
+ * wpiChipReadPins:
+ *	Read up to 64 gpios: one ioctl per chip. Bit k of values is gpios [k].
+ *	With values NULL, return the single value of gpios [0].
+ *********************************************************************************
+ */
+
+int wpiChipReadPins (const int *gpios, int n, uint64_t *values)
+{
+  struct gpio_v2_line_values lv [CHIP_MAX] ;
+  uint64_t result = 0 ;
+  struct chip *c ;
+  int k, ci, err ;
+
+  if ((n < 0) || (n > 64))
+    return -EINVAL ;
+
+  pthread_mutex_lock (&chipMutex) ;
+
+  if ((err = chipAddLines (gpios, n, 0, 0)) < 0)
+    goto out ;
+
+  memset (lv, 0, sizeof (lv)) ;
+  for (k = 0 ; k < n ; ++k)
+    lv [chipOf [gpios [k]] - 1].mask |= 1ULL << (indexOf [gpios [k]] - 1) ;
+
+  for (ci = 0 ; ci < numChips ; ++ci)
+    if (lv [ci].mask != 0)
+      if (ioctl (chips [ci].req, GPIO_V2_LINE_GET_VALUES_IOCTL, &lv [ci]) < 0)
+      {
+	err = -errno ;
+	goto out ;
+      }
+
+  for (k = 0 ; k < n ; ++k)
+  {
+    c = chipFor (gpios [k]) ;
+    if (lv [c - chips].bits & (1ULL << (indexOf [gpios [k]] - 1)))
+      result |= 1ULL << k ;
+  }
+
+  if (values != NULL)
+    *values = result ;
+  else
+    err = (int)(result & 1) ;
+
+out:
+  pthread_mutex_unlock (&chipMutex) ;
+  return err ;
+}
+
+
+/*
+ * wpiChipWritePins:
+ *	Write up to 64 gpios: one ioctl per chip. Bit k of values is gpios [k].
+ *********************************************************************************
+ */
+
+int wpiChipWritePins (const int *gpios, int n, uint64_t values)
+{
+  struct gpio_v2_line_values lv [CHIP_MAX] ;
+  struct chip *c ;
+  uint64_t bit ;
+  int k, i, ci, err ;
+
+  if ((n < 0) || (n > 64))
+    return -EINVAL ;
+
+  pthread_mutex_lock (&chipMutex) ;
+
+  if ((err = chipAddLines (gpios, n, GPIO_V2_LINE_FLAG_OUTPUT, values)) < 0)
+    goto out ;
+
+  memset (lv, 0, sizeof (lv)) ;
+  for (k = 0 ; k < n ; ++k)
+  {
+    c   = chipFor (gpios [k]) ;
+    i   = indexOf [gpios [k]] - 1 ;
+    bit = 1ULL << i ;
+
+    c->outputs = (values & (1ULL << k)) ? (c->outputs | bit) : (c->outputs & ~bit) ;
+    if (c->flags [i] & GPIO_V2_LINE_FLAG_OUTPUT)
+    {
+      ci = c - chips ;
+      lv [ci].mask |= bit ;
+      lv [ci].bits  = (lv [ci].bits & ~bit) | (c->outputs & bit) ;
+    }
+  }
+
+  for (ci = 0 ; ci < numChips ; ++ci)
+    if (lv [ci].mask != 0)
+      if (ioctl (chips [ci].req, GPIO_V2_LINE_SET_VALUES_IOCTL, &lv [ci]) < 0)
+      {
+	err = -errno ;
+	break ;
+      }
+
+out:
+  pthread_mutex_unlock (&chipMutex) ;
+  return err ;
+}
+
+
+/*
+ * wpiChipEventFd:
+ *	The fd a gpio's edges arrive on, or -1 if it's not held
+ *********************************************************************************
+ */
+
+int wpiChipEventFd (int gpio)
+{
+  struct chip *c ;
+  int fd = -1 ;
+
+  pthread_mutex_lock (&chipMutex) ;
+  if (((c = chipFor (gpio)) != NULL) && (indexOf [gpio] != 0))
+    fd = c->req ;
+  pthread_mutex_unlock (&chipMutex) ;
+  return fd ;
+}
+
+
+/*
+ * wpiChipReadEvents:
+ *	Read up to max pending edges from a request fd, so poll it first.
+ *	Returns the number read, 0 if there were none after all.
+ *********************************************************************************
+ */
+
+int wpiChipReadEvents (int fd, struct wpiChipEvent *events, int max)
+{
+  struct gpio_v2_line_event le [CHIP_EVENTS] ;
+  int base = -1, ci, k, n ;
+  ssize_t r ;
+
+  pthread_mutex_lock (&chipMutex) ;
+  for (ci = 0 ; ci < numChips ; ++ci)
+    if (chips [ci].req == fd)
+      base = chips [ci].base ;
+  pthread_mutex_unlock (&chipMutex) ;
+
+  if (base < 0)
+    return -EBADF ;
+
+  if ((n = max) > CHIP_EVENTS)
+    n = CHIP_EVENTS ;
+  if ((r = read (fd, le, n * sizeof (le [0]))) < 0)
+    return (errno == EAGAIN) ? 0 : -errno ;
+
+  n = r / sizeof (le [0]) ;
+  for (k = 0 ; k < n ; ++k)
+  {
+    events [k].gpio      = base + le [k].offset ;
+    events [k].level     = (le [k].id == GPIO_V2_LINE_EVENT_RISING_EDGE) ? HIGH : LOW ;
+    events [k].timestamp = le [k].timestamp_ns ;
+    events [k].seqno     = le [k].line_seqno ;
+  }
+  return n ;
+}
+
+#else
+
+// Headers too old for uAPI v2: no character device support
+
+int  wpiChipOpen       (const char *chip)                                   { return -ENOSYS ; }
+void wpiChipClose      (void)                                               { }
+void wpiChipNotify     (void (*newRequest)(int fd), void (*oldRequest)(int fd)) { }
+int  wpiChipMode       (int gpio, int mode)                                 { return -ENOSYS ; }
+int  wpiChipPull       (int gpio, int pud)                                  { return -ENOSYS ; }
+int  wpiChipEdge       (int gpio, int edge)                                 { return -ENOSYS ; }
+int  wpiChipRead       (int gpio)                                           { return -ENOSYS ; }
+int  wpiChipWrite      (int gpio, int value)                                { return -ENOSYS ; }
+int  wpiChipReadPins   (const int *gpios, int n, uint64_t *values)          { return -ENOSYS ; }
+int  wpiChipWritePins  (const int *gpios, int n, uint64_t values)           { return -ENOSYS ; }
+int  wpiChipEventFd    (int gpio)                                           { return -1 ; }
+int  wpiChipReadEvents (int fd, struct wpiChipEvent *events, int max)       { return -ENOSYS ; }
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * wiringChip.h:
+ *	GPIO access through the Linux GPIO character device (/dev/gpiochipN,
+ *	uAPI v2) - the replacement for /sys/class/gpio.
+ ***********************************************************************
+ * This file is part of wiringPi:
+ *	https://projects.drogon.net/raspberry-pi/wiringpi/
+ *
+ *    wiringPi is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU Lesser General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    wiringPi is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public License
+ *    along with wiringPi.  If not, see <http://www.gnu.org/licenses/>.
+ ***********************************************************************
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// An edge, as read from a line request
+
+struct wpiChipEvent
+{
+  int      gpio ;
+  int      level ;		// HIGH after a rising edge, LOW after a falling one
+  uint64_t timestamp ;		// Kernel time, CLOCK_MONOTONIC nS
+  unsigned int seqno ;		// Per line, 1 up: a gap is an edge the kernel lost
+} ;
+
+extern int  wpiChipOpen       (const char *chip) ;
+extern void wpiChipClose      (void) ;
+extern void wpiChipNotify     (void (*newRequest)(int fd), void (*oldRequest)(int fd)) ;
+
+extern int  wpiChipMode       (int gpio, int mode) ;
+extern int  wpiChipPull       (int gpio, int pud) ;
+extern int  wpiChipEdge       (int gpio, int edge) ;
+extern int  wpiChipRead       (int gpio) ;
+extern int  wpiChipWrite      (int gpio, int value) ;
+extern int  wpiChipReadPins   (const int *gpios, int n, uint64_t *values) ;
+extern int  wpiChipWritePins  (const int *gpios, int n, uint64_t values) ;
+
+extern int  wpiChipEventFd    (int gpio) ;
+extern int  wpiChipReadEvents (int fd, struct wpiChipEvent *events, int max) ;
+
+#ifdef __cplusplus
+}
+#endif
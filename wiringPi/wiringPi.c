@@ -69,11 +69,15 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sched.h>
 
 #include "softPwm.h"
 #include "softTone.h"
 
 #include "wiringPi.h"
+#include "wiringChip.h"
 
 #ifndef	TRUE
 #define	TRUE	(1==1)
@@ -86,6 +90,9 @@
 #define	ENV_DEBUG	"WIRINGPI_DEBUG"
 #define	ENV_CODES	"WIRINGPI_CODES"
 #define	ENV_GPIOMEM	"WIRINGPI_GPIOMEM"
+#define	ENV_CACHED	"WIRINGPI_CACHED"
+#define	ENV_SIM		"WIRINGPI_SIM"
+#define	ENV_GPIOCHIP	"WIRINGPI_GPIOCHIP"
 
 
 // Mask for the bottom 64 pins which belong to the Raspberry Pi
@@ -99,6 +106,22 @@
 
 struct wiringPiNodeStruct *wiringPiNodes = NULL ;
 
+// The node table:
+//	Extension pins under NODE_TABLE_PINS are found through a two level
+//	table - a directory of pages of node pointers - instead of a walk
+//	of wiringPiNodes. Entries only ever go from NULL to a node, and
+//	pages are only ever added, each published with one atomic store
+//	once it's filled in, so a lookup needs no lock and sees either no
+//	node or the whole of one. Pins above the table still walk the list.
+
+#define	NODE_PAGE_BITS	8
+#define	NODE_PAGE_PINS	(1 << NODE_PAGE_BITS)
+#define	NODE_PAGES	256
+#define	NODE_TABLE_PINS	(NODE_PAGES * NODE_PAGE_PINS)
+
+static struct wiringPiNodeStruct **nodePages [NODE_PAGES] ;
+static pthread_mutex_t nodeMutex = PTHREAD_MUTEX_INITIALIZER ;
+
 // BCM Magic
 
 #define	BCM_PASSWORD		0x5A000000
@@ -284,13 +307,27 @@ const int piMemorySize [8] =
 } ;
 
 // Time for easy calculations
+//	Everything runs off CLOCK_MONOTONIC, so setting the clock doesn't
+//	upset timeouts. A delay sleeps until spinNanos before its end, as
+//	nanosleep overshoots by about that much (see calibrateSleep), and
+//	spins the rest. It's measured the first time a delay needs it, not
+//	at setup, so programs that never delay don't pay for it.
+
+static uint64_t epochNanos ;
+static uint64_t spinNanos = 80000 ;
+static pthread_once_t spinOnce = PTHREAD_ONCE_INIT ;
 
-static uint64_t epochMilli, epochMicro ;
+static inline uint64_t monoNanos (void)
+{
+	struct timespec ts ;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts) ;
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec ;
+}
 
 // Misc
 
 static int wiringPiMode = WPI_MODE_UNINITIALISED ;
-static volatile int    pinPass = -1 ;
 static pthread_mutex_t pinMutex ;
 
 // Debugging & Return codes
@@ -302,6 +339,12 @@ int wiringPiReturnCodes = FALSE ;
 
 int wiringPiTryGpioMem  = FALSE ;
 
+// Simulated registers? File name, or "" for anonymous memory
+
+#ifdef TINKER_BOARD
+static const char *wiringPiSimFile = NULL ;
+#endif
+
 // sysFds:
 //	Map a file descriptor from the /sys/class/gpio/gpioX/value
 
@@ -329,6 +372,89 @@ static int sysFds [258] =
 // ISR Data
 
 static void (*isrFunctions [258])(void) ;
+static void (*isrFunctionsEx [258])(int pin, int level, uint64_t timestamp, void *userData) ;
+static void  *isrUserData [258] ;
+
+// ISR dispatch:
+//	Every pin being watched is in an epoll set, served by one thread -
+//	or a few, one set each, see wiringPiISRThreads (). The threads are
+//	only started when the first pin is handed to them.
+
+#define	ISR_MAX_THREADS	   8
+#define	ISR_EVENTS	  16
+
+static int isrThreads  =  1 ;
+static int isrFirstCpu = -1 ;
+static int isrNext     =  0 ;
+static int isrEpollFds [ISR_MAX_THREADS] = { -1, -1, -1, -1, -1, -1, -1, -1 } ;
+static int isrEpollOf  [258] ;		// Set + 1 of a watched pin, 0 if not
+static int isrOwnFd    [258] ;		// We opened its sysFds entry
+static int isrSetPins  [ISR_MAX_THREADS] ;
+static int isrStopFds  [ISR_MAX_THREADS] = { -1, -1, -1, -1, -1, -1, -1, -1 } ;	// Of the set's latest thread
+static unsigned int isrGens    [ISR_MAX_THREADS] ;	// Of the set's latest thread
+static unsigned int isrStopGen [ISR_MAX_THREADS] ;	// Threads up to this one stop
+static pthread_t isrThreadIds [ISR_MAX_THREADS] ;
+
+// In GPIO device mode the pins arrive a chip at a time, on the chip's
+//	line request fd, all in the one set. Its entries carry ISR_CHIP in
+//	place of the pin number.
+
+#define	ISR_CHIP	0xFFFFFFFFu
+#define	ISR_STOP	0xFFFFFFFEu		// The set's stop/wake eventfd
+
+static int isrDevSet = -1 ;
+static int isrDevArmed [258] ;		// waitForInterrupt set the edges
+static int isrOwned    [258] ;		// wiringPiISR set them: leave them be
+
+// Once the dispatcher has the chip fd, waitForInterrupt can't read it
+//	too: the dispatcher counts the edges on pins without a function
+//	and waitForInterrupt waits for the count to move. The condition
+//	variable times out on CLOCK_MONOTONIC, so setting the clock doesn't
+//	stretch or cut short a wait; it's set up before the dispatcher starts.
+
+static pthread_mutex_t isrDevMutex = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  isrDevCond ;
+static pthread_once_t  isrDevOnce  = PTHREAD_ONCE_INIT ;
+static unsigned int isrDevCount [258] ;
+static unsigned int isrDevSeen  [258] ;
+
+// Time of the last interrupt on each pin, CLOCK_MONOTONIC nS
+
+static volatile uint64_t isrTimes [258] ;
+
+// Event rings:
+//	Single producer, single consumer. All of a ring's pins are on the
+//	one dispatcher thread, the only writer of head; the program reading
+//	it is the only writer of tail. An edge that finds the ring full is
+//	counted in overflow, as are edges the kernel says it lost.
+
+struct wpiEventRing
+{
+  unsigned int size ;			// A power of 2
+  unsigned int head ;			// Next to fill
+  unsigned int tail ;			// Next to read
+  unsigned int overflow ;
+  int          set ;			// Its dispatcher, -1 until the first pin
+  int          fd ;			// eventfd, kicked when it stops being empty
+  struct wpiEdgeEvent events [] ;
+} ;
+
+static struct wpiEventRing *isrRings [258] ;
+static int          isrModes [258] ;
+static unsigned int isrSeqs  [258] ;	// Last kernel sequence number seen
+
+// So a pin or ring can be taken off a running dispatcher: the passes
+//	it's finished (a batch of events fully handled), anyone waiting
+//	for the next, and fds to close once its batch is done, when they
+//	were removed from inside it.
+
+static unsigned int isrPasses  [ISR_MAX_THREADS] ;
+static int          isrWaiters [ISR_MAX_THREADS] ;
+static pthread_mutex_t isrPassMutex = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  isrPassCond  = PTHREAD_COND_INITIALIZER ;
+
+static int isrLateFds   [ISR_MAX_THREADS][258] ;
+static int isrLateCount [ISR_MAX_THREADS] ;
 
 // Doing it the Arduino way with lookup tables...
 //	Yes, it's probably more innefficient than all the bit-twidling, but it
@@ -386,6 +512,40 @@ static int pinToGpioR2 [64] =
 
 static int *physToGpio ;
 
+#ifdef TINKER_BOARD
+// wpiHeader, physHeader:
+//	The bank and bit in the bank of each wiringPi and physical pin,
+//	worked out once at setup time so the multi-pin functions can sort
+//	pins into banks without going through the gpio number each time.
+//	A bank of -1 is a pin that isn't a GPIO.
+
+struct headerPin
+{
+  int      bank ;
+  uint32_t mask ;
+} ;
+
+static struct headerPin wpiHeader  [64] ;
+static struct headerPin physHeader [64] ;
+
+// headerScatter:
+//	The other way round for reading: one entry per header GPIO with the
+//	wiringPi and physical bits it lands on, and the banks that need
+//	loading to fill them all in.
+
+struct headerScatter
+{
+  int      bank ;
+  uint32_t mask ;
+  uint64_t wpiBit ;
+  uint64_t physBit ;
+} ;
+
+static struct headerScatter headerScatter [64] ;
+static int                  headerScatterCount ;
+static uint32_t             headerBanks ;
+#endif
+
 #ifndef TINKER_BOARD
 static int physToGpioR1 [64] =
 {
@@ -684,6 +844,19 @@ int wiringPiFailure (int fatal, const char *message, ...)
  *********************************************************************************
  */
 
+// The Revision line of /proc/cpuinfo, as found by piGpioLayout
+
+static char cpuRevision [120] ;
+
+#ifdef TINKER_BOARD
+static const char *piSimFile (void)
+{
+	if (wiringPiSimFile == NULL)
+		wiringPiSimFile = getenv (ENV_SIM) ;
+	return wiringPiSimFile ;
+}
+#endif
+
 static void piGpioLayoutOops (const char *why)
 {
 	fprintf (stderr, "piBoardRev: Unable to determine board revision from /proc/cpuinfo\n") ;
@@ -701,6 +874,10 @@ int piGpioLayout (void)
 	static int  gpioLayout = -1 ;
 	if (gpioLayout != -1)	// No point checking twice
 		return gpioLayout ;
+	#ifdef TINKER_BOARD
+	if (piSimFile () != NULL)	// No hardware to look at
+		return gpioLayout = 2 ;
+	#endif
 	if ((cpuFd = fopen ("/proc/cpuinfo", "r")) == NULL)
 		piGpioLayoutOops ("Unable to open /proc/cpuinfo") ;
 	// Start by looking for the Architecture to make sure we're really running
@@ -745,6 +922,7 @@ int piGpioLayout (void)
 	// Chomp trailing CR/NL
 	for (c = &line [strlen (line) - 1] ; (*c == '\n') || (*c == '\r') ; --c)
 		*c = 0 ;
+	strcpy (cpuRevision, line) ;	// Saves piBoardId reading it all again
 	if (wiringPiDebug)
 		printf ("piGpioLayout: Revision string: %s\n", line) ;
 	// Scan to the first character of the revision number
@@ -788,6 +966,8 @@ int piBoardRev (void)
  *	This is undocumented and really only intended for the GPIO command.
  *	Use at your own risk!
  *
+ *	/proc/cpuinfo is only read once, later calls get the same answer.
+ *
  *	Seems there are some boards with 0000 in them (mistake in manufacture)
  *	So the distinction between boards that I can see is:
  *
@@ -836,9 +1016,8 @@ int piBoardRev (void)
  *********************************************************************************
  */
 
-void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
+static void piBoardIdRead (int *model, int *rev, int *mem, int *maker, int *warranty)
 {
-	FILE *cpuFd ;
 	char line [120] ;
 	char *c ;
 	unsigned int revision ;
@@ -846,12 +1025,14 @@ void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
 	//	Will deal with the properly later on - for now, lets just get it going...
 	//  unsigned int modelNum ;
 	(void)piGpioLayout () ;	// Call this first to make sure all's OK. Don't care about the result.
-	if ((cpuFd = fopen ("/proc/cpuinfo", "r")) == NULL)
-		piGpioLayoutOops ("Unable to open /proc/cpuinfo") ;
-	while (fgets (line, 120, cpuFd) != NULL)
-		if (strncmp (line, "Revision", 8) == 0)
-			break ;
-	fclose (cpuFd) ;
+	#ifdef TINKER_BOARD
+	if (piSimFile () != NULL)
+	{
+		*model = PI_MODEL_TB ; *rev = PI_VERSION_1_2 ; *mem = 3 ; *maker = PI_MAKER_ASUS ; *warranty = 0 ;
+		return ;
+	}
+	#endif
+	strcpy (line, cpuRevision) ;
 	if (strncmp (line, "Revision", 8) != 0)
 		piGpioLayoutOops ("No \"Revision\" line") ;
 	// Chomp trailing CR/NL
@@ -934,6 +1115,23 @@ void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
 		#endif
 	}
 }
+
+
+void piBoardId (int *model, int *rev, int *mem, int *maker, int *warranty)
+{
+	static int cached = FALSE ;
+	static int bModel, bRev, bMem, bMaker, bWarranty ;
+	if (!cached)	// The board won't change under us
+	{
+		piBoardIdRead (&bModel, &bRev, &bMem, &bMaker, &bWarranty) ;
+		cached = TRUE ;
+	}
+	*model    = bModel ;
+	*rev      = bRev ;
+	*mem      = bMem ;
+	*maker    = bMaker ;
+	*warranty = bWarranty ;
+}
  
 
 
@@ -1189,6 +1387,67 @@ void setPwmFrequency (int pin, int divisor)
 	#endif
 }
 
+/*
+ * pwmCapable:
+ *	Can the pin do hardware PWM (pinMode PWM_OUTPUT)?
+ *********************************************************************************
+ */
+
+int pwmCapable (int pin)
+{
+	if ((pin & PI_GPIO_MASK) != 0)		// Not On-Board
+		return FALSE ;
+
+	/**/ if (wiringPiMode == WPI_MODE_PINS)
+		pin = pinToGpio [pin & 63] ;
+	else if (wiringPiMode == WPI_MODE_PHYS)
+		pin = physToGpio [pin & 63] ;
+	else if (wiringPiMode != WPI_MODE_GPIO)
+		return FALSE ;
+
+	#ifdef TINKER_BOARD
+	return (pin == PWM2) || (pin == PWM3) ;
+	#else
+	return (pin >= 0) && (pin < 64) && (gpioToPwmALT [pin] != 0) ;
+	#endif
+}
+
+
+/*
+ * pwmStage: pwmCommit:
+ *	Stage a change of period, value and/or clock divisor (-1 to leave
+ *	it alone) on a PWM pin, then commit everything staged in one go.
+ *	Channels that get a new period or clock are restarted together,
+ *	so they run in phase; value-only changes take effect at the end
+ *	of the current period.
+ *********************************************************************************
+ */
+
+int pwmStage (int pin, int period, int value, int divisor)
+{
+	#ifdef TINKER_BOARD
+	if ((pin & PI_GPIO_MASK) == 0)          // On-Board Pin
+	{
+		if (wiringPiMode == WPI_MODE_PINS)
+			pin = pinToGpio [pin] ;
+		else if (wiringPiMode == WPI_MODE_PHYS)
+			pin = physToGpio [pin] ;
+		else if (wiringPiMode != WPI_MODE_GPIO)
+			return -1 ;
+		return asus_pwm_stage (pin, period, value, divisor) ;
+	}
+	#endif
+	return -1 ;
+}
+
+void pwmCommit (void)
+{
+	#ifdef TINKER_BOARD
+	if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+		asus_pwm_commit () ;
+	#endif
+}
+
 /*
  * setGpioDrive:
  *	Set the drive strength on a given port. 
@@ -1272,24 +1531,34 @@ void gpioClockSet (int pin, int freq)
 
 
 /*
- * wiringPiFindNode:
+ * findNode: wiringPiFindNode:
  *      Locate our device node
  *********************************************************************************
  */
 
-struct wiringPiNodeStruct *wiringPiFindNode (int pin)
+static inline struct wiringPiNodeStruct *findNode (int pin)
 {
-  struct wiringPiNodeStruct *node = wiringPiNodes ;
+  struct wiringPiNodeStruct **page, *node ;
+
+  if ((unsigned int)pin < NODE_TABLE_PINS)
+  {
+    if ((page = __atomic_load_n (&nodePages [pin >> NODE_PAGE_BITS], __ATOMIC_ACQUIRE)) == NULL)
+      return NULL ;
+    return __atomic_load_n (&page [pin & (NODE_PAGE_PINS - 1)], __ATOMIC_ACQUIRE) ;
+  }
 
-  while (node != NULL)
+  for (node = __atomic_load_n (&wiringPiNodes, __ATOMIC_ACQUIRE) ; node != NULL ; node = node->next)
     if ((pin >= node->pinBase) && (pin <= node->pinMax))
       return node ;
-    else
-      node = node->next ;
 
   return NULL ;
 }
 
+struct wiringPiNodeStruct *wiringPiFindNode (int pin)
+{
+  return findNode (pin) ;
+}
+
 
 /*
  * wiringPiNewNode:
@@ -1305,25 +1574,79 @@ static void pwmWriteDummy            (struct wiringPiNodeStruct *node, int pin,
 static int  analogReadDummy          (struct wiringPiNodeStruct *node, int pin)            { return 0 ; }
 static void analogWriteDummy         (struct wiringPiNodeStruct *node, int pin, int value) { return ; }
 
+/*
+ * nodeTablePages:
+ *	Make sure there's a page for each of a node's pins in the table.
+ *	New pages are empty so they can be published straight away.
+ *	Called with nodeMutex held.
+ *********************************************************************************
+ */
+
+static int nodeTablePages (int pinBase, int pinMax)
+{
+  struct wiringPiNodeStruct **page ;
+  int dir ;
+
+  if (pinMax >= NODE_TABLE_PINS)
+    pinMax = NODE_TABLE_PINS - 1 ;
+
+  for (dir = pinBase >> NODE_PAGE_BITS ; dir <= (pinMax >> NODE_PAGE_BITS) ; ++dir)
+    if (nodePages [dir] == NULL)
+    {
+      if ((page = calloc (NODE_PAGE_PINS, sizeof (*page))) == NULL)
+	return -1 ;
+      __atomic_store_n (&nodePages [dir], page, __ATOMIC_RELEASE) ;
+    }
+
+  return 0 ;
+}
+
+
 struct wiringPiNodeStruct* wiringPiNewNode (int pinBase, int numPins)
 {
-  int    pin ;
+  int    pin, max ;
   struct wiringPiNodeStruct *node ;
 
 // Minimum pin base is 64
 
   if (pinBase < 64)
+  {
     (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: pinBase of %d is < 64\n", pinBase) ;
+    return NULL ;
+  }
+
+  pthread_mutex_lock (&nodeMutex) ;
 
-// Check all pins in-case there is overlap:
+// Check all pins in-case there is overlap: in the table pin by pin,
+//	above it against each node
 
-  for (pin = pinBase ; pin < (pinBase + numPins) ; ++pin)
-    if (wiringPiFindNode (pin) != NULL)
+  for (pin = pinBase ; (pin < (pinBase + numPins)) && (pin < NODE_TABLE_PINS) ; ++pin)
+    if (findNode (pin) != NULL)
+    {
+      pthread_mutex_unlock (&nodeMutex) ;
       (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Pin %d overlaps with existing definition\n", pin) ;
+      return NULL ;
+    }
+
+  if (pinBase + numPins > NODE_TABLE_PINS)
+    for (node = wiringPiNodes ; node != NULL ; node = node->next)
+      if ((node->pinMax >= NODE_TABLE_PINS) && (node->pinMax >= pinBase) && (node->pinBase < pinBase + numPins))
+      {
+	pthread_mutex_unlock (&nodeMutex) ;
+	(void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Pins %d-%d overlap with existing definition\n", pinBase, pinBase + numPins - 1) ;
+	return NULL ;
+      }
+
+// Allocate everything up front, so it's all or nothing
 
   node = (struct wiringPiNodeStruct *)calloc (sizeof (struct wiringPiNodeStruct), 1) ;	// calloc zeros
-  if (node == NULL)
+  if ((node == NULL) || (nodeTablePages (pinBase, pinBase + numPins - 1) < 0))
+  {
+    pthread_mutex_unlock (&nodeMutex) ;
+    free (node) ;
     (void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Unable to allocate memory: %s\n", strerror (errno)) ;
+    return NULL ;
+  }
 
   node->pinBase         = pinBase ;
   node->pinMax          = pinBase + numPins - 1 ;
@@ -1335,7 +1658,15 @@ struct wiringPiNodeStruct* wiringPiNewNode (int pinBase, int numPins)
   node->analogRead      = analogReadDummy ;
   node->analogWrite     = analogWriteDummy ;
   node->next            = wiringPiNodes ;
-  wiringPiNodes         = node ;
+
+// Publish it - with the dummies until the caller fills it in
+
+  max = (node->pinMax < NODE_TABLE_PINS) ? node->pinMax : NODE_TABLE_PINS - 1 ;
+  for (pin = pinBase ; pin <= max ; ++pin)
+    __atomic_store_n (&nodePages [pin >> NODE_PAGE_BITS][pin & (NODE_PAGE_PINS - 1)], node, __ATOMIC_RELEASE) ;
+  __atomic_store_n (&wiringPiNodes, node, __ATOMIC_RELEASE) ;
+
+  pthread_mutex_unlock (&nodeMutex) ;
 
   return node ;
 }
@@ -1412,6 +1743,12 @@ void pinMode (int pin, int mode)
             pin = pinToGpio [pin] ;
         else if (wiringPiMode == WPI_MODE_PHYS)
             pin = physToGpio [pin] ;
+        else if (wiringPiMode == WPI_MODE_GPIO_DEV)
+        {
+            if ((mode == INPUT) || (mode == OUTPUT))
+                wpiChipMode (pin, mode) ;
+            return ;
+        }
         else if (wiringPiMode != WPI_MODE_GPIO)
             return ;
         softPwmStop  (origPin) ;
@@ -1494,7 +1831,7 @@ void pinMode (int pin, int mode)
     }//if ((pin & PI_GPIO_MASK) == 0)
     else
     {
-		if ((node = wiringPiFindNode (pin)) != NULL)
+		if ((node = findNode (pin)) != NULL)
 			node->pinMode (node, pin, mode) ;
 		return ;
 	}
@@ -1520,6 +1857,11 @@ void pullUpDnControl (int pin, int pud)
 			pin = pinToGpio [pin] ;
 		else if (wiringPiMode == WPI_MODE_PHYS)
 			pin = physToGpio [pin] ;
+		else if (wiringPiMode == WPI_MODE_GPIO_DEV)
+		{
+			wpiChipPull (pin, pud) ;
+			return ;
+		}
 		else if (wiringPiMode != WPI_MODE_GPIO)
 			return ;
 		#ifdef TINKER_BOARD
@@ -1533,7 +1875,7 @@ void pullUpDnControl (int pin, int pud)
   	}
 	else						// Extension module
   	{
-		if ((node = wiringPiFindNode (pin)) != NULL)
+		if ((node = findNode (pin)) != NULL)
 			node->pullUpDnControl (node, pin, pud) ;
     	return ;
   	}
@@ -1560,6 +1902,8 @@ int digitalRead (int pin)
 			read   (sysFds [pin], &c, 1) ;
 			return (c == '0') ? LOW : HIGH ;
 		}
+		else if (wiringPiMode == WPI_MODE_GPIO_DEV)
+			return (wpiChipRead (pin) > 0) ? HIGH : LOW ;
 		else if (wiringPiMode == WPI_MODE_PINS)
 			pin = pinToGpio [pin] ;
 		else if (wiringPiMode == WPI_MODE_PHYS)
@@ -1579,7 +1923,7 @@ int digitalRead (int pin)
 	}
 	else
 	{
-		if ((node = wiringPiFindNode (pin)) == NULL)
+		if ((node = findNode (pin)) == NULL)
 			return LOW ;
 		return node->digitalRead (node, pin) ;
 	}
@@ -1609,6 +1953,11 @@ void digitalWrite (int pin, int value)
 			}
 			return ;
 		}
+		else if (wiringPiMode == WPI_MODE_GPIO_DEV)
+		{
+			wpiChipWrite (pin, value) ;
+			return ;
+		}
 		else if (wiringPiMode == WPI_MODE_PINS)
 			pin = pinToGpio [pin] ;
 		else if (wiringPiMode == WPI_MODE_PHYS)
@@ -1626,12 +1975,52 @@ void digitalWrite (int pin, int value)
 	}
 	else
 	{
-		if ((node = wiringPiFindNode (pin)) != NULL)
+		if ((node = findNode (pin)) != NULL)
 			node->digitalWrite (node, pin, value) ;
 	}
 }
 
 
+/*
+ * wpiPinOpen:
+ *	Translate and check a pin once, returning a handle that the inline
+ *	wpiHandleWrite/Read/Toggle functions can use directly on the GPIO
+ *	bank registers. Pins we can't reach that way (extension nodes, sys
+ *	mode, non Tinker hardware) get a handle that falls back to the
+ *	normal digitalRead/digitalWrite path.
+ *********************************************************************************
+ */
+
+wpiPinHandle wpiPinOpen (int pin)
+{
+	wpiPinHandle h ;
+	#ifdef TINKER_BOARD
+	int gpio = -1 ;
+	#endif
+	h.bank   = NULL ;
+	h.mask   = 0 ;
+	h.bankNo = -1 ;
+	h.pin    = pin ;
+	#ifdef TINKER_BOARD
+	if ((pin & PI_GPIO_MASK) == 0)		// On-Board Pin
+	{
+		if ((wiringPiMode == WPI_MODE_PINS) && (pin < 64))
+			gpio = pinToGpio [pin] ;
+		else if ((wiringPiMode == WPI_MODE_PHYS) && (pin < 64))
+			gpio = physToGpio [pin] ;
+		else if (wiringPiMode == WPI_MODE_GPIO)
+			gpio = pin ;
+		if ((gpio != -1) && ((h.bank = asus_get_gpio_bank (gpio)) != NULL))
+		{
+			h.mask   = 1 << gpioToBankPin (gpio) ;
+			h.bankNo = gpioToBank (gpio) ;
+		}
+	}
+	#endif
+	return h ;
+}
+
+
 /*
  * pwmWrite:
  *	Set an output PWM value
@@ -1657,7 +2046,7 @@ void pwmWrite (int pin, int value)
     }
 	else
 	{
-		if ((node = wiringPiFindNode (pin)) != NULL)
+		if ((node = findNode (pin)) != NULL)
 			node->pwmWrite (node, pin, value) ;
 	}
 }
@@ -1674,7 +2063,7 @@ int analogRead (int pin)
 {
 	struct wiringPiNodeStruct *node = wiringPiNodes ;
 
-	if ((node = wiringPiFindNode (pin)) == NULL)
+	if ((node = findNode (pin)) == NULL)
 		return 0 ;
 	else
 		return node->analogRead (node, pin) ;
@@ -1693,7 +2082,7 @@ void analogWrite (int pin, int value)
 {
 	struct wiringPiNodeStruct *node = wiringPiNodes ;
 
-	if ((node = wiringPiFindNode (pin)) == NULL)
+	if ((node = findNode (pin)) == NULL)
 		return ;
 
 	node->analogWrite (node, pin, value) ;
@@ -1737,116 +2126,575 @@ void pwmToneWrite (int pin, int freq)
 
 
 /*
- * digitalWriteByte:
- *	Pi Specific
- *	Write an 8-bit byte to the first 8 GPIO pins - try to do it as
- *	fast as possible.
- *	However it still needs 2 operations to set the bits, so any external
- *	hardware must not rely on seeing a change as there will be a change 
- *	to set the outputs bits to zero, then another change to set the 1's
+ * digitalWriteBank:
+ *	Tinker Specific.
+ *	Set the bits in setMask and clear the bits in clrMask of one GPIO
+ *	bank with a single update of its data register, so all of the
+ *	outputs change at the same instant. Bits that are in both masks
+ *	end up set.
  *********************************************************************************
  */
 
-void digitalWriteByte (int value)
+void digitalWriteBank (int bank, unsigned int setMask, unsigned int clrMask)
 {
-	
-	int mask = 1 ;
-	int pin ;
-	#ifdef TINKER_BOARD
-	/**/ if (wiringPiMode == WPI_MODE_GPIO_SYS||wiringPiMode == WPI_MODE_GPIO)
-	{
-		for (pin = 0 ; pin < 8 ; ++pin)
-		{
-			pinMode(pin,OUTPUT);
-			digitalWrite (pin, value & mask) ;
-			mask <<= 1 ;
-		}
-		return ;
-	}
-	else if(wiringPiMode == WPI_MODE_PINS)
-	{
-		for (pin = 0 ; pin < 8 ; ++pin)
-		{
-			
-			pinMode(pinToGpio [pin],OUTPUT);
-			digitalWrite (pin, value & mask) ;
-			mask <<= 1 ;
-		}
-
-	}
-	else if(wiringPiMode == WPI_MODE_PHYS)
-	{
-		for (pin = 0 ; pin < 8 ; ++pin)
-		{
-			
-			pinMode( physToGpio[pin],OUTPUT);
-			digitalWrite (pin, value & mask) ;
-			mask <<= 1 ;
-		}
-	}
-	#else
-	uint32_t pinSet = 0 ;
-	uint32_t pinClr = 0 ;
-	/**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
-	{
-		for (pin = 0 ; pin < 8 ; ++pin)
-		{
-			digitalWrite (pinToGpio [pin], value & mask) ;
-			mask <<= 1 ;
-		}
-		return ;
-	}
-	else
+	if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
 	{
-		for (pin = 0 ; pin < 8 ; ++pin)
-		{
-			if ((value & mask) == 0)
-				pinClr |= (1 << pinToGpio [pin]) ;
-			else
-				pinSet |= (1 << pinToGpio [pin]) ;
-			mask <<= 1 ;
-		}
-		*(gpio + gpioToGPCLR [0]) = pinClr ;
-		*(gpio + gpioToGPSET [0]) = pinSet ;
+		#ifdef TINKER_BOARD
+		asus_digitalWriteBank (bank, setMask, clrMask) ;
+		#else
+		if ((bank < 0) || (bank > 1))
+			return ;
+		*(gpio + gpioToGPCLR [bank * 32]) = clrMask & ~setMask ;
+		*(gpio + gpioToGPSET [bank * 32]) = setMask ;
+		#endif
 	}
-	#endif
 }
 
 
 /*
- * waitForInterrupt:
- *	Pi Specific.
- *	Wait for Interrupt on a GPIO pin.
- *	This is actually done via the /sys/class/gpio interface regardless of
- *	the wiringPi access mode in-use. Maybe sometime it might get a better
- *	way for a bit more efficiency.
+ * edgeLatchSetup: edgeLatchRead: edgeLatchAck:
+ *	Tinker Specific.
+ *	Have the GPIO controller catch edges on a pin by itself: mode is
+ *	INT_EDGE_RISING or INT_EDGE_FALLING (the controller can't do both),
+ *	or INT_EDGE_SETUP to stop. The interrupt stays masked, so nothing
+ *	goes to the kernel; instead edgeLatchRead gives the latched edges of
+ *	a whole bank (bits as digitalWriteBank) with one register load, and
+ *	edgeLatchAck clears the ones it's been given. A pulse shorter than
+ *	the polling interval is still seen.
  *********************************************************************************
  */
 
-int waitForInterrupt (int pin, int mS)
+int edgeLatchSetup (int pin, int mode)
 {
-	int fd, x ;
-	uint8_t c ;
-	struct pollfd polls ;
+	#ifdef TINKER_BOARD
+	int edge ;
 
 	/**/ if (wiringPiMode == WPI_MODE_PINS)
-		pin = pinToGpio [pin] ;
+		pin = pinToGpio [pin & 63] ;
 	else if (wiringPiMode == WPI_MODE_PHYS)
-		pin = physToGpio [pin] ;
+		pin = physToGpio [pin & 63] ;
+	else if (wiringPiMode != WPI_MODE_GPIO)
+		return wiringPiFailure (WPI_ALMOST, "edgeLatchSetup: needs the GPIO registers\n") ;
+
+	/**/ if (mode == INT_EDGE_RISING)
+		edge = ASUS_LATCH_RISING ;
+	else if (mode == INT_EDGE_FALLING)
+		edge = ASUS_LATCH_FALLING ;
+	else if (mode == INT_EDGE_SETUP)
+		edge = ASUS_LATCH_OFF ;
+	else
+		return wiringPiFailure (WPI_ALMOST, "edgeLatchSetup: one edge only (mode %d)\n", mode) ;
 
-	if ((fd = sysFds [pin]) == -1)
-		return -2 ;
+	return asus_edge_latch (pin, edge) ;
+	#else
+	return wiringPiFailure (WPI_ALMOST, "edgeLatchSetup: not on this board\n") ;
+	#endif
+}
 
-	// Setup poll structure
+unsigned int edgeLatchRead (int bank)
+{
+	#ifdef TINKER_BOARD
+	if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+		return asus_edge_latch_read (bank) ;
+	#endif
+	return 0 ;
+}
 
-	polls.fd     = fd ;
-	polls.events = POLLPRI ;	// Urgent data!
+void edgeLatchAck (int bank, unsigned int mask)
+{
+	#ifdef TINKER_BOARD
+	if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+		asus_edge_latch_ack (bank, mask) ;
+	#endif
+}
 
-	// Wait for it ...
 
-	x = poll (&polls, 1, mS) ;
+/*
+ * setGpioDebounce:
+ *	Tinker Specific.
+ *	Turn the GPIO controller's debounce of an input on or off.
+ *********************************************************************************
+ */
 
-	// Do a dummy read to clear the interrupt
+void setGpioDebounce (int pin, int enable)
+{
+	#ifdef TINKER_BOARD
+	if ((pin & PI_GPIO_MASK) == 0)          // On-Board Pin
+	{
+		if (wiringPiMode == WPI_MODE_PINS)
+			pin = pinToGpio [pin] ;
+		else if (wiringPiMode == WPI_MODE_PHYS)
+			pin = physToGpio [pin] ;
+		else if (wiringPiMode != WPI_MODE_GPIO)
+			return ;
+		asus_set_debounce (pin, enable) ;
+	}
+	#endif
+}
+
+
+/*
+ * digitalWriteMask:
+ *	Set and clear any number of header pins at once. Bit n of the masks
+ *	is physical pin n in Phys mode and wiringPi pin n otherwise. The pins
+ *	are grouped by bank and each bank touched gets one update.
+ *********************************************************************************
+ */
+
+#ifdef TINKER_BOARD
+static void headerWrite (struct headerPin *map, uint64_t setMask, uint64_t clrMask)
+{
+	uint32_t bankSet [GPIO_BANK] = { 0 } ;
+	uint32_t bankClr [GPIO_BANK] = { 0 } ;
+	uint32_t touched = 0 ;
+	uint64_t bits ;
+	int pin, bank ;
+	for (bits = setMask | clrMask ; bits != 0 ; bits &= bits - 1)
+	{
+		pin = __builtin_ctzll (bits) ;
+		if ((bank = map [pin].bank) < 0)
+			continue ;
+		if (setMask & (1ULL << pin))
+			bankSet [bank] |= map [pin].mask ;
+		else
+			bankClr [bank] |= map [pin].mask ;
+		touched |= 1 << bank ;
+	}
+	for (bank = 0 ; touched != 0 ; ++bank, touched >>= 1)
+		if (touched & 1)
+			asus_digitalWriteBank (bank, bankSet [bank], bankClr [bank]) ;
+}
+#endif
+
+void digitalWriteMask (uint64_t setMask, uint64_t clrMask)
+{
+	int gpios [64] ;
+	uint64_t values = 0 ;
+	int pin, n = 0 ;
+	if (wiringPiMode == WPI_MODE_GPIO_DEV)
+	{
+		for (pin = 0 ; pin < 64 ; ++pin)
+			if (((setMask | clrMask) & (1ULL << pin)) && (pinToGpio [pin] != -1))
+			{
+				if (setMask & (1ULL << pin))
+					values |= 1ULL << n ;
+				gpios [n++] = pinToGpio [pin] ;
+			}
+		wpiChipWritePins (gpios, n, values) ;
+		return ;
+	}
+	#ifdef TINKER_BOARD
+	if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_GPIO))
+	{
+		headerWrite (wpiHeader, setMask, clrMask) ;
+		return ;
+	}
+	else if (wiringPiMode == WPI_MODE_PHYS)
+	{
+		headerWrite (physHeader, setMask, clrMask) ;
+		return ;
+	}
+	#endif
+	for (pin = 0 ; pin < 64 ; ++pin)
+	{
+		if (setMask & (1ULL << pin))
+			digitalWrite (pin, HIGH) ;
+		else if (clrMask & (1ULL << pin))
+			digitalWrite (pin, LOW) ;
+	}
+}
+
+
+/*
+ * digitalWriteByte:
+ *	Pi Specific
+ *	Write an 8-bit byte to the first 8 GPIO pins - try to do it as
+ *	fast as possible.
+ *	On the Tinker Board the pins are spread over banks 0, 5 and 6, each
+ *	of which is updated once, with the set and clear done together.
+ *	The pins must already be outputs.
+ *********************************************************************************
+ */
+
+void digitalWriteByte (int value)
+{
+	int mask = 1 ;
+	int pin ;
+	if (wiringPiMode == WPI_MODE_GPIO_DEV)
+	{
+		wpiChipWritePins (pinToGpio, 8, value & 0xFF) ;
+		return ;
+	}
+	#ifdef TINKER_BOARD
+	/**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+	{
+		for (pin = 0 ; pin < 8 ; ++pin)
+		{
+			digitalWrite (pinToGpio [pin], value & mask) ;
+			mask <<= 1 ;
+		}
+		return ;
+	}
+	else if (wiringPiMode != WPI_MODE_UNINITIALISED)
+		headerWrite (wpiHeader, value & 0xFF, ~value & 0xFF) ;
+	#else
+	uint32_t pinSet = 0 ;
+	uint32_t pinClr = 0 ;
+	/**/ if (wiringPiMode == WPI_MODE_GPIO_SYS)
+	{
+		for (pin = 0 ; pin < 8 ; ++pin)
+		{
+			digitalWrite (pinToGpio [pin], value & mask) ;
+			mask <<= 1 ;
+		}
+		return ;
+	}
+	else
+	{
+		for (pin = 0 ; pin < 8 ; ++pin)
+		{
+			if ((value & mask) == 0)
+				pinClr |= (1 << pinToGpio [pin]) ;
+			else
+				pinSet |= (1 << pinToGpio [pin]) ;
+			mask <<= 1 ;
+		}
+		*(gpio + gpioToGPCLR [0]) = pinClr ;
+		*(gpio + gpioToGPSET [0]) = pinSet ;
+	}
+	#endif
+}
+
+
+/*
+ * digitalReadAll:
+ *	Sample every header pin at (as near as we can) the same instant.
+ *	Each GPIO bank the header uses is loaded once and the bits scattered
+ *	out to wiringPi and physical pin order. The return value is in the
+ *	same numbering as digitalWriteMask (); levels, if not NULL, gets all
+ *	of the orderings.
+ *********************************************************************************
+ */
+
+static int gpioLevel (int bcmGpio)
+{
+	char c ;
+	if (bcmGpio == -1)
+		return LOW ;
+	if (wiringPiMode == WPI_MODE_GPIO_SYS)
+	{
+		if (sysFds [bcmGpio] == -1)
+			return LOW ;
+		lseek (sysFds [bcmGpio], 0L, SEEK_SET) ;
+		read  (sysFds [bcmGpio], &c, 1) ;
+		return (c == '0') ? LOW : HIGH ;
+	}
+	#ifdef TINKER_BOARD
+	return asus_digitalRead (bcmGpio) ;
+	#else
+	return (*(gpio + gpioToGPLEV [bcmGpio]) & (1 << (bcmGpio & 31))) ? HIGH : LOW ;
+	#endif
+}
+
+// GPIO device mode: every header gpio in one read per chip
+
+static void devReadAll (struct wpiPinLevels *l)
+{
+	int gpios [64] ;
+	uint64_t values ;
+	int pin, gpio, k, n = 0 ;
+	for (pin = 0 ; pin < 128 ; ++pin)
+	{
+		gpio = (pin < 64) ? pinToGpio [pin] : physToGpio [pin - 64] ;
+		if (gpio == -1)
+			continue ;
+		for (k = 0 ; (k < n) && (gpios [k] != gpio) ; ++k)
+			;
+		if ((k == n) && (n < 64))
+			gpios [n++] = gpio ;
+	}
+	if (wpiChipReadPins (gpios, n, &values) < 0)
+		return ;
+	for (pin = 0 ; pin < 64 ; ++pin)
+		for (k = 0 ; k < n ; ++k)
+			if (values & (1ULL << k))
+			{
+				if (pinToGpio [pin] == gpios [k])
+					l->wpi  |= 1ULL << pin ;
+				if (physToGpio [pin] == gpios [k])
+					l->phys |= 1ULL << pin ;
+			}
+	#ifdef TINKER_BOARD
+	for (k = 0 ; k < n ; ++k)
+		if (values & (1ULL << k))
+			l->gpio [gpioToBank (gpios [k])] |= 1 << gpioToBankPin (gpios [k]) ;
+	#endif
+}
+
+uint64_t digitalReadAll (struct wpiPinLevels *levels)
+{
+	struct wpiPinLevels l ;
+	int pin ;
+	memset (&l, 0, sizeof (l)) ;
+	if (wiringPiMode == WPI_MODE_UNINITIALISED)
+		goto done ;
+	if (wiringPiMode == WPI_MODE_GPIO_DEV)
+	{
+		devReadAll (&l) ;
+		goto done ;
+	}
+	#ifdef TINKER_BOARD
+	if (wiringPiMode != WPI_MODE_GPIO_SYS)
+	{
+		int bank ;
+		struct headerScatter *h ;
+		for (bank = 0 ; bank < GPIO_BANK ; ++bank)
+			if (headerBanks & (1 << bank))
+				l.gpio [bank] = asus_digitalReadBank (bank) ;
+		for (h = headerScatter ; h < &headerScatter [headerScatterCount] ; ++h)
+			if (l.gpio [h->bank] & h->mask)
+			{
+				l.wpi  |= h->wpiBit ;
+				l.phys |= h->physBit ;
+			}
+		goto done ;
+	}
+	#endif
+	for (pin = 0 ; pin < 64 ; ++pin)
+	{
+		if (gpioLevel (pinToGpio [pin]))
+			l.wpi  |= 1ULL << pin ;
+		if (gpioLevel (physToGpio [pin]))
+			l.phys |= 1ULL << pin ;
+	}
+	#ifdef TINKER_BOARD
+	for (pin = 0 ; pin <= GPIO8_B1 ; ++pin)
+		if (gpio_is_valid (pin) && gpioLevel (pin))
+			l.gpio [gpioToBank (pin)] |= 1 << gpioToBankPin (pin) ;
+	#endif
+done:
+	if (levels != NULL)
+		*levels = l ;
+	return (wiringPiMode == WPI_MODE_PHYS) ? l.phys : l.wpi ;
+}
+
+
+/*
+ * digitalReadByte:
+ *	Read the first 8 wiringPi pins - the counterpart of digitalWriteByte
+ *********************************************************************************
+ */
+
+unsigned int digitalReadByte (void)
+{
+	struct wpiPinLevels l ;
+	(void)digitalReadAll (&l) ;
+	return (unsigned int)(l.wpi & 0xFF) ;
+}
+
+
+/*
+ * digitalReadPins: digitalWritePins:
+ *	Read or write up to 64 on-board pins together; bit k of values is
+ *	pins [k]. In GPIO device mode this is one ioctl per GPIO chip, so
+ *	the pins on a chip are sampled, or change, at the same instant.
+ *	Otherwise it's a pin at a time.
+ *********************************************************************************
+ */
+
+int digitalReadPins (const int *pins, int n, uint64_t *values)
+{
+	int k, err ;
+	if ((n < 0) || (n > 64))
+		return wiringPiFailure (WPI_ALMOST, "digitalReadPins: n must be 0-64 (%d)\n", n) ;
+	if (wiringPiMode == WPI_MODE_GPIO_DEV)
+	{
+		if ((err = wpiChipReadPins (pins, n, values)) < 0)
+			return wiringPiFailure (WPI_ALMOST, "digitalReadPins: %s\n", strerror (-err)) ;
+		return 0 ;
+	}
+	*values = 0 ;
+	for (k = 0 ; k < n ; ++k)
+		if (digitalRead (pins [k]) == HIGH)
+			*values |= 1ULL << k ;
+	return 0 ;
+}
+
+int digitalWritePins (const int *pins, int n, uint64_t values)
+{
+	int k, err ;
+	if ((n < 0) || (n > 64))
+		return wiringPiFailure (WPI_ALMOST, "digitalWritePins: n must be 0-64 (%d)\n", n) ;
+	if (wiringPiMode == WPI_MODE_GPIO_DEV)
+	{
+		if ((err = wpiChipWritePins (pins, n, values)) < 0)
+			return wiringPiFailure (WPI_ALMOST, "digitalWritePins: %s\n", strerror (-err)) ;
+		return 0 ;
+	}
+	for (k = 0 ; k < n ; ++k)
+		digitalWrite (pins [k], (values & (1ULL << k)) ? HIGH : LOW) ;
+	return 0 ;
+}
+
+
+/*
+ * waitForInterrupt:
+ *	Pi Specific.
+ *	Wait for Interrupt on a GPIO pin.
+ *	This is actually done via the /sys/class/gpio interface regardless of
+ *	the wiringPi access mode in-use. Maybe sometime it might get a better
+ *	way for a bit more efficiency.
+ *	In GPIO device mode it's the pin's line request instead: the first
+ *	wait sets the pin up for both edges (unless wiringPiISR already
+ *	has), and edges on other pins of the same chip are discarded - or,
+ *	once wiringPiISR is running, it's the dispatcher's count of them.
+ *********************************************************************************
+ */
+
+static void isrDevInit (void)
+{
+	pthread_condattr_t attr ;
+
+	pthread_condattr_init     (&attr) ;
+	pthread_condattr_setclock (&attr, CLOCK_MONOTONIC) ;
+	pthread_cond_init         (&isrDevCond, &attr) ;
+	pthread_condattr_destroy  (&attr) ;
+}
+
+static int devWaitForCounts (const int *pins, int n, int mS, int *firedPins)
+{
+	struct timespec deadline ;
+	int err = 0, fired = 0, k ;
+
+	pthread_once (&isrDevOnce, isrDevInit) ;
+
+	clock_gettime (CLOCK_MONOTONIC, &deadline) ;
+	deadline.tv_sec  += mS / 1000 ;
+	deadline.tv_nsec += (mS % 1000) * 1000000 ;
+	if (deadline.tv_nsec >= 1000000000)
+	{
+		deadline.tv_nsec -= 1000000000 ;
+		++deadline.tv_sec ;
+	}
+
+	pthread_mutex_lock (&isrDevMutex) ;
+	for (;;)
+	{
+		for (k = 0 ; k < n ; ++k)
+			if (isrDevCount [pins [k]] != isrDevSeen [pins [k]])
+			{
+				isrDevSeen [pins [k]] = isrDevCount [pins [k]] ;
+				firedPins [fired++] = pins [k] ;
+			}
+		if ((fired != 0) || (err != 0))
+			break ;
+		if (mS < 0)
+			err = pthread_cond_wait (&isrDevCond, &isrDevMutex) ;
+		else
+			err = pthread_cond_timedwait (&isrDevCond, &isrDevMutex, &deadline) ;
+	}
+	pthread_mutex_unlock (&isrDevMutex) ;
+
+	return fired ;
+}
+
+static int devWaitForAny (const int *pins, int n, int mS, int *firedPins)
+{
+	struct wpiChipEvent events [ISR_EVENTS] ;
+	struct pollfd polls [64] ;
+	unsigned int deadline = millis () + mS ;
+	int nFds = 0, fired, got, i, j, k, x ;
+
+	for (k = 0 ; k < n ; ++k)
+	{
+		if ((pins [k] < 0) || (pins [k] > 257))
+			return -2 ;
+		if (!isrDevArmed [pins [k]] && !__atomic_load_n (&isrOwned [pins [k]], __ATOMIC_ACQUIRE))
+		{
+			if (wpiChipEdge (pins [k], INT_EDGE_BOTH) < 0)
+				return -2 ;
+			isrDevArmed [pins [k]] = TRUE ;
+		}
+	}
+	if (isrDevSet >= 0)
+		return devWaitForCounts (pins, n, mS, firedPins) ;
+
+	// One fd per chip, however many of its pins we're waiting for
+
+	for (k = 0 ; k < n ; ++k)
+		if ((polls [nFds].fd = wpiChipEventFd (pins [k])) < 0)
+			return -2 ;
+		else
+		{
+			for (i = 0 ; polls [i].fd != polls [nFds].fd ; ++i)
+				;
+			if (i == nFds)
+				polls [nFds++].events = POLLIN ;
+		}
+
+	for (;;)
+	{
+		if ((x = poll (polls, nFds, mS)) <= 0)
+			return x ;
+		fired = 0 ;
+		for (i = 0 ; i < nFds ; ++i)
+		{
+			if ((polls [i].revents & POLLIN) == 0)
+				continue ;
+			if ((got = wpiChipReadEvents (polls [i].fd, events, ISR_EVENTS)) < 0)
+				return -1 ;
+			for (j = 0 ; j < got ; ++j)
+				for (k = 0 ; k < n ; ++k)
+					if (events [j].gpio == pins [k])
+					{
+						isrTimes [pins [k]] = events [j].timestamp ;
+						for (x = 0 ; (x < fired) && (firedPins [x] != pins [k]) ; ++x)
+							;
+						if (x == fired)
+							firedPins [fired++] = pins [k] ;
+					}
+		}
+		if (fired != 0)
+			return fired ;
+		if ((mS >= 0) && ((mS = (int)(deadline - millis ())) <= 0))
+			return 0 ;
+	}
+}
+
+static int devWaitForInterrupt (int pin, int mS)
+{
+	int fired ;
+
+	return devWaitForAny (&pin, 1, mS, &fired) ;
+}
+
+int waitForInterrupt (int pin, int mS)
+{
+	int fd, x ;
+	uint8_t c ;
+	struct pollfd polls ;
+
+	if (wiringPiMode == WPI_MODE_GPIO_DEV)
+		return devWaitForInterrupt (pin, mS) ;
+
+	/**/ if (wiringPiMode == WPI_MODE_PINS)
+		pin = pinToGpio [pin] ;
+	else if (wiringPiMode == WPI_MODE_PHYS)
+		pin = physToGpio [pin] ;
+
+	if ((fd = sysFds [pin]) == -1)
+		return -2 ;
+
+	// Setup poll structure
+
+	polls.fd     = fd ;
+	polls.events = POLLPRI ;	// Urgent data!
+
+	// Wait for it ...
+
+	x = poll (&polls, 1, mS) ;
+
+	// Do a dummy read to clear the interrupt
 	//	A one character read appars to be enough.
 	//	Followed by a seek to reset it.
 
@@ -1858,157 +2706,1056 @@ int waitForInterrupt (int pin, int mS)
 
 
 /*
- * interruptHandler:
- *	This is a thread and gets started to wait for the interrupt we're
- *	hoping to catch. It will call the user-function when the interrupt
- *	fires.
+ * waitForInterruptAny:
+ *	Wait for an interrupt on any of n pins (up to 64) with the one poll,
+ *	in place of a thread per pin. Every pin that fired is put in
+ *	firedPins, which needs room for n, and its interrupt cleared; the
+ *	others are left pending for next time.
+ *	Returns how many fired, 0 on a timeout, or as waitForInterrupt.
+ *********************************************************************************
+ */
+
+int waitForInterruptAny (const int *pins, int n, int mS, int *firedPins)
+{
+	struct pollfd polls [64] ;
+	int gpio, fired, k, x ;
+	uint8_t c ;
+
+	if ((n < 1) || (n > 64))
+		return wiringPiFailure (WPI_ALMOST, "waitForInterruptAny: n must be 1-64 (%d)\n", n) ;
+
+	if (wiringPiMode == WPI_MODE_GPIO_DEV)
+		return devWaitForAny (pins, n, mS, firedPins) ;
+
+	for (k = 0 ; k < n ; ++k)
+	{
+		/**/ if (wiringPiMode == WPI_MODE_PINS)
+			gpio = pinToGpio [pins [k] & 63] ;
+		else if (wiringPiMode == WPI_MODE_PHYS)
+			gpio = physToGpio [pins [k] & 63] ;
+		else
+			gpio = pins [k] ;
+
+		if ((gpio < 0) || (gpio > 257) || (sysFds [gpio] == -1))
+			return -2 ;
+		polls [k].fd     = sysFds [gpio] ;
+		polls [k].events = POLLPRI ;
+	}
+
+	if ((x = poll (polls, n, mS)) <= 0)
+		return x ;
+
+	// Clear just the ones that fired
+
+	fired = 0 ;
+	for (k = 0 ; k < n ; ++k)
+		if (polls [k].revents & (POLLPRI | POLLERR))
+		{
+			(void)read (polls [k].fd, &c, 1) ;
+			lseek (polls [k].fd, 0, SEEK_SET) ;
+			firedPins [fired++] = pins [k] ;
+		}
+
+	return fired ;
+}
+
+
+/*
+ * interruptHandler:
+ *	This is a thread and gets started to wait for the interrupts we're
+ *	hoping to catch. It will call the user-function for each pin whose
+ *	interrupt fires.
+ *********************************************************************************
+ */
+
+// isrCall:
+//	Everything that's listening to a pin. A level of -1 means it
+//	couldn't be read: only the plain function can be called.
+
+static void isrCall (int pin, int level)
+{
+	void (*function)(void) ;
+	void (*functionEx)(int pin, int level, uint64_t timestamp, void *userData) ;
+
+	if ((function = __atomic_load_n (&isrFunctions [pin], __ATOMIC_ACQUIRE)) != NULL)
+		function () ;
+	if (level < 0)			// Couldn't read it
+		return ;
+	if ((functionEx = __atomic_load_n (&isrFunctionsEx [pin], __ATOMIC_ACQUIRE)) != NULL)
+		functionEx (pin, level, isrTimes [pin], isrUserData [pin]) ;
+}
+
+static int isrListening (int pin)
+{
+	return (__atomic_load_n (&isrFunctions   [pin], __ATOMIC_ACQUIRE) != NULL) ||
+	       (__atomic_load_n (&isrFunctionsEx [pin], __ATOMIC_ACQUIRE) != NULL) ;
+}
+
+static int isrEdge (int pin, int level)
+{
+	if ((isrModes [pin] == INT_EDGE_RISING) || (isrModes [pin] == INT_EDGE_FALLING))
+		return isrModes [pin] ;
+	return (level == HIGH) ? INT_EDGE_RISING : INT_EDGE_FALLING ;
+}
+
+static void isrRingPut (struct wpiEventRing *ring, int pin, int edge, int level, uint64_t timestamp)
+{
+	struct wpiEdgeEvent *e ;
+	unsigned int head = ring->head ;
+	unsigned int tail = __atomic_load_n (&ring->tail, __ATOMIC_SEQ_CST) ;
+	uint64_t one = 1 ;
+
+	if (head - tail == ring->size)
+	{
+		__atomic_add_fetch (&ring->overflow, 1, __ATOMIC_RELAXED) ;
+		return ;
+	}
+
+	e = &ring->events [head & (ring->size - 1)] ;
+	e->pin       = pin ;
+	e->edge      = edge ;
+	e->level     = level ;
+	e->timestamp = timestamp ;
+	__atomic_store_n (&ring->head, head + 1, __ATOMIC_SEQ_CST) ;
+
+	// Only an empty ring needs a kick. The seq_cst pairs with the
+	//	reader's, so either we see its tail or it sees our head.
+
+	if (head == tail)
+		(void)write (ring->fd, &one, sizeof (one)) ;
+}
+
+// A chip's line request: every edge, with its kernel timestamp
+
+static void isrChipEvents (int fd)
+{
+	struct wpiChipEvent events [ISR_EVENTS] ;
+	struct wpiEventRing *ring ;
+	int n, i, pin ;
+
+	if ((n = wpiChipReadEvents (fd, events, ISR_EVENTS)) <= 0)
+		return ;
+
+	for (i = 0 ; i < n ; ++i)
+	{
+		if ((pin = events [i].gpio) > 257)
+			continue ;
+		isrTimes [pin] = events [i].timestamp ;
+		if ((ring = __atomic_load_n (&isrRings [pin], __ATOMIC_SEQ_CST)) != NULL)
+		{
+			if ((isrSeqs [pin] != 0) && (events [i].seqno > isrSeqs [pin] + 1))
+				__atomic_add_fetch (&ring->overflow, events [i].seqno - isrSeqs [pin] - 1, __ATOMIC_RELAXED) ;
+			isrRingPut (ring, pin, (events [i].level == HIGH) ? INT_EDGE_RISING : INT_EDGE_FALLING,
+				events [i].level, events [i].timestamp) ;
+		}
+		isrSeqs [pin] = events [i].seqno ;
+		if (isrListening (pin))
+			isrCall (pin, events [i].level) ;
+		else
+		{
+			pthread_mutex_lock (&isrDevMutex) ;
+			++isrDevCount [pin] ;
+			pthread_cond_broadcast (&isrDevCond) ;
+			pthread_mutex_unlock (&isrDevMutex) ;
+		}
+	}
+}
+
+// isrPassDone:
+//	The end of a batch: close what was removed during it and let
+//	isrQuiesce know.
+
+static void isrPassDone (int set)
+{
+	while (isrLateCount [set] > 0)
+		close (isrLateFds [set][--isrLateCount [set]]) ;
+
+	__atomic_add_fetch (&isrPasses [set], 1, __ATOMIC_SEQ_CST) ;
+	if (__atomic_load_n (&isrWaiters [set], __ATOMIC_SEQ_CST) != 0)
+	{
+		pthread_mutex_lock     (&isrPassMutex) ;
+		pthread_cond_broadcast (&isrPassCond) ;
+		pthread_mutex_unlock   (&isrPassMutex) ;
+	}
+}
+
+struct isrThreadArg
+{
+	int          set ;
+	unsigned int gen ;
+	int          stopFd ;		// This thread's own
+} ;
+
+static void *interruptHandler (void *arg)
+{
+	struct isrThreadArg me = *(struct isrThreadArg *)arg ;
+	struct epoll_event events [ISR_EVENTS] ;
+	struct wpiEventRing *ring ;
+	int set          = me.set ;
+	unsigned int gen = me.gen ;
+	int epfd         = isrEpollFds [set] ;
+	int n, i, fd, level, stop = FALSE ;
+	unsigned int pin ;
+	uint64_t kicks ;
+	uint8_t c ;
+
+	free (arg) ;
+
+	while (!stop)
+	{
+		n = epoll_wait (epfd, events, ISR_EVENTS, -1) ;
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue ;
+			break ;
+		}
+
+		for (i = 0 ; i < n ; ++i)
+		{
+			fd  = events [i].data.u64 >> 32 ;
+			pin = events [i].data.u64 & 0xFFFFFFFF ;
+
+			if (pin == ISR_CHIP)
+			{
+				isrChipEvents (fd) ;
+				continue ;
+			}
+			if (pin == ISR_STOP)	// See isrStop and isrQuiesce
+			{
+				(void)read (fd, &kicks, sizeof (kicks)) ;	// Non-blocking
+				if ((int)(__atomic_load_n (&isrStopGen [set], __ATOMIC_SEQ_CST) - gen) >= 0)
+					stop = TRUE ;
+				continue ;
+			}
+
+			// Clear the interrupt, as in waitForInterrupt - from the
+			//	start of the file: setup leaves the offset at the end.
+			//	Without the level there's no edge to record either,
+			//	but the plain function still gets its call.
+
+			isrTimes [pin] = monoNanos () ;
+			if (pread (fd, &c, 1, 0) != 1)
+			{
+				isrCall (pin, -1) ;
+				continue ;
+			}
+			level = (c == '1') ? HIGH : LOW ;
+			if ((ring = __atomic_load_n (&isrRings [pin], __ATOMIC_SEQ_CST)) != NULL)
+				isrRingPut (ring, pin, isrEdge (pin, level), level, isrTimes [pin]) ;
+			isrCall (pin, level) ;
+		}
+		isrPassDone (set) ;
+	}
+
+	// Nobody kicks a stopped thread's eventfd (isrStop and isrQuiesce
+	//	look under isrPassMutex), so once it's marked stopped it can go
+
+	close (epfd) ;
+	pthread_mutex_lock (&isrPassMutex) ;
+	if ((int)(__atomic_load_n (&isrStopGen [set], __ATOMIC_SEQ_CST) - gen) < 0)	// epoll failed
+		__atomic_store_n (&isrStopGen [set], gen, __ATOMIC_SEQ_CST) ;
+	close (me.stopFd) ;
+	pthread_mutex_unlock (&isrPassMutex) ;
+	isrPassDone (set) ;
+
+	return NULL ;
+}
+
+
+/*
+ * isrDispatcher: isrStart:
+ *	Return the epoll set for the next pin, round robin over the
+ *	dispatcher threads, starting its thread if needed - or start a
+ *	given one.
+ *	Called with pinMutex held.
+ *********************************************************************************
+ */
+
+static int isrStart (int t)
+{
+	struct isrThreadArg *arg ;
+	struct epoll_event ev ;
+	cpu_set_t cpus ;
+	int err ;
+
+	if (isrEpollFds [t] != -1)
+		return t ;
+
+	if ((isrEpollFds [t] = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: epoll_create failed: %s\n", strerror (errno)) ;
+
+	// Each thread has its own stop/wake eventfd, which it closes as it
+	//	ends: a thread on its way out of the set never shares one with
+	//	the thread that's replacing it
+
+	isrStopFds [t] = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK) ;
+	ev.events   = EPOLLIN ;
+	ev.data.u64 = ((uint64_t)isrStopFds [t] << 32) | ISR_STOP ;
+	if ((isrStopFds [t] < 0) || (epoll_ctl (isrEpollFds [t], EPOLL_CTL_ADD, isrStopFds [t], &ev) < 0))
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to set up the dispatcher: %s\n", strerror (errno)) ;
+	if ((arg = malloc (sizeof (*arg))) == NULL)
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: Out of memory\n") ;
+
+	arg->set    = t ;
+	arg->gen    = ++isrGens [t] ;
+	arg->stopFd = isrStopFds [t] ;
+	err = wpiThreadCreate (&isrThreadIds [t], WPI_THREAD_ISR, interruptHandler, arg) ;
+	if (err != 0)
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to start the dispatcher: %s\n", strerror (err)) ;
+
+	if (isrFirstCpu >= 0)		// Overrides the class's affinity
+	{
+		CPU_ZERO (&cpus) ;
+		CPU_SET ((isrFirstCpu + t) % sysconf (_SC_NPROCESSORS_CONF), &cpus) ;
+		pthread_setaffinity_np (isrThreadIds [t], sizeof (cpus), &cpus) ;
+	}
+
+	return t ;
+}
+
+static int isrDispatcher (void)
+{
+	return isrStart (isrNext++ % isrThreads) ;
+}
+
+
+/*
+ * isrStop: isrQuiesce: isrClose:
+ *	Stop a dispatcher with no pins left, or wait for it to finish the
+ *	batch of interrupts it's on (so a removed pin's function isn't
+ *	still running). Both kick its stop/wake eventfd, so an idle one
+ *	finishes a pass straight away: the eventfd of the thread that was
+ *	running when the caller looked (under pinMutex), and only while
+ *	that thread isn't stopped, as it closes it on the way out.
+ *	Neither waits when called from the dispatcher itself, i.e. from
+ *	an ISR; its thread then exits after the batch. An fd taken off a dispatcher is only closed once it's
+ *	done with it - at the end of its batch, if called from an ISR.
+ *	Called without pinMutex - an ISR might be waiting for it.
+ *********************************************************************************
+ */
+
+static void isrStop (int t, unsigned int gen, int stopFd, pthread_t threadId)
+{
+	uint64_t one = 1 ;
+
+	pthread_mutex_lock   (&isrPassMutex) ;
+	__atomic_store_n     (&isrStopGen [t], gen, __ATOMIC_SEQ_CST) ;
+	(void)write          (stopFd, &one, sizeof (one)) ;
+	pthread_mutex_unlock (&isrPassMutex) ;
+	if (pthread_equal (pthread_self (), threadId))
+		pthread_detach (threadId) ;
+	else
+		pthread_join (threadId, NULL) ;
+}
+
+static void isrQuiesce (int t, unsigned int gen, int stopFd)
+{
+	unsigned int pass ;
+	uint64_t one = 1 ;
+
+	if (pthread_equal (pthread_self (), isrThreadIds [t]))
+		return ;
+
+	pthread_mutex_lock (&isrPassMutex) ;
+	__atomic_add_fetch (&isrWaiters [t], 1, __ATOMIC_SEQ_CST) ;
+	pass = __atomic_load_n (&isrPasses [t], __ATOMIC_SEQ_CST) ;
+	if ((int)(__atomic_load_n (&isrStopGen [t], __ATOMIC_SEQ_CST) - gen) < 0)
+		(void)write (stopFd, &one, sizeof (one)) ;
+	while ((__atomic_load_n (&isrPasses [t], __ATOMIC_SEQ_CST) == pass) &&	// Or it's stopped since
+	       ((int)(__atomic_load_n (&isrStopGen [t], __ATOMIC_SEQ_CST) - gen) < 0))
+		pthread_cond_wait (&isrPassCond, &isrPassMutex) ;
+	__atomic_sub_fetch (&isrWaiters [t], 1, __ATOMIC_SEQ_CST) ;
+	pthread_mutex_unlock (&isrPassMutex) ;
+}
+
+static void isrClose (int t, int fd)
+{
+	if (pthread_equal (pthread_self (), isrThreadIds [t]))
+		isrLateFds [t][isrLateCount [t]++] = fd ;
+	else
+		close (fd) ;
+}
+
+
+/*
+ * wiringPiISRThreads:
+ *	Spread the wiringPiISR pins over this many dispatcher threads
+ *	instead of the one, pinned to CPUs firstCpu, firstCpu + 1, ...
+ *	(-1 to leave them to the WPI_THREAD_ISR affinity). Must be called
+ *	before the first wiringPiISR.
+ *********************************************************************************
+ */
+
+int wiringPiISRThreads (int threads, int firstCpu)
+{
+	if ((threads < 1) || (threads > ISR_MAX_THREADS))
+		return wiringPiFailure (WPI_ALMOST, "wiringPiISRThreads: threads must be 1-%d (%d)\n", ISR_MAX_THREADS, threads) ;
+
+	pthread_mutex_lock (&pinMutex) ;
+	if (isrNext != 0)
+	{
+		pthread_mutex_unlock (&pinMutex) ;
+		return wiringPiFailure (WPI_ALMOST, "wiringPiISRThreads: interrupts already being dispatched\n") ;
+	}
+	isrThreads  = threads ;
+	isrFirstCpu = firstCpu ;
+	pthread_mutex_unlock (&pinMutex) ;
+
+	return 0 ;
+}
+
+
+/*
+ * sysfsWrite: sysfsEdge:
+ *	Set a pin up for interrupts through /sys/class/gpio ourselves -
+ *	export it, make it an input and set the edge - the same as the
+ *	"gpio edge" command does, without starting a process for it.
+ *	They return 0 or -errno.
+ *********************************************************************************
+ */
+
+#define	SYSFS_RETRIES	100		// 1mS each
+
+static int sysfsWrite (const char *fName, const char *value, int retries)
+{
+	int fd, len, err ;
+
+	// The files of a pin that has only just been exported can take
+	//	udev a moment to appear and get their group permissions
+
+	while ((fd = open (fName, O_WRONLY)) < 0)
+	{
+		if (((errno != EACCES) && (errno != ENOENT)) || (retries-- <= 0))
+			return -errno ;
+		delay (1) ;
+	}
+
+	len = strlen (value) ;
+	err = (write (fd, value, len) == len) ? 0 : -errno ;
+	close (fd) ;
+	return err ;
+}
+
+static int sysfsEdge (int pin, const char *mode)
+{
+	char fName [64] ;
+	char value  [16] ;
+	int  err ;
+
+	sprintf (fName, "/sys/class/gpio/gpio%d", pin) ;
+	if (access (fName, F_OK) != 0)
+	{
+		sprintf (value, "%d\n", pin) ;
+		err = sysfsWrite ("/sys/class/gpio/export", value, 0) ;
+		if ((err < 0) && (err != -EBUSY))	// Busy: already exported
+			return err ;
+	}
+
+	sprintf (fName, "/sys/class/gpio/gpio%d/direction", pin) ;
+	if ((err = sysfsWrite (fName, "in\n", SYSFS_RETRIES)) < 0)
+		return err ;
+
+	sprintf (fName, "/sys/class/gpio/gpio%d/edge", pin) ;
+	sprintf (value, "%s\n", mode) ;
+	return sysfsWrite (fName, value, SYSFS_RETRIES) ;
+}
+
+
+/*
+ * gpioProgEdge:
+ *	The fallback: have the gpio program export the pin and set the
+ *	edge. It assumes a full installation of wiringPi, but works for
+ *	a normal user as the program is setuid root.
+ *********************************************************************************
+ */
+
+static int gpioProgEdge (int pin, const char *modeS)
+{
+	char  pinS [8] ;
+	pid_t pid ;
+
+	sprintf (pinS, "%d", pin) ;
+
+	if ((pid = fork ()) < 0)	// Fail
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: fork failed: %s\n", strerror (errno)) ;
+
+	if (pid == 0)	// Child, exec
+	{
+		/**/ if (access ("/usr/local/bin/gpio", X_OK) == 0)
+		{
+			execl ("/usr/local/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
+			return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
+		}
+		else if (access ("/usr/bin/gpio", X_OK) == 0)
+		{
+			execl ("/usr/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
+			return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
+		}
+#ifdef ANDROID
+		else if (access ("/system/bin/gpio", X_OK) == 0) //Android
+		{
+			execl ("/system/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
+				return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
+		}
+#endif			  
+		else
+			return wiringPiFailure (WPI_FATAL, "wiringPiISR: Can't find gpio program\n") ;
+	}
+	else		// Parent, wait
+		wait (NULL) ;
+
+	return 0 ;
+}
+
+
+/*
+ * isrSetHandlers:
+ *	What a pin's interrupts go to. The dispatcher may be reading these
+ *	as they change, so the user data goes in before its function.
+ *********************************************************************************
+ */
+
+static void isrSetHandlers (int pin, int mode, void (*function)(void),
+	void (*functionEx)(int pin, int level, uint64_t timestamp, void *userData), void *userData,
+	struct wpiEventRing *ring)
+{
+	__atomic_store_n (&isrFunctionsEx [pin], NULL, __ATOMIC_RELEASE) ;
+	isrFunctions [pin] = function ;
+	isrModes     [pin] = mode ;
+	isrUserData  [pin] = userData ;
+	__atomic_store_n (&isrFunctionsEx [pin], functionEx, __ATOMIC_RELEASE) ;
+	__atomic_store_n (&isrRings [pin], ring, __ATOMIC_SEQ_CST) ;
+
+	// Whichever way it's going, the ISR code has just set the edges
+
+	isrDevArmed [pin] = FALSE ;
+	__atomic_store_n (&isrOwned [pin], (function != NULL) || (functionEx != NULL) || (ring != NULL), __ATOMIC_RELEASE) ;
+}
+
+
+/*
+ * devISR: isrChipNotify: isrChipDrop:
+ *	wiringPiISR in GPIO device mode: set the edge on the pin's line and
+ *	make sure its chip's request is in the dispatcher's set. Adding
+ *	another line to the chip re-requests it: isrChipDrop takes the old
+ *	fd out of the set and isrChipNotify adds the new one. The two can't
+ *	wait for the dispatcher - they're called with the chip lock held,
+ *	which an ISR may be waiting for - but wiringChip keeps the fd number
+ *	safe to read until then.
+ *********************************************************************************
+ */
+
+static void isrChipNotify (int fd)
+{
+	struct epoll_event ev ;
+
+	if (isrDevSet < 0)
+		return ;
+	ev.events   = EPOLLIN ;
+	ev.data.u64 = ((uint64_t)fd << 32) | ISR_CHIP ;
+	epoll_ctl (isrEpollFds [isrDevSet], EPOLL_CTL_ADD, fd, &ev) ;
+}
+
+static void isrChipDrop (int fd)
+{
+	if (isrDevSet < 0)
+		return ;
+	epoll_ctl (isrEpollFds [isrDevSet], EPOLL_CTL_DEL, fd, NULL) ;
+}
+
+static int devISR (int pin, int mode, void (*function)(void),
+	void (*functionEx)(int pin, int level, uint64_t timestamp, void *userData), void *userData,
+	struct wpiEventRing *ring)
+{
+	struct epoll_event ev ;
+	int fd, t, err ;
+
+	if (mode == INT_EDGE_SETUP)	// Nothing outside can set it up for us
+		mode = INT_EDGE_BOTH ;
+	if ((err = wpiChipEdge (pin, mode)) < 0)
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to set up GPIO %d: %s\n", pin, strerror (-err)) ;
+
+	isrSeqs [pin] = 0 ;
+	isrSetHandlers (pin, mode, function, functionEx, userData, ring) ;
+
+	pthread_mutex_lock (&pinMutex) ;
+	if (isrDevSet < 0)
+	{
+		pthread_once (&isrDevOnce, isrDevInit) ;
+		if ((t = isrDispatcher ()) < 0)
+		{
+			pthread_mutex_unlock (&pinMutex) ;
+			return t ;
+		}
+		isrDevSet = t ;
+	}
+	if (ring != NULL)
+		ring->set = isrDevSet ;
+	if (isrEpollOf [pin] == 0)
+	{
+		isrEpollOf [pin] = isrDevSet + 1 ;
+		++isrSetPins [isrDevSet] ;
+	}
+	fd          = wpiChipEventFd (pin) ;
+	ev.events   = EPOLLIN ;
+	ev.data.u64 = ((uint64_t)fd << 32) | ISR_CHIP ;
+	if ((epoll_ctl (isrEpollFds [isrDevSet], EPOLL_CTL_ADD, fd, &ev) < 0) && (errno != EEXIST))
+	{
+		pthread_mutex_unlock (&pinMutex) ;
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: epoll_ctl failed: %s\n", strerror (errno)) ;
+	}
+	pthread_mutex_unlock (&pinMutex) ;
+
+	return 0 ;
+}
+
+
+/*
+ * wiringPiISR:
+ *	Pi Specific.
+ *	Take the details and create an interrupt handler that will do a call-
+ *	back to the user supplied function.
+ *	isrSetup does the work for it and for wpiEventRingAddPin: a pin
+ *	either calls a function or feeds a ring.
+ *********************************************************************************
+ */
+
+static int isrSetup (int pin, int mode, void (*function)(void),
+	void (*functionEx)(int pin, int level, uint64_t timestamp, void *userData), void *userData,
+	struct wpiEventRing *ring)
+{
+	struct epoll_event ev ;
+	const char *modeS ;
+	char fName   [64] ;
+	int   count, i, t, err ;
+	char  c ;
+	int   bcmGpioPin ;
+	#ifdef TINKER_BOARD
+	if ((((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS)) && ((pin < 0) || (pin > 63))) ||
+	    (((wiringPiMode == WPI_MODE_GPIO) || (wiringPiMode == WPI_MODE_GPIO_SYS) || (wiringPiMode == WPI_MODE_GPIO_DEV)) &&
+	     ((pin < 0) || (pin > 257))))
+	{
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: pin must be GPIO40Pin (%d)\n", pin) ;
+	} 
+	#else
+	if ((pin < 0) || (pin > 63))
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: pin must be 0-63 (%d)\n", pin) ;
+	#endif
+
+	/**/ if (wiringPiMode == WPI_MODE_UNINITIALISED)
+		return wiringPiFailure (WPI_FATAL, "wiringPiISR: wiringPi has not been initialised. Unable to continue.\n") ;
+	else if (wiringPiMode == WPI_MODE_PINS)
+		bcmGpioPin = pinToGpio [pin] ;
+	else if (wiringPiMode == WPI_MODE_PHYS)
+		bcmGpioPin = physToGpio [pin] ;
+	else if (wiringPiMode == WPI_MODE_GPIO_DEV)
+		return devISR (pin, mode, function, functionEx, userData, ring) ;
+	else
+		bcmGpioPin = pin ;
+
+	// Now export the pin and set the right edge
+	//	Done directly through /sys/class/gpio when we can. When we're
+	//	not allowed to - running as a normal user without the gpio
+	//	group - fall back to the gpio program, which is setuid root.
+
+	if (mode != INT_EDGE_SETUP)
+	{
+		/**/ if (mode == INT_EDGE_FALLING)
+			modeS = "falling" ;
+		else if (mode == INT_EDGE_RISING)
+			modeS = "rising" ;
+		else
+			modeS = "both" ;
+
+		if ((err = sysfsEdge (bcmGpioPin, modeS)) < 0)
+		{
+			if ((err != -EACCES) && (err != -EPERM))
+				return wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to set up GPIO %d: %s\n", bcmGpioPin, strerror (-err)) ;
+			if ((err = gpioProgEdge (bcmGpioPin, modeS)) < 0)
+				return err ;
+		}
+	}
+
+	// Now pre-open the /sys/class node - but it may already be open if
+	//	we are in Sys mode...
+
+	if (sysFds [bcmGpioPin] == -1)
+	{
+		sprintf (fName, "/sys/class/gpio/gpio%d/value", bcmGpioPin) ;
+		if ((sysFds [bcmGpioPin] = open (fName, O_RDWR)) < 0)
+			return wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to open %s: %s\n", fName, strerror (errno)) ;
+		isrOwnFd [bcmGpioPin] = TRUE ;
+	}
+
+	// Clear any initial pending interrupt
+
+	ioctl (sysFds [bcmGpioPin], FIONREAD, &count) ;
+	for (i = 0 ; i < count ; ++i)
+		read (sysFds [bcmGpioPin], &c, 1) ;
+
+	isrSetHandlers (pin, mode, function, functionEx, userData, ring) ;
+
+	// Hand it to a dispatcher - unless it already has one. A ring's pins
+	//	all go to the ring's dispatcher, so it has just the one writer.
+
+	pthread_mutex_lock (&pinMutex) ;
+	if ((ring != NULL) && (ring->set < 0))
+		ring->set = isrDispatcher () ;
+	/**/ if (ring != NULL)
+		t = isrStart (ring->set) ;
+	else if (isrEpollOf [pin] != 0)
+		t = isrEpollOf [pin] - 1 ;
+	else
+		t = isrDispatcher () ;
+	if (t < 0)
+	{
+		pthread_mutex_unlock (&pinMutex) ;
+		return t ;
+	}
+	if (isrEpollOf [pin] != t + 1)
+	{
+		if (isrEpollOf [pin] != 0)
+		{
+			epoll_ctl (isrEpollFds [isrEpollOf [pin] - 1], EPOLL_CTL_DEL, sysFds [bcmGpioPin], NULL) ;
+			--isrSetPins [isrEpollOf [pin] - 1] ;
+		}
+		ev.events   = EPOLLPRI | EPOLLERR ;
+		ev.data.u64 = ((uint64_t)sysFds [bcmGpioPin] << 32) | pin ;
+		if (epoll_ctl (isrEpollFds [t], EPOLL_CTL_ADD, sysFds [bcmGpioPin], &ev) < 0)
+		{
+			pthread_mutex_unlock (&pinMutex) ;
+			return wiringPiFailure (WPI_FATAL, "wiringPiISR: epoll_ctl failed: %s\n", strerror (errno)) ;
+		}
+		isrEpollOf [pin] = t + 1 ;
+		++isrSetPins [t] ;
+	}
+	pthread_mutex_unlock (&pinMutex) ;
+
+	return 0 ;
+}
+
+
+/*
+ * wiringPiISRTime:
+ *	When the last interrupt on a pin happened, CLOCK_MONOTONIC nS. In
+ *	GPIO device mode it's the kernel's timestamp of the edge, otherwise
+ *	the time the dispatcher picked it up. 0 if there hasn't been one.
+ *********************************************************************************
+ */
+
+uint64_t wiringPiISRTime (int pin)
+{
+	if ((pin < 0) || (pin > 257))
+		return 0 ;
+	return isrTimes [pin] ;
+}
+
+int wiringPiISR (int pin, int mode, void (*function)(void))
+{
+	return isrSetup (pin, mode, function, NULL, NULL, NULL) ;
+}
+
+
+/*
+ * wiringPiISRex:
+ *	As wiringPiISR, but the function is told which pin it was, its level
+ *	after the edge and when it happened (as wiringPiISRTime), and gets
+ *	userData back - so one function can serve many pins or devices.
+ *********************************************************************************
+ */
+
+int wiringPiISRex (int pin, int mode,
+	void (*function)(int pin, int level, uint64_t timestamp, void *userData), void *userData)
+{
+	return isrSetup (pin, mode, NULL, function, userData, NULL) ;
+}
+
+
+/*
+ * wiringPiISRRemove:
+ *	Undo wiringPiISR, wiringPiISRex or wpiEventRingAddPin: the pin stops
+ *	interrupting, and once this returns its function isn't running and
+ *	won't be called again (unless it's called from an ISR, where the
+ *	current batch of interrupts is still finished). A dispatcher thread
+ *	left with no pins is stopped.
+ *********************************************************************************
+ */
+
+int wiringPiISRRemove (int pin)
+{
+	char fName [64] ;
+	pthread_t threadId ;
+	unsigned int gen ;
+	int gpio, t, stopFd, stop = FALSE, closeFd = -1 ;
+
+	if ((pin < 0) || (pin > 257))
+		return wiringPiFailure (WPI_ALMOST, "wiringPiISRRemove: bad pin (%d)\n", pin) ;
+
+	/**/ if ((wiringPiMode == WPI_MODE_PINS) && (pin < 64))
+		gpio = pinToGpio [pin] ;
+	else if ((wiringPiMode == WPI_MODE_PHYS) && (pin < 64))
+		gpio = physToGpio [pin] ;
+	else
+		gpio = pin ;
+
+	pthread_mutex_lock (&pinMutex) ;
+
+	if ((t = isrEpollOf [pin] - 1) < 0)
+	{
+		pthread_mutex_unlock (&pinMutex) ;
+		return 0 ;
+	}
+
+	isrSetHandlers (pin, INT_EDGE_SETUP, NULL, NULL, NULL, NULL) ;
+	isrEpollOf [pin] = 0 ;
+
+	if (wiringPiMode == WPI_MODE_GPIO_DEV)
+		wpiChipEdge (gpio, INT_EDGE_SETUP) ;	// No edges: its events stop
+	else if ((gpio >= 0) && (sysFds [gpio] != -1))
+	{
+		epoll_ctl (isrEpollFds [t], EPOLL_CTL_DEL, sysFds [gpio], NULL) ;
+		sprintf (fName, "/sys/class/gpio/gpio%d/edge", gpio) ;
+		(void)sysfsWrite (fName, "none\n", 0) ;
+		if (isrOwnFd [gpio])		// Closed once the dispatcher's done with it
+		{
+			closeFd         = sysFds [gpio] ;
+			sysFds   [gpio] = -1 ;
+			isrOwnFd [gpio] = FALSE ;
+		}
+	}
+
+	// Last pin on its dispatcher: stop it
+
+	gen    = isrGens    [t] ;
+	stopFd = isrStopFds [t] ;
+	if (--isrSetPins [t] == 0)
+	{
+		stop     = TRUE ;
+		threadId = isrThreadIds [t] ;
+		isrEpollFds [t] = -1 ;
+		if (isrDevSet == t)
+			isrDevSet = -1 ;
+	}
+
+	pthread_mutex_unlock (&pinMutex) ;
+
+	if (stop)
+		isrStop (t, gen, stopFd, threadId) ;
+	else
+		isrQuiesce (t, gen, stopFd) ;
+	if (closeFd != -1)
+		isrClose (t, closeFd) ;
+
+	return 0 ;
+}
+
+
+/*
+ * wpiEventRingOpen:
+ *	Make a ring for the edges of one or more pins, each recorded as it's
+ *	dispatched: pin, edge, level and time - the kernel's timestamp in GPIO
+ *	device mode. size is rounded up to a power of 2. In sys mode a burst
+ *	of edges faster than the dispatcher can wake is still one event, in
+ *	GPIO device mode it's every edge the kernel saw.
+ *********************************************************************************
+ */
+
+struct wpiEventRing *wpiEventRingOpen (int size)
+{
+	struct wpiEventRing *ring ;
+	unsigned int n = 2 ;
+
+	while ((n < (unsigned int)size) && (n < 0x10000000))
+		n <<= 1 ;
+
+	if ((ring = calloc (1, sizeof (*ring) + n * sizeof (struct wpiEdgeEvent))) == NULL)
+	{
+		(void)wiringPiFailure (WPI_ALMOST, "wpiEventRingOpen: out of memory\n") ;
+		return NULL ;
+	}
+	if ((ring->fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+	{
+		free (ring) ;
+		(void)wiringPiFailure (WPI_ALMOST, "wpiEventRingOpen: eventfd failed: %s\n", strerror (errno)) ;
+		return NULL ;
+	}
+	ring->size = n ;
+	ring->set  = -1 ;
+	return ring ;
+}
+
+
+/*
+ * wpiEventRingAddPin:
+ *	Send a pin's edges to a ring, as wiringPiISR would to a function
+ *	(and in place of any function it had).
  *********************************************************************************
  */
 
-static void *interruptHandler (void *arg)
+int wpiEventRingAddPin (struct wpiEventRing *ring, int pin, int mode)
 {
-	int myPin ;
+	if (ring == NULL)
+		return wiringPiFailure (WPI_ALMOST, "wpiEventRingAddPin: no ring\n") ;
+	return isrSetup (pin, mode, NULL, NULL, NULL, ring) ;
+}
 
-	(void)piHiPri (55) ;	// Only effective if we run as root
 
-	myPin   = pinPass ;
-	pinPass = -1 ;
+/*
+ * wpiEventRingRead:
+ *	Take up to max events from a ring, oldest first, without waiting.
+ *	Returns how many.
+ *********************************************************************************
+ */
 
-	for (;;)
-		if (waitForInterrupt (myPin, -1) > 0)
-			isrFunctions [myPin] () ;
+int wpiEventRingRead (struct wpiEventRing *ring, struct wpiEdgeEvent *events, int max)
+{
+	unsigned int tail = ring->tail ;
+	unsigned int head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE) ;
+	int n = 0 ;
 
-	return NULL ;
+	while ((tail != head) && (n < max))
+		events [n++] = ring->events [tail++ & (ring->size - 1)] ;
+
+	__atomic_store_n (&ring->tail, tail, __ATOMIC_SEQ_CST) ;
+	return n ;
 }
 
 
 /*
- * wiringPiISR:
- *	Pi Specific.
- *	Take the details and create an interrupt handler that will do a call-
- *	back to the user supplied function.
+ * wpiEventRingWait:
+ *	Wait up to mS (-1 forever) for a ring to have something in it.
+ *	Returns 1 if it has, 0 on a timeout. wpiEventRingFd gives an fd
+ *	to poll instead, which is readable when the ring stops being empty.
  *********************************************************************************
  */
 
-int wiringPiISR (int pin, int mode, void (*function)(void))
+int wpiEventRingWait (struct wpiEventRing *ring, int mS)
 {
-	pthread_t threadId ;
-	const char *modeS ;
-	char fName   [64] ;
-	char  pinS [8] ;
-	pid_t pid ;
-	int   count, i ;
-	char  c ;
-	int   bcmGpioPin ;
-	#ifdef TINKER_BOARD
-	if ((((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS)) && ((pin < 0) || (pin > 63))) ||
-	    (((wiringPiMode == WPI_MODE_GPIO) || (wiringPiMode == WPI_MODE_GPIO_SYS)) && ((pin < 0) || (pin > 257))))
-	{
-		return wiringPiFailure (WPI_FATAL, "wiringPiISR: pin must be GPIO40Pin (%d)\n", pin) ;
-	} 
-	#else
-	if ((pin < 0) || (pin > 63))
-		return wiringPiFailure (WPI_FATAL, "wiringPiISR: pin must be 0-63 (%d)\n", pin) ;
-	#endif
-
-	/**/ if (wiringPiMode == WPI_MODE_UNINITIALISED)
-		return wiringPiFailure (WPI_FATAL, "wiringPiISR: wiringPi has not been initialised. Unable to continue.\n") ;
-	else if (wiringPiMode == WPI_MODE_PINS)
-		bcmGpioPin = pinToGpio [pin] ;
-	else if (wiringPiMode == WPI_MODE_PHYS)
-		bcmGpioPin = physToGpio [pin] ;
-	else
-		bcmGpioPin = pin ;
+	struct pollfd polls ;
+	unsigned int deadline = millis () + mS ;
+	uint64_t kicks ;
+	int x ;
 
-	// Now export the pin and set the right edge
-	//	We're going to use the gpio program to do this, so it assumes
-	//	a full installation of wiringPi. It's a bit 'clunky', but it
-	//	is a way that will work when we're running in "Sys" mode, as
-	//	a non-root user. (without sudo)
+	polls.fd     = ring->fd ;
+	polls.events = POLLIN ;
 
-	if (mode != INT_EDGE_SETUP)
+	for (;;)
 	{
-		/**/ if (mode == INT_EDGE_FALLING)
-			modeS = "falling" ;
-		else if (mode == INT_EDGE_RISING)
-			modeS = "rising" ;
-		else
-			modeS = "both" ;
+		(void)read (ring->fd, &kicks, sizeof (kicks)) ;
+		if (ring->tail != __atomic_load_n (&ring->head, __ATOMIC_SEQ_CST))
+			return 1 ;
+		if ((x = poll (&polls, 1, mS)) <= 0)
+			return x ;
+		if ((mS >= 0) && ((mS = (int)(deadline - millis ())) < 0))
+			mS = 0 ;
+	}
+}
 
-		sprintf (pinS, "%d", bcmGpioPin) ;
+int wpiEventRingFd (struct wpiEventRing *ring)
+{
+	return ring->fd ;
+}
 
-		if ((pid = fork ()) < 0)	// Fail
-			return wiringPiFailure (WPI_FATAL, "wiringPiISR: fork failed: %s\n", strerror (errno)) ;
 
-		if (pid == 0)	// Child, exec
-		{
-			/**/ if (access ("/usr/local/bin/gpio", X_OK) == 0)
-			{
-				execl ("/usr/local/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
-				return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
-			}
-			else if (access ("/usr/bin/gpio", X_OK) == 0)
-			{
-				execl ("/usr/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
-				return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
-			}
-#ifdef ANDROID
-			else if (access ("/system/bin/gpio", X_OK) == 0) //Android
-			{
-				execl ("/system/bin/gpio", "gpio", "edge", pinS, modeS, (char *)NULL) ;
-					return wiringPiFailure (WPI_FATAL, "wiringPiISR: execl failed: %s\n", strerror (errno)) ;
-			}
-#endif			  
-			else
-				return wiringPiFailure (WPI_FATAL, "wiringPiISR: Can't find gpio program\n") ;
-		}
-		else		// Parent, wait
-			wait (NULL) ;
-	}
+/*
+ * wpiEventRingOverflow:
+ *	How many edges have been lost so far: found the ring full, or
+ *	dropped by the kernel before we read them.
+ *********************************************************************************
+ */
 
-	// Now pre-open the /sys/class node - but it may already be open if
-	//	we are in Sys mode...
+unsigned int wpiEventRingOverflow (struct wpiEventRing *ring)
+{
+	return __atomic_load_n (&ring->overflow, __ATOMIC_RELAXED) ;
+}
 
-	if (sysFds [bcmGpioPin] == -1)
-	{
-		sprintf (fName, "/sys/class/gpio/gpio%d/value", bcmGpioPin) ;
-		if ((sysFds [bcmGpioPin] = open (fName, O_RDWR)) < 0)
-			return wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to open %s: %s\n", fName, strerror (errno)) ;
-	}
 
-	// Clear any initial pending interrupt
+/*
+ * wpiEventRingClose:
+ *	Stop sending edges to a ring and free it. The pins stay set up, with
+ *	nothing listening. If the dispatcher might be part way through
+ *	filling it, wait for it to finish.
+ *********************************************************************************
+ */
 
-	ioctl (sysFds [bcmGpioPin], FIONREAD, &count) ;
-	for (i = 0 ; i < count ; ++i)
-		read (sysFds [bcmGpioPin], &c, 1) ;
+void wpiEventRingClose (struct wpiEventRing *ring)
+{
+	unsigned int gen = 0 ;
+	int pin, running, stopFd = -1 ;
 
-	isrFunctions [pin] = function ;
+	if (ring == NULL)
+		return ;
 
 	pthread_mutex_lock (&pinMutex) ;
-	pinPass = pin ;
-	pthread_create (&threadId, NULL, interruptHandler, NULL) ;
-	while (pinPass != -1)
-		delay (1) ;
+	for (pin = 0 ; pin < 258 ; ++pin)
+		if (isrRings [pin] == ring)
+			__atomic_store_n (&isrRings [pin], NULL, __ATOMIC_SEQ_CST) ;
+	if ((running = ((ring->set >= 0) && (isrEpollFds [ring->set] != -1))))
+	{
+		gen    = isrGens    [ring->set] ;
+		stopFd = isrStopFds [ring->set] ;
+	}
 	pthread_mutex_unlock (&pinMutex) ;
 
-	return 0 ;
+	if (running)
+		isrQuiesce (ring->set, gen, stopFd) ;
+
+	close (ring->fd) ;
+	free (ring) ;
 }
 
 
 /*
- * initialiseEpoch:
- *	Initialise our start-of-time variable to be the current unix
- *	time in milliseconds and microseconds.
+ * initialiseEpoch: calibrateSleep: sleepMargin:
+ *	Initialise our start-of-time variable to be the current monotonic
+ *	time, and find how late nanosleep wakes us: the worst of a few short
+ *	sleeps, plus a margin, between 20 and 200uS. That's done once, by
+ *	the first delay to sleep; until then spinNanos is a fair guess.
  *********************************************************************************
  */
 
-static void initialiseEpoch (void)
+static void sleepUntil (uint64_t when)
+{
+  struct timespec ts ;
+
+  ts.tv_sec  = (time_t)(when / 1000000000ULL) ;
+  ts.tv_nsec = (long)(when % 1000000000ULL) ;
+  while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+}
+
+static void calibrateSleep (void)
+{
+  uint64_t start, late, worst = 0 ;
+  int i ;
+
+  for (i = 0 ; i < 8 ; ++i)
+  {
+    start = monoNanos () ;
+    sleepUntil (start + 100000) ;
+    if ((late = monoNanos () - start - 100000) > worst)
+      worst = late ;
+  }
+  worst += 10000 ;
+
+  /**/ if (worst <  20000)
+    spinNanos =  20000 ;
+  else if (worst > 200000)
+    spinNanos = 200000 ;
+  else
+    spinNanos = worst ;
+}
+
+static uint64_t sleepMargin (void)
 {
-  struct timeval tv ;
+  pthread_once (&spinOnce, calibrateSleep) ;
+  return spinNanos ;
+}
 
-  gettimeofday (&tv, NULL) ;
-  epochMilli = (uint64_t)tv.tv_sec * (uint64_t)1000    + (uint64_t)(tv.tv_usec / 1000) ;
-  epochMicro = (uint64_t)tv.tv_sec * (uint64_t)1000000 + (uint64_t)(tv.tv_usec) ;
+static void initialiseEpoch (void)
+{
+  epochNanos = monoNanos () ;
 }
 
 
@@ -2020,12 +3767,7 @@ static void initialiseEpoch (void)
 
 void delay (unsigned int howLong)
 {
-  struct timespec sleeper, dummy ;
-
-  sleeper.tv_sec  = (time_t)(howLong / 1000) ;
-  sleeper.tv_nsec = (long)(howLong % 1000) * 1000000 ;
-
-  nanosleep (&sleeper, &dummy) ;
+  sleepUntil (monoNanos () + (uint64_t)howLong * 1000000ULL) ;
 }
 
 
@@ -2036,85 +3778,191 @@ void delay (unsigned int howLong)
  *	obeying the standards (may take longer), it's not always what we
  *	want!
  *
- *	So what I'll do now is if the delay is less than 100uS we'll do it
- *	in a hard loop, watching a built-in counter on the ARM chip. This is
- *	somewhat sub-optimal in that it uses 100% CPU, something not an issue
- *	in a microcontroller, but under a multi-tasking, multi-user OS, it's
- *	wastefull, however we've no real choice )-:
- *
- *      Plan B: It seems all might not be well with that plan, so changing it
- *      to use gettimeofday () and poll on that instead...
+ *	So we sleep until the nanosleep overshoot (as calibrated by the first)
+ *	before the end, then finish in a hard loop on the monotonic clock.
+ *	Short delays are all loop - which uses 100% CPU, something not an
+ *	issue in a microcontroller, but under a multi-tasking, multi-user OS,
+ *	it's wastefull, however we've no real choice )-:
  *********************************************************************************
  */
 
 void delayMicrosecondsHard (unsigned int howLong)
 {
-  struct timeval tNow, tLong, tEnd ;
-
-  gettimeofday (&tNow, NULL) ;
-  tLong.tv_sec  = howLong / 1000000 ;
-  tLong.tv_usec = howLong % 1000000 ;
-  timeradd (&tNow, &tLong, &tEnd) ;
+  uint64_t tEnd = monoNanos () + (uint64_t)howLong * 1000ULL ;
 
-  while (timercmp (&tNow, &tEnd, <))
-    gettimeofday (&tNow, NULL) ;
+  while (monoNanos () < tEnd)
+    ;
 }
 
 void delayMicroseconds (unsigned int howLong)
 {
-  struct timespec sleeper ;
-  unsigned int uSecs = howLong % 1000000 ;
-  unsigned int wSecs = howLong / 1000000 ;
+  uint64_t tEnd ;
 
-  /**/ if (howLong ==   0)
+  if (howLong == 0)
     return ;
-  else if (howLong  < 100)
-    delayMicrosecondsHard (howLong) ;
-  else
-  {
-    sleeper.tv_sec  = wSecs ;
-    sleeper.tv_nsec = (long)(uSecs * 1000L) ;
-    nanosleep (&sleeper, NULL) ;
-  }
+
+  if ((uint64_t)howLong * 1000ULL > spinNanos)
+    (void)sleepMargin () ;		// Calibrated before we start timing
+
+  tEnd = monoNanos () + (uint64_t)howLong * 1000ULL ;
+  if ((uint64_t)howLong * 1000ULL > spinNanos)
+    sleepUntil (tEnd - spinNanos) ;
+  while (monoNanos () < tEnd)
+    ;
 }
 
 
 /*
- * millis:
- *	Return a number of milliseconds as an unsigned int.
+ * millis: micros:
+ *	Return a number of milliseconds or microseconds since setup as an
+ *	unsigned int. These wrap: micros after about 71 minutes.
  *********************************************************************************
  */
 
 unsigned int millis (void)
 {
-  struct timeval tv ;
-  uint64_t now ;
+  return (uint32_t)((monoNanos () - epochNanos) / 1000000ULL) ;
+}
+
+unsigned int micros (void)
+{
+  return (uint32_t)((monoNanos () - epochNanos) / 1000ULL) ;
+}
+
+
+/*
+ * micros64: nanos:
+ *	As micros, but 64 bits wide so they don't wrap.
+ *********************************************************************************
+ */
 
-  gettimeofday (&tv, NULL) ;
-  now  = (uint64_t)tv.tv_sec * (uint64_t)1000 + (uint64_t)(tv.tv_usec / 1000) ;
+uint64_t micros64 (void)
+{
+  return (monoNanos () - epochNanos) / 1000ULL ;
+}
 
-  return (uint32_t)(now - epochMilli) ;
+uint64_t nanos (void)
+{
+  return monoNanos () - epochNanos ;
 }
 
 
 /*
- * micros:
- *	Return a number of microseconds as an unsigned int.
+ * wpiWaitUntil:
+ *	Wait for a CLOCK_MONOTONIC time in nS, as delayMicroseconds: asleep
+ *	until just before it, then in a hard loop.
  *********************************************************************************
  */
 
-unsigned int micros (void)
+void wpiWaitUntil (uint64_t when)
+{
+  uint64_t now = monoNanos () ;
+
+  if (now >= when)
+    return ;
+  if (when - now > spinNanos)
+    sleepUntil (when - sleepMargin ()) ;
+  while (monoNanos () < when)
+    ;
+}
+
+
+/*
+ * wpiPeriodicStart: wpiWaitNextPeriod:
+ *	Run a loop every periodNs: wpiWaitNextPeriod waits for the start of
+ *	the next period. A loop that's already past it has overrun; it isn't
+ *	kept waiting, and any periods it's missed altogether are skipped, so
+ *	it stays in phase. Returns how many it's skipped plus one after an
+ *	overrun, 0 otherwise.
+ *********************************************************************************
+ */
+
+struct wpiPeriodic wpiPeriodicStart (uint64_t periodNs)
+{
+  struct wpiPeriodic ctx ;
+
+  (void)sleepMargin () ;		// Not in the first period
+
+  memset (&ctx, 0, sizeof (ctx)) ;
+  ctx.period  = (periodNs == 0) ? 1 : periodNs ;
+  ctx.start   = monoNanos () ;
+  ctx.next    = ctx.start + ctx.period ;
+  ctx.periods = 1 ;
+
+  return ctx ;
+}
+
+int wpiWaitNextPeriod (struct wpiPeriodic *ctx)
 {
-  struct timeval tv ;
-  uint64_t now ;
+  uint64_t now = monoNanos () ;
+  uint64_t skip = 0 ;
+  int late = 0 ;
+
+  if (now >= ctx->next)
+  {
+    skip = (now - ctx->next) / ctx->period ;
+    ctx->next     += skip * ctx->period ;
+    ctx->skipped  += skip ;
+    ++ctx->overruns ;
+    late = (int)skip + 1 ;
+  }
+  else
+    wpiWaitUntil (ctx->next) ;
 
-  gettimeofday (&tv, NULL) ;
-  now  = (uint64_t)tv.tv_sec * (uint64_t)1000000 + (uint64_t)tv.tv_usec ;
+  ctx->start  = ctx->next ;
+  ctx->next  += ctx->period ;
+  ++ctx->periods ;
 
-  return (uint32_t)(now - epochMicro) ;
+  return late ;
 }
 
 
+/*
+ * setupHeaderPins:
+ *	Fill in the wpiHeader and physHeader bank/bit tables
+ *********************************************************************************
+ */
+
+#ifdef TINKER_BOARD
+static void setupHeaderPins (void)
+{
+	int pin, gpio ;
+	for (pin = 0 ; pin < 64 ; ++pin)
+	{
+		gpio = pinToGpio [pin] ;
+		wpiHeader [pin].bank = ((gpio == -1) || !gpio_is_valid (gpio)) ? -1 : gpioToBank (gpio) ;
+		wpiHeader [pin].mask = (gpio == -1) ? 0 : 1 << gpioToBankPin (gpio) ;
+		gpio = physToGpio [pin] ;
+		physHeader [pin].bank = ((gpio == -1) || !gpio_is_valid (gpio)) ? -1 : gpioToBank (gpio) ;
+		physHeader [pin].mask = (gpio == -1) ? 0 : 1 << gpioToBankPin (gpio) ;
+	}
+	headerScatterCount = 0 ;
+	headerBanks        = 0 ;
+	for (gpio = 0 ; gpio <= GPIO8_B1 ; ++gpio)
+	{
+		struct headerScatter h ;
+		if (!gpio_is_valid (gpio))
+			continue ;
+		h.bank    = gpioToBank (gpio) ;
+		h.mask    = 1 << gpioToBankPin (gpio) ;
+		h.wpiBit  = 0 ;
+		h.physBit = 0 ;
+		for (pin = 0 ; pin < 64 ; ++pin)
+		{
+			if (pinToGpio [pin] == gpio)
+				h.wpiBit  |= 1ULL << pin ;
+			if (physToGpio [pin] == gpio)
+				h.physBit |= 1ULL << pin ;
+		}
+		if ((h.wpiBit | h.physBit) == 0)
+			continue ;
+		headerScatter [headerScatterCount++] = h ;
+		headerBanks |= 1 << h.bank ;
+	}
+}
+#endif
+
+
 /*
  * wiringPiSetup:
  *	Must be called once at the start of your program execution.
@@ -2147,6 +3995,7 @@ int wiringPiSetup (void)
 	#ifdef TINKER_BOARD
 	pinToGpio =  asus_get_pinToGpio(piGpioLayout());
 	physToGpio = asus_get_physToGpio(piGpioLayout());
+	setupHeaderPins () ;
 	#else
 	if (piGpioLayout () == 1)	// A, B, Rev 1, 1.1
 	{
@@ -2162,7 +4011,14 @@ int wiringPiSetup (void)
 	// Open the master /dev/ memory control device
 	// Open the master /dev/memory device
 	#ifdef TINKER_BOARD
-	tinker_board_setup(piGpioLayout());
+	if (piSimFile () != NULL)
+	{
+		asus_set_sim (wiringPiSimFile) ;
+		if (wiringPiDebug)
+			printf ("wiringPi: Using simulated registers: %s\n", (*wiringPiSimFile == 0) ? "(memory)" : wiringPiSimFile) ;
+	}
+	if (tinker_board_setup (piGpioLayout ()) < 0)
+		return wiringPiFailure (WPI_ALMOST, "wiringPiSetup: Unable to map the GPIO registers\n") ;
 	#else
 	// Map the individual hardware components
 	// GPIO:
@@ -2205,6 +4061,8 @@ int wiringPiSetup (void)
 		wiringPiMode = WPI_MODE_PINS ;
 	#ifdef TINKER_BOARD
 	gpio_clk_enable();
+	if (getenv (ENV_CACHED) != NULL)
+		asus_set_cached (TRUE) ;
 	#endif
 
 	return 0 ;
@@ -2254,6 +4112,70 @@ int wiringPiSetupPhys (void)
 }
 
 
+/*
+ * wiringPiSetupCached:
+ *	Must be called once at the start of your program execution.
+ *
+ * Cached setup: As wiringPiSetup, but the GPIO data and direction
+ *	registers are kept in memory, so writing a pin is a single store with
+ *	no read of the hardware first. Only for programs that own their pins
+ *	- if anything else changes the GPIOs call wiringPiCacheSync ().
+ *	Setting WIRINGPI_CACHED in the environment does the same for any
+ *	of the memory mapped setup functions.
+ *********************************************************************************
+ */
+
+int wiringPiSetupCached (void)
+{
+	(void)wiringPiSetup () ;
+	if (wiringPiDebug)
+		printf ("wiringPi: wiringPiSetupCached called\n") ;
+	#ifdef TINKER_BOARD
+	asus_set_cached (TRUE) ;
+	#endif
+	return 0 ;
+}
+
+
+/*
+ * wiringPiSetupSim:
+ *	Must be called once at the start of your program execution.
+ *
+ * Simulated setup: As wiringPiSetup, but runs on a copy of the Tinker
+ *	Board registers held in the given file (or in memory if file is
+ *	NULL or ""), so no board or root access is needed. Outputs are
+ *	looped back to the inputs. Setting WIRINGPI_SIM does the same for
+ *	any of the other setup functions.
+ *********************************************************************************
+ */
+
+int wiringPiSetupSim (const char *file)
+{
+	#ifdef TINKER_BOARD
+	wiringPiSimFile = (file == NULL) ? "" : file ;
+	return wiringPiSetup () ;
+	#else
+	return wiringPiFailure (WPI_ALMOST, "wiringPiSetupSim: Only supported on the Tinker Board\n") ;
+	#endif
+}
+
+
+/*
+ * wiringPiCacheSync:
+ *	Re-read the cached GPIO registers from the hardware, for when
+ *	another process (or the kernel) may have changed them.
+ *********************************************************************************
+ */
+
+void wiringPiCacheSync (void)
+{
+	#ifdef TINKER_BOARD
+	if ((wiringPiMode == WPI_MODE_PINS) || (wiringPiMode == WPI_MODE_PHYS) || (wiringPiMode == WPI_MODE_GPIO))
+		asus_cache_sync (-1) ;
+	#endif
+}
+
+
 /*
  * wiringPiSetupSys:
  *	Must be called once at the start of your program execution.
@@ -2261,18 +4183,11 @@ int wiringPiSetupPhys (void)
  * Initialisation (again), however this time we are using the /sys/class/gpio
  *	interface to the GPIO systems - slightly slower, but always usable as
  *	a non-root user, assuming the devices are already exported and setup correctly.
+ *	With WIRINGPI_GPIOCHIP set it's wiringPiSetupGpioDevice instead.
  */
 
-int wiringPiSetupSys (void)
+static void sysPinTables (void)
 {
-	int pin ;
-	char fName [128] ;
-	if (getenv (ENV_DEBUG) != NULL)
-		wiringPiDebug = TRUE ;
-	if (getenv (ENV_CODES) != NULL)
-		wiringPiReturnCodes = TRUE ;
-	if (wiringPiDebug)
-		printf ("wiringPi: wiringPiSetupSys called\n") ;
 	#ifdef TINKER_BOARD
 	pinToGpio =  asus_get_pinToGpio(piGpioLayout());
 	physToGpio = asus_get_physToGpio(piGpioLayout());
@@ -2288,6 +4203,21 @@ int wiringPiSetupSys (void)
 		physToGpio = physToGpioR2 ;
 	}
 	#endif
+}
+
+int wiringPiSetupSys (void)
+{
+	int pin ;
+	char fName [128] ;
+	if (getenv (ENV_GPIOCHIP) != NULL)
+		return wiringPiSetupGpioDevice (NULL) ;
+	if (getenv (ENV_DEBUG) != NULL)
+		wiringPiDebug = TRUE ;
+	if (getenv (ENV_CODES) != NULL)
+		wiringPiReturnCodes = TRUE ;
+	if (wiringPiDebug)
+		printf ("wiringPi: wiringPiSetupSys called\n") ;
+	sysPinTables () ;
 	// Open and scan the directory, looking for exported GPIOs, and pre-open
 	//	the 'value' interface to speed things up for later
 	for (pin = 0 ; pin < 64 ; ++pin)
@@ -2301,3 +4231,39 @@ int wiringPiSetupSys (void)
 	wiringPiMode = WPI_MODE_GPIO_SYS ;
 	return 0 ;
 }
+
+
+/*
+ * wiringPiSetupGpioDevice:
+ *	Must be called once at the start of your program execution.
+ *
+ * GPIO device setup: as Sys mode - GPIO numbering, no root needed with
+ *	access to /dev/gpiochip* - but through the GPIO character device.
+ *	Pins are requested when first used, bank values are read and written
+ *	in one ioctl and interrupts come with kernel timestamps. chip may
+ *	name one chip (a number or a path), or be NULL for WIRINGPI_GPIOCHIP
+ *	or, if that's empty, all the Tinker Board banks.
+ *********************************************************************************
+ */
+
+int wiringPiSetupGpioDevice (const char *chip)
+{
+	const char *env ;
+	int err ;
+	if (getenv (ENV_DEBUG) != NULL)
+		wiringPiDebug = TRUE ;
+	if (getenv (ENV_CODES) != NULL)
+		wiringPiReturnCodes = TRUE ;
+	if (wiringPiDebug)
+		printf ("wiringPi: wiringPiSetupGpioDevice called\n") ;
+	if ((chip == NULL) && ((env = getenv (ENV_GPIOCHIP)) != NULL) && (*env != 0))
+		chip = env ;
+	sysPinTables () ;
+	if ((err = wpiChipOpen (chip)) < 0)
+		return wiringPiFailure (WPI_ALMOST, "wiringPiSetupGpioDevice: unable to open %s: %s\n",
+			(chip == NULL) ? "the GPIO chips" : chip, strerror (-err)) ;
+	wpiChipNotify (isrChipNotify, isrChipDrop) ;
+	initialiseEpoch () ;
+	wiringPiMode = WPI_MODE_GPIO_DEV ;
+	return 0 ;
+}
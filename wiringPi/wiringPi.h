@@ -25,6 +25,9 @@
 #define	__WIRING_PI_H__
 
 
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
 #include <wiringTB.h>
 #undef    INPUT
 #undef    OUTPUT
@@ -50,6 +53,7 @@
 #define	WPI_MODE_GPIO_SYS	 2
 #define	WPI_MODE_PHYS		 3
 #define	WPI_MODE_PIFACE		 4
+#define	WPI_MODE_GPIO_DEV	 5
 #define	WPI_MODE_UNINITIALISED	-1
 
 // Pin modes
@@ -141,10 +145,12 @@ extern const int   piMemorySize    [ 8] ;
 // wiringPiNodeStruct:
 //	This describes additional device nodes in the extended wiringPi
 //	2.0 scheme of things.
-//	It's a simple linked list for now, but will hopefully migrate to 
-//	a binary tree for efficiency reasons - but then again, the chances
-//	of more than 1 or 2 devices being added are fairly slim, so who
-//	knows....
+//	They're kept in a linked list, and looked up by pin through a
+//	table that's only ever added to, so wiringPiFindNode () takes the
+//	same time however many there are, and needs no lock.
+//	A node can be found as soon as wiringPiNewNode () returns it, with
+//	functions that do nothing: a *Setup function fills in fd and the
+//	data fields before it sets the functions that use them.
 
 struct wiringPiNodeStruct
 {
@@ -171,6 +177,97 @@ struct wiringPiNodeStruct
 extern struct wiringPiNodeStruct *wiringPiNodes ;
 
 
+// wpiPinHandle:
+//	A pin that has been through the mode translation and validity
+//	checks once, by wpiPinOpen (). For on-board pins it holds the GPIO
+//	bank registers and the bit within them, so reads are a single
+//	register access and writes go straight to the bank update. Anything
+//	else (extension nodes, sys mode) has bank == NULL and goes via
+//	digitalRead/digitalWrite.
+
+typedef struct
+{
+  volatile unsigned int *bank ;
+  unsigned int           mask ;
+  int                    bankNo ;
+  int                    pin ;
+} wpiPinHandle ;
+
+
+// wpiPinLevels:
+//	A snapshot of every header pin, taken by digitalReadAll () in one
+//	pass over the GPIO banks. gpio [n] is the raw input register of
+//	bank n, i.e. the levels in native GPIO (CPU) order.
+
+struct wpiPinLevels
+{
+  uint64_t wpi ;		// bit n = wiringPi pin n
+  uint64_t phys ;		// bit n = physical pin n
+  uint32_t gpio [GPIO_BANK] ;
+} ;
+
+
+// wpiEdgeEvent:
+//	One edge, as read from an event ring (see wpiEventRingOpen ()).
+
+struct wpiEdgeEvent
+{
+  int      pin ;
+  int      edge ;		// INT_EDGE_RISING or INT_EDGE_FALLING
+  int      level ;		// The level after the edge
+  uint64_t timestamp ;		// CLOCK_MONOTONIC nS
+} ;
+
+struct wpiEventRing ;
+
+
+// wpiPeriodic:
+//	A loop run at a fixed rate by wpiWaitNextPeriod (). Times are
+//	CLOCK_MONOTONIC nS, and the deadlines absolute, so the time spent in
+//	the loop doesn't add up as drift.
+
+struct wpiPeriodic
+{
+  uint64_t period ;
+  uint64_t start ;		// Of the current period
+  uint64_t next ;		// Deadline: the start of the next one
+  uint64_t periods ;		// How many have started
+  uint64_t overruns ;		// Times the deadline had gone already
+  uint64_t skipped ;		// Periods missed altogether by those
+} ;
+
+// Thread classes:
+//	Every thread wiringPi starts is one of these, and is started with
+//	the class's configuration - set by wpiThreadConfigSet ().
+//	The ISR dispatchers, which run your ISRs, have a 256KiB stack: set
+//	a bigger stackSize for WPI_THREAD_ISR before the first wiringPiISR ()
+//	if they need more.
+
+#define	WPI_THREAD_SOFTPWM	0
+#define	WPI_THREAD_SOFTTONE	1
+#define	WPI_THREAD_SOFTSERVO	2
+#define	WPI_THREAD_ISR		3
+#define	WPI_THREAD_USER		4	// piThreadCreate ()
+#define	WPI_THREAD_CLASSES	5
+
+#define	WPI_SCHED_INHERIT	0	// Leave it as the creator's
+#define	WPI_SCHED_OTHER		1
+#define	WPI_SCHED_FIFO		2
+#define	WPI_SCHED_RR		3
+#define	WPI_SCHED_DEADLINE	4
+
+struct wpiThreadConfig
+{
+  int      policy ;		// WPI_SCHED_*
+  int      priority ;		// For FIFO and RR
+  uint64_t runtime ;		// For DEADLINE, nS
+  uint64_t deadline ;
+  uint64_t period ;
+  uint64_t cpus ;		// Affinity: bit n for CPU n, 0 to leave it
+  size_t   stackSize ;		// Bytes, 0 for the system default
+} ;
+
+
 // Function prototypes
 //	c++ wrappers thanks to a comment by Nick Lott
 //	(and others on the Raspberry Pi forums)
@@ -194,6 +291,10 @@ extern int  wiringPiSetup       (void) ;
 extern int  wiringPiSetupSys    (void) ;
 extern int  wiringPiSetupGpio   (void) ;
 extern int  wiringPiSetupPhys   (void) ;
+extern int  wiringPiSetupCached (void) ;
+extern int  wiringPiSetupSim    (const char *file) ;
+extern int  wiringPiSetupGpioDevice (const char *chip) ;
+extern void wiringPiCacheSync   (void) ;
 
 extern void pinModeAlt          (int pin, int mode) ;
 extern void pinMode             (int pin, int mode) ;
@@ -204,10 +305,39 @@ extern void pwmWrite            (int pin, int value) ;
 extern int  analogRead          (int pin) ;
 extern void analogWrite         (int pin, int value) ;
 
+// Pre-resolved pin handles
+
+extern wpiPinHandle wpiPinOpen  (int pin) ;
+
+static inline void wpiHandleWrite (wpiPinHandle h, int value)
+{
+  if (h.bank == 0)
+    digitalWrite (h.pin, value) ;
+  else
+    asus_gpio_update (h.bankNo, h.mask, (value == LOW) ? 0 : h.mask) ;
+}
+
+static inline int wpiHandleRead (wpiPinHandle h)
+{
+  if (h.bank == 0)
+    return digitalRead (h.pin) ;
+  return (h.bank [GPIO_EXT_PORTA_OFFSET / 4] & h.mask) ? HIGH : LOW ;
+}
+
+static inline void wpiHandleToggle (wpiPinHandle h)
+{
+  if (h.bank == 0)
+    digitalWrite (h.pin, !digitalRead (h.pin)) ;
+  else
+    asus_gpio_update (h.bankNo, 0, h.mask) ;
+}
+
 // On-Board TinkerBoard hardware specific stuff
 extern int  getPinMode          (int pin) ;
 extern void setPwmPeriod		(int pin, unsigned int period) ;
 extern void setPwmFrequency		(int pin, int divisor) ;
+extern int  pwmStage            (int pin, int period, int value, int divisor) ;
+extern void pwmCommit           (void) ;
 extern void setGpioDrive		(int pin, int drv_type) ;
 extern int 	getGpioDrive		(int pin) ;
 
@@ -227,16 +357,42 @@ extern void setPadDrive         (int group, int value) ;
 extern int  getAlt              (int pin) ;
 extern void pwmToneWrite        (int pin, int freq) ;
 extern void digitalWriteByte    (int value) ;
+extern void digitalWriteBank    (int bank, unsigned int setMask, unsigned int clrMask) ;
+extern void digitalWriteMask    (uint64_t setMask, uint64_t clrMask) ;
+extern int  edgeLatchSetup      (int pin, int mode) ;
+extern unsigned int edgeLatchRead (int bank) ;
+extern void edgeLatchAck        (int bank, unsigned int mask) ;
+extern void setGpioDebounce     (int pin, int enable) ;
+extern uint64_t digitalReadAll  (struct wpiPinLevels *levels) ;
+extern unsigned int digitalReadByte (void) ;
+extern int  digitalReadPins     (const int *pins, int n, uint64_t *values) ;
+extern int  digitalWritePins    (const int *pins, int n, uint64_t values) ;
 extern void pwmSetMode          (int mode) ;
 extern void pwmSetRange         (unsigned int range) ;
 extern void pwmSetClock         (int divisor) ;
+extern int  pwmCapable          (int pin) ;
 extern void gpioClockSet        (int pin, int freq) ;
 
 // Interrupts
 //	(Also Pi hardware specific)
 
 extern int  waitForInterrupt    (int pin, int mS) ;
+extern int  waitForInterruptAny (const int *pins, int n, int mS, int *firedPins) ;
 extern int  wiringPiISR         (int pin, int mode, void (*function)(void)) ;
+extern int  wiringPiISRex       (int pin, int mode,
+				 void (*function)(int pin, int level, uint64_t timestamp, void *userData),
+				 void *userData) ;
+extern int  wiringPiISRRemove   (int pin) ;
+extern int  wiringPiISRThreads  (int threads, int firstCpu) ;
+extern uint64_t wiringPiISRTime (int pin) ;
+
+extern struct wpiEventRing *wpiEventRingOpen (int size) ;
+extern int  wpiEventRingAddPin  (struct wpiEventRing *ring, int pin, int mode) ;
+extern int  wpiEventRingRead    (struct wpiEventRing *ring, struct wpiEdgeEvent *events, int max) ;
+extern int  wpiEventRingWait    (struct wpiEventRing *ring, int mS) ;
+extern int  wpiEventRingFd      (struct wpiEventRing *ring) ;
+extern unsigned int wpiEventRingOverflow (struct wpiEventRing *ring) ;
+extern void wpiEventRingClose   (struct wpiEventRing *ring) ;
 
 // Threads
 
@@ -244,9 +400,14 @@ extern int  piThreadCreate      (void *(*fn)(void *)) ;
 extern void piLock              (int key) ;
 extern void piUnlock            (int key) ;
 
-// Schedulling priority
+// Schedulling priority and real-time configuration
 
 extern int piHiPri (const int pri) ;
+extern int wpiThreadConfigSet (int cls, const struct wpiThreadConfig *cfg) ;
+extern int wpiThreadConfigGet (int cls, struct wpiThreadConfig *cfg) ;
+extern int wpiThreadCreate    (pthread_t *thread, int cls, void *(*fn)(void *), void *arg) ;
+extern int wpiThreadSchedError (int cls) ;
+extern int wpiMemoryLock      (size_t stackPrefault) ;
 
 // Extras from arduino land
 
@@ -254,6 +415,12 @@ extern void         delay             (unsigned int howLong) ;
 extern void         delayMicroseconds (unsigned int howLong) ;
 extern unsigned int millis            (void) ;
 extern unsigned int micros            (void) ;
+extern uint64_t     micros64          (void) ;
+extern uint64_t     nanos             (void) ;
+
+extern struct wpiPeriodic wpiPeriodicStart (uint64_t periodNs) ;
+extern int          wpiWaitNextPeriod (struct wpiPeriodic *ctx) ;
+extern void         wpiWaitUntil      (uint64_t when) ;
 
 #ifdef __cplusplus
 }
@@ -8,11 +8,18 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
 #define CONFIG_I2S_SHORT
 
 #define BLOCK_SIZE (4*1024)
 
+/* Every block we use sits in one 1.5M window of the IO space, from the
+ * PWM up to GPIO8, so it can all be mapped in one go */
+#define IO_WINDOW_BASE RK3288_PWM
+#define IO_WINDOW_SIZE (RK3288_GPIO(8)+BLOCK_SIZE-RK3288_PWM)
+
 //jason add for asuspi
 static int  mem_fd;
 static void* gpio_map0[9];
@@ -30,6 +37,48 @@ static volatile unsigned *pmu;
 static void *cru_map;
 static volatile unsigned *cru;
 
+/* Set when all the blocks are in one mapping (window or simulation) */
+static void *io_window;
+static size_t io_window_size;
+static int mapped;
+
+/* Header gpios of each bank, bank writes never touch anything else */
+static unsigned bank_valid[9];
+
+/* Shadow copies of DR/DDR. With cache_outputs set the registers are
+ * only ever stored to, never read back - so nobody else may touch the
+ * banks, or asus_cache_sync() must be called after they have. */
+static int cache_outputs;
+static unsigned dr_shadow[9];
+static unsigned ddr_shadow[9];
+
+/* One lock per register, so threads on different banks never meet */
+static int dr_lock[9];
+static int ddr_lock[9];
+/* And one for the interrupt control registers of each bank, which the
+ * kernel's gpio driver shares with us for the pins it isn't using */
+static int int_lock[9];
+
+/* Hardware PWM channels, by controller channel number. Once a channel
+ * is known to be in PWM mode and running, a duty update is a single
+ * store to PWMx_DUTY, which the controller latches at the end of the
+ * current period - no disable/enable, so no glitch. */
+#define PWM_UNKNOWN     0       /* Not looked at yet by this process */
+#define PWM_MUXED       1       /* Pin is in PWM mode, channel not set up */
+#define PWM_RUNNING     2       /* Set up and enabled, duty writes only */
+#define PWM_REG(n, reg) (pwm + (0x10*(n) + RK3288_PWM0_##reg)/4)
+static struct
+{
+        int state;
+        unsigned period;        /* Copy of PWMx_PERIOD */
+} pwm_chans[4];
+
+/* Simulation: the register blocks live in a file or anonymous memory,
+ * laid out as GPIO0-8, GRF, PWM, PMU, CRU, one 4K block each. */
+#define SIM_BLOCKS 13
+static char *sim_file;
+static int sim_mode;
+
 /* Format Convert*/
 int* asus_get_physToGpio(int rev)
 {
@@ -125,39 +174,104 @@ int alt_2_tb_format(int alt)
         }
 }
 
-/* Register Offset Table */
-int GET_PULL_OFFSET(int bank, int pin)
+/* Pin descriptors
+ * Everything needed to set up one GPIO - iomux field and its function
+ * map, pull and drive registers - so the mode calls are a table lookup
+ * and one register access. Indexed by GPIO number, empty entries are
+ * pins we don't handle. */
+#define PIN_HEADER      0x01    /* On the 40 pin header: gpio_is_valid() */
+#define PIN_PMU         0x02    /* Registers in the PMU, no write enable bits */
+#define PIN_NOMUX       0x04    /* Never touch the iomux (act-led) */
+#define PIN_I2S_SHORT   0x08    /* 6A1 is shorted to 6A2, mux both together */
+
+#ifdef CONFIG_I2S_SHORT
+#define PIN_6A1         (PIN_HEADER|PIN_I2S_SHORT)
+#else
+#define PIN_6A1         PIN_HEADER
+#endif
+
+struct pin_desc
 {
-        int PULL_TABLE [9][4] =
-        {
-                {          -1,           -1, PMU_GPIO0C_P,           -1},        //Bank 0
-                {          -1,           -1,           -1, GRF_GPIO1D_P},        //Bank 1
-                {GRF_GPIO2A_P, GRF_GPIO2B_P, GRF_GPIO2C_P,           -1},        //Bank 2
-                {GRF_GPIO3A_P, GRF_GPIO3B_P, GRF_GPIO3C_P, GRF_GPIO3D_P},        //Bank 3
-                {GRF_GPIO4A_P, GRF_GPIO4B_P, GRF_GPIO4C_P, GRF_GPIO4D_P},        //Bank 4
-                {          -1, GRF_GPIO5B_P, GRF_GPIO5C_P,           -1},        //Bank 5
-                {GRF_GPIO6A_P, GRF_GPIO6B_P, GRF_GPIO6C_P,           -1},        //Bank 6
-                {GRF_GPIO7A_P, GRF_GPIO7B_P, GRF_GPIO7C_P,           -1},        //Bank 7
-                {GRF_GPIO8A_P, GRF_GPIO8B_P,           -1,           -1}        //Bank 8
-        } ;
-        return PULL_TABLE[bank][(int)(pin / 8)];
-}
+        unsigned short iomux;           /* Register offsets in the GRF or PMU */
+        unsigned short pull;
+        unsigned short drv;
+        unsigned char shift;            /* Of the iomux field */
+        unsigned char rmask;            /* Function bits read back */
+        unsigned char wmask;            /* Field written, 0 = not writable */
+        unsigned char flags;
+        const signed char *funcs;       /* iomux value -> GPIO, SPI, ... */
+};
+
+/* iomux value -> function */
+static const signed char funcs_0c1[8]    = {GPIO, CLKOUT, CLK1_27M, -1};
+static const signed char funcs_5b_lo[8]  = {GPIO, SERIAL, TS, -1};
+static const signed char funcs_5b_hi[8]  = {GPIO, SPI, TS, SERIAL};
+static const signed char funcs_5c0[8]    = {GPIO, SPI, TS, -1};
+static const signed char funcs_5c_ts[8]  = {GPIO, TS};
+static const signed char funcs_6a[8]     = {GPIO, I2S};
+static const signed char funcs_7a0[8]    = {GPIO, PWM, VOP0_PWM, VOP1_PWM};
+static const signed char funcs_7a7[8]    = {GPIO, SERIAL, GPS_MAG, HSADCT};
+static const signed char funcs_7b2[8]    = {GPIO, SERIAL, USB, -1};
+static const signed char funcs_7c_i2c[8] = {GPIO, I2C};
+static const signed char funcs_7c6[8]    = {GPIO, SERIAL, SERIAL, PWM};
+static const signed char funcs_7c7[8]    = {GPIO, SERIAL, SERIAL, PWM, HDMI, -1, -1, -1};
+static const signed char funcs_8_spi[8]  = {GPIO, SPI, SC, -1};
+static const signed char funcs_8_i2c[8]  = {GPIO, I2C, SC, -1};
 
-int GET_DRV_OFFSET(int bank, int pin)
+/* The usual layout: 2 bit fields, GRF with write enable */
+#define GRF_PIN(pin, port, rmask, wmask, funcs, flags) \
+        [pin] = { GRF_GPIO##port##_IOMUX, GRF_GPIO##port##_P, GRF_GPIO##port##_E, \
+                  ((pin)%8)*2, rmask, wmask, flags, funcs }
+
+static const struct pin_desc pin_descs[GPIO8_B1+1] =
 {
-        int DRV_TABLE [9][4] =
-        {
-                {          -1,           -1, PMU_GPIO0C_E,           -1},        //Bank 0
-                {          -1,           -1,           -1, GRF_GPIO1D_E},        //Bank 1
-                {GRF_GPIO2A_E, GRF_GPIO2B_E, GRF_GPIO2C_E,           -1},        //Bank 2
-                {GRF_GPIO3A_E, GRF_GPIO3B_E, GRF_GPIO3C_E, GRF_GPIO3D_E},        //Bank 3
-                {GRF_GPIO4A_E, GRF_GPIO4B_E, GRF_GPIO4C_E, GRF_GPIO4D_E},        //Bank 4
-                {          -1, GRF_GPIO5B_E, GRF_GPIO5C_E,           -1},        //Bank 5
-                {GRF_GPIO6A_E, GRF_GPIO6B_E, GRF_GPIO6C_E,           -1},        //Bank 6
-                {GRF_GPIO7A_E, GRF_GPIO7B_E, GRF_GPIO7C_E,           -1},        //Bank 7
-                {GRF_GPIO8A_E, GRF_GPIO8B_E,           -1,           -1}        //Bank 8
-        } ;
-        return DRV_TABLE[bank][(int)(pin / 8)];
+        [GPIO0_C1] = { PMU_GPIO0C_IOMUX, PMU_GPIO0C_P, PMU_GPIO0C_E, (GPIO0_C1%8)*2, 0x3, 0x3, PIN_HEADER|PIN_PMU, funcs_0c1 },
+        [GPIO1_D0] = { 0, GRF_GPIO1D_P, GRF_GPIO1D_E, 0, 0, 0, PIN_NOMUX, NULL },
+
+        GRF_PIN(GPIO5_B0, 5B, 0x3, 0x3, funcs_5b_lo, PIN_HEADER),
+        GRF_PIN(GPIO5_B1, 5B, 0x3, 0x3, funcs_5b_lo, PIN_HEADER),
+        GRF_PIN(GPIO5_B2, 5B, 0x3, 0x3, funcs_5b_lo, PIN_HEADER),
+        GRF_PIN(GPIO5_B3, 5B, 0x3, 0x3, funcs_5b_lo, PIN_HEADER),
+        GRF_PIN(GPIO5_B4, 5B, 0x3, 0x3, funcs_5b_hi, PIN_HEADER),
+        GRF_PIN(GPIO5_B5, 5B, 0x3, 0x3, funcs_5b_hi, PIN_HEADER),
+        GRF_PIN(GPIO5_B6, 5B, 0x3, 0x3, funcs_5b_hi, PIN_HEADER),
+        GRF_PIN(GPIO5_B7, 5B, 0x3, 0x3, funcs_5b_hi, PIN_HEADER),
+        GRF_PIN(GPIO5_C0, 5C, 0x3, 0x3, funcs_5c0,   PIN_HEADER),
+        GRF_PIN(GPIO5_C1, 5C, 0x1, 0x3, funcs_5c_ts, 0),
+        GRF_PIN(GPIO5_C2, 5C, 0x1, 0x3, funcs_5c_ts, 0),
+        GRF_PIN(GPIO5_C3, 5C, 0x1, 0x3, funcs_5c_ts, PIN_HEADER),
+
+        GRF_PIN(GPIO6_A0, 6A, 0x1, 0x3, funcs_6a,    PIN_HEADER),
+        GRF_PIN(GPIO6_A1, 6A, 0x1, 0x3, funcs_6a,    PIN_6A1),
+        GRF_PIN(GPIO6_A3, 6A, 0x1, 0x3, funcs_6a,    PIN_HEADER),
+        GRF_PIN(GPIO6_A4, 6A, 0x1, 0x3, funcs_6a,    PIN_HEADER),
+
+        GRF_PIN(GPIO7_A0, 7A, 0x3, 0x0, funcs_7a0,   PIN_HEADER),     /* PWM0, read only */
+        GRF_PIN(GPIO7_A7, 7A, 0x3, 0x3, funcs_7a7,   PIN_HEADER),
+        GRF_PIN(GPIO7_B0, 7B, 0x3, 0x3, funcs_7a7,   PIN_HEADER),
+        GRF_PIN(GPIO7_B1, 7B, 0x3, 0x3, funcs_7a7,   0),
+        GRF_PIN(GPIO7_B2, 7B, 0x3, 0x3, funcs_7b2,   0),
+
+        /* 7C has 4 bit fields, C4-C7 in the high register */
+        [GPIO7_C1] = { GRF_GPIO7CL_IOMUX, GRF_GPIO7C_P, GRF_GPIO7C_E, (GPIO7_C1%8)*4, 0x1, 0xf, PIN_HEADER, funcs_7c_i2c },
+        [GPIO7_C2] = { GRF_GPIO7CL_IOMUX, GRF_GPIO7C_P, GRF_GPIO7C_E, (GPIO7_C2%8)*4, 0x1, 0xf, PIN_HEADER, funcs_7c_i2c },
+        [GPIO7_C6] = { GRF_GPIO7CH_IOMUX, GRF_GPIO7C_P, GRF_GPIO7C_E, (GPIO7_C6%8-4)*4, 0x3, 0xf, PIN_HEADER, funcs_7c6 },
+        [GPIO7_C7] = { GRF_GPIO7CH_IOMUX, GRF_GPIO7C_P, GRF_GPIO7C_E, (GPIO7_C7%8-4)*4, 0x7, 0xf, PIN_HEADER, funcs_7c7 },
+
+        GRF_PIN(GPIO8_A3, 8A, 0x3, 0x3, funcs_8_spi, PIN_HEADER),
+        GRF_PIN(GPIO8_A4, 8A, 0x3, 0x3, funcs_8_i2c, PIN_HEADER),
+        GRF_PIN(GPIO8_A5, 8A, 0x3, 0x3, funcs_8_i2c, PIN_HEADER),
+        GRF_PIN(GPIO8_A6, 8A, 0x3, 0x3, funcs_8_spi, PIN_HEADER),
+        GRF_PIN(GPIO8_A7, 8A, 0x3, 0x3, funcs_8_spi, PIN_HEADER),
+        GRF_PIN(GPIO8_B0, 8B, 0x3, 0x3, funcs_8_spi, PIN_HEADER),
+        GRF_PIN(GPIO8_B1, 8B, 0x3, 0x3, funcs_8_spi, PIN_HEADER),
+};
+
+static const struct pin_desc* pin_desc(int gpio)
+{
+        if(gpio < 0 || gpio > GPIO8_B1 || pin_descs[gpio].flags == 0)
+                return NULL;
+        return &pin_descs[gpio];
 }
 
 /* common */
@@ -177,9 +291,172 @@ int gpioToBankPin(int gpio)
                 return (gpio - 24) % 32;
 }
 
+/* Run on simulated registers, file == "" for anonymous memory.
+ * Must be called before tinker_board_setup(). */
+void asus_set_sim(const char *file)
+{
+        free(sim_file);
+        sim_file = (file != NULL) ? strdup(file) : NULL;
+}
+
+int asus_is_sim(void)
+{
+        return sim_mode;
+}
+
+static void board_init(void)
+{
+        int i;
+        asus_cache_sync(-1);
+        for(i=0;i<GPIO_BANK;i++)
+                bank_valid[i] = 0;
+        for(i=0;i<=GPIO8_B1;i++)
+        {
+                if(gpio_is_valid(i))
+                        bank_valid[gpioToBank(i)] |= (1<<gpioToBankPin(i));
+        }
+}
+
+static int sim_setup(void)
+{
+        int i, fd = -1, flags = MAP_SHARED;
+        struct stat st;
+        unsigned char *base;
+        if(sim_file[0] == 0)
+                flags |= MAP_ANONYMOUS;
+        else
+        {
+                if((fd = open(sim_file, O_RDWR|O_CREAT|O_CLOEXEC, 0666)) < 0)
+                {
+                        printf("wiringPiSetup: Unable to open simulation file %s: %s\n", sim_file, strerror (errno));
+                        return -1;
+                }
+                if(fstat(fd, &st) < 0 || (st.st_size < SIM_BLOCKS*BLOCK_SIZE && ftruncate(fd, SIM_BLOCKS*BLOCK_SIZE) < 0))
+                {
+                        printf("wiringPiSetup: Unable to size simulation file %s: %s\n", sim_file, strerror (errno));
+                        close(fd);
+                        return -1;
+                }
+        }
+        base = mmap(NULL, SIM_BLOCKS*BLOCK_SIZE, PROT_READ|PROT_WRITE, flags, fd, 0);
+        if(fd >= 0)
+                close(fd);
+        if(base == MAP_FAILED)
+        {
+                printf("wiringPiSetup: Unable to map simulation registers: %s\n", strerror (errno));
+                return -1;
+        }
+        io_window = base;
+        io_window_size = SIM_BLOCKS*BLOCK_SIZE;
+        for(i=0;i<GPIO_BANK;i++)
+        {
+                gpio_map0[i] = base + i*BLOCK_SIZE;
+                gpio0[i] = (volatile unsigned *)gpio_map0[i];
+        }
+        grf_map = base + 9*BLOCK_SIZE;
+        pwm_map = base + 10*BLOCK_SIZE;
+        pmu_map = base + 11*BLOCK_SIZE;
+        cru_map = base + 12*BLOCK_SIZE;
+        grf = (volatile unsigned *)grf_map;
+        pwm = (volatile unsigned *)pwm_map;
+        pmu = (volatile unsigned *)pmu_map;
+        cru = (volatile unsigned *)cru_map;
+        sim_mode = 1;
+        mapped = 1;
+        board_init();
+        return 0;
+}
+
+/* One mapping for the whole window. /dev/gpiomem, or a /dev/mem that
+ * guards other drivers' registers, may refuse it - then the caller maps
+ * block by block instead. */
+static int map_window(void)
+{
+        int i;
+        unsigned char *base;
+        #ifdef ANDROID
+        base = mmap64(
+        #else
+        base = mmap(
+        #endif
+                NULL, IO_WINDOW_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, mem_fd, IO_WINDOW_BASE);
+        if(base == MAP_FAILED)
+                return -1;
+        io_window = base;
+        io_window_size = IO_WINDOW_SIZE;
+        for(i=0;i<GPIO_BANK;i++)
+        {
+                gpio_map0[i] = base + RK3288_GPIO(i) - IO_WINDOW_BASE;
+                gpio0[i] = (volatile unsigned *)gpio_map0[i];
+        }
+        grf_map = base + RK3288_GRF_PHYS - IO_WINDOW_BASE;
+        pwm_map = base + RK3288_PWM - IO_WINDOW_BASE;
+        pmu_map = base + RK3288_PMU - IO_WINDOW_BASE;
+        cru_map = base + RK3288_CRU - IO_WINDOW_BASE;
+        grf = (volatile unsigned *)grf_map;
+        pwm = (volatile unsigned *)pwm_map;
+        pmu = (volatile unsigned *)pmu_map;
+        cru = (volatile unsigned *)cru_map;
+        return 0;
+}
+
+/*
+ * Register locks: 0 free, 1 held, 2 held with sleepers. Spin a little,
+ * then sleep on a futex - a high priority thread spinning on a lock held
+ * by a preempted lower priority one on the same CPU would never get it.
+ */
+#define REG_LOCK_SPINS  100
+
+static int reg_trylock(int *lock)
+{
+        int free = 0;
+        return __atomic_compare_exchange_n(lock, &free, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static void reg_lock(int *lock)
+{
+        int n;
+        for(n = 0; n < REG_LOCK_SPINS; n++)
+                if(reg_trylock(lock))
+                        return;
+        while(__atomic_exchange_n(lock, 2, __ATOMIC_SEQ_CST) != 0)
+                syscall(SYS_futex, lock, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+}
+
+static void reg_unlock(int *lock)
+{
+        if(__atomic_exchange_n(lock, 0, __ATOMIC_SEQ_CST) == 2)
+                syscall(SYS_futex, lock, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* There are no pins behind simulated registers, so loop the outputs
+ * back to the input register for reads to see them. Done under the
+ * bank's interrupt lock, so two writers can't interleave the update of
+ * EXT_PORTA and the edge setup can't change under it; RAWSTATUS is also
+ * acked without the lock, so that stays atomic. */
+static void sim_loopback(int bank)
+{
+        volatile unsigned *base = gpio0[bank];
+        unsigned ddr, was, now, pol, edges;
+        reg_lock(&int_lock[bank]);
+        ddr = base[GPIO_SWPORTA_DDR_OFFSET/4];
+        was = base[GPIO_EXT_PORTA_OFFSET/4];
+        now = (base[GPIO_SWPORTA_DR_OFFSET/4] & ddr) | (was & ~ddr);
+        pol = base[GPIO_INT_POLARITY_OFFSET/4];
+        edges = (was ^ now) & base[GPIO_INTEN_OFFSET/4] & base[GPIO_INTTYPE_LEVEL_OFFSET/4];
+        base[GPIO_EXT_PORTA_OFFSET/4] = now;
+        /* and latch edges as the controller would */
+        __atomic_or_fetch(&base[GPIO_INT_RAWSTATUS_OFFSET/4], edges & ~(now ^ pol), __ATOMIC_SEQ_CST);
+        reg_unlock(&int_lock[bank]);
+}
+
 int tinker_board_setup(int rev)
 {
         int i;
+        if(mapped)      /* Setup called again, e.g. by wiringPiSetupGpio */
+                return 0;
+        if(sim_file != NULL)
+                return sim_setup();
         if ((mem_fd = open("/dev/mem", O_RDWR|O_SYNC) ) < 0) 
         {
                 if ((mem_fd = open ("/dev/gpiomem", O_RDWR | O_SYNC | O_CLOEXEC) ) < 0)
@@ -189,6 +466,13 @@ int tinker_board_setup(int rev)
                         return -1;
                 }
         }
+        if(map_window() == 0)
+        {
+                close(mem_fd);
+                mapped = 1;
+                board_init();
+                return 0;
+        }
         for(i=0;i<9;i++)
         {
                 // mmap GPIO 
@@ -292,47 +576,146 @@ int tinker_board_setup(int rev)
         cru = (volatile unsigned *)cru_map;
         ///////////////////////////////
         close(mem_fd); // No need to keep mem_fdcru open after mmap
+        mapped = 1;
+        board_init();
         return 0;
 }
 
+/* Output register cache */
+void asus_cache_sync(int bank)
+{
+        int i;
+        for(i=0;i<GPIO_BANK;i++)
+        {
+                if(bank != -1 && bank != i)
+                        continue;
+                dr_shadow[i] = *(gpio0[i]+GPIO_SWPORTA_DR_OFFSET/4);
+                ddr_shadow[i] = *(gpio0[i]+GPIO_SWPORTA_DDR_OFFSET/4);
+        }
+        if(bank == -1)
+                memset(pwm_chans, 0, sizeof(pwm_chans));
+}
+
+void asus_set_cached(int enable)
+{
+        if(enable)
+                asus_cache_sync(-1);
+        cache_outputs = enable;
+}
+
+/*
+ * Thread safe register update: reg = (reg & ~clrMask) ^ xorMask
+ * (so set is clr=xor=mask, clear is clr=mask, toggle is xor=mask).
+ *
+ * Without a shadow it is a plain read-modify-write under a per register
+ * lock. With one the new value is made in the shadow by a CAS loop,
+ * then whoever gets the lock stores the shadow. A thread that finds the
+ * lock taken just leaves: the holder looks at the shadow again after
+ * unlocking and stores once more if it moved. Stores are serialised and
+ * always of the newest shadow, so the pins never see an older value.
+ * Works on any memory, the bank stress test runs it on a plain buffer.
+ */
+void asus_reg_update(volatile unsigned *reg, unsigned *shadow, int *lock, unsigned clrMask, unsigned xorMask)
+{
+        unsigned old, val;
+        if(shadow == NULL)
+        {
+                reg_lock(lock);
+                *reg = (*reg & ~clrMask) ^ xorMask;
+                reg_unlock(lock);
+                return;
+        }
+        old = __atomic_load_n(shadow, __ATOMIC_RELAXED);
+        do
+                val = (old & ~clrMask) ^ xorMask;
+        while(!__atomic_compare_exchange_n(shadow, &old, val, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+        while(reg_trylock(lock))
+        {
+                val = __atomic_load_n(shadow, __ATOMIC_SEQ_CST);
+                *reg = val;
+                reg_unlock(lock);
+                if(__atomic_load_n(shadow, __ATOMIC_SEQ_CST) == val)
+                        break;
+        }
+}
+
+/* Data register update of one bank, used by the pin handles */
+void asus_gpio_update(int bank, unsigned int clrMask, unsigned int xorMask)
+{
+        asus_reg_update(gpio0[bank]+GPIO_SWPORTA_DR_OFFSET/4, cache_outputs ? &dr_shadow[bank] : NULL,
+                        &dr_lock[bank], clrMask, xorMask);
+        if(sim_mode)
+                sim_loopback(bank);
+}
+
+static unsigned get_gpio_dir(int bank)
+{
+        if(cache_outputs)
+                return __atomic_load_n(&ddr_shadow[bank], __ATOMIC_RELAXED);
+        return *(gpio0[bank]+GPIO_SWPORTA_DDR_OFFSET/4);
+}
+
+static void set_gpio_dir(int bank, unsigned mask, int output)
+{
+        asus_reg_update(gpio0[bank]+GPIO_SWPORTA_DDR_OFFSET/4, cache_outputs ? &ddr_shadow[bank] : NULL,
+                        &ddr_lock[bank], mask, output ? mask : 0);
+        if(sim_mode)
+                sim_loopback(bank);
+}
+
 int gpio_is_valid(int gpio)
 {
-        switch (gpio)
+        const struct pin_desc *d = pin_desc(gpio);
+        return d != NULL && (d->flags & PIN_HEADER);
+}
+
+/* Registers of a descriptor */
+static volatile unsigned* pin_reg(const struct pin_desc *d, int offset)
+{
+        return ((d->flags & PIN_PMU) ? pmu : grf) + offset/4;
+}
+
+static int iomux_get(const struct pin_desc *d)
+{
+        return (*pin_reg(d, d->iomux) >> d->shift) & d->rmask;
+}
+
+static void iomux_set(const struct pin_desc *d, unsigned value)
+{
+        volatile unsigned *reg = pin_reg(d, d->iomux);
+        unsigned wmask = d->wmask;
+        if(d->flags & PIN_NOMUX)
+                return;
+        if(wmask == 0)
         {
-                case GPIO0_C1:
-                case GPIO5_B0:
-                case GPIO5_B1:
-                case GPIO5_B2:
-                case GPIO5_B3:
-                case GPIO5_B4:
-                case GPIO5_B5:
-                case GPIO5_B6:
-                case GPIO5_B7:
-                case GPIO5_C0:
-                case GPIO5_C3:
-                case GPIO6_A0:
-                case GPIO6_A1:
-                case GPIO6_A3:
-                case GPIO6_A4:
-                case GPIO7_A7:
-                case GPIO7_B0:
-                case GPIO7_C1:
-                case GPIO7_C2:
-                case GPIO7_C6:
-                case GPIO7_C7:
-                case GPIO8_A3:
-                case GPIO8_A4:
-                case GPIO8_A5:
-                case GPIO8_A6:
-                case GPIO8_A7:
-                case GPIO8_B0:
-                case GPIO8_B1:
-                case PWM0:
-                        return 1;
-                default:
-                        return 0;
+                printf("wrong gpio\n");
+                return;
+        }
+        /* The shorted pin's field is the next one up, it needs its own write enable */
+        if(d->flags & PIN_I2S_SHORT)
+        {
+                value |= value << 2;
+                wmask |= wmask << 2;
         }
+        /* Plain memory has no write enable bits, simulate them */
+        if((d->flags & PIN_PMU) || sim_mode)
+                *reg = (*reg & ~(wmask << d->shift)) | (value << d->shift);
+        else
+                *reg = (wmask << (d->shift+16)) | (value << d->shift);
 }
+
+/* Pull and drive strength: 2 bits per pin */
+static void pad_set(const struct pin_desc *d, int offset, int pin, unsigned value)
+{
+        volatile unsigned *reg = pin_reg(d, offset);
+        int write_bit = (gpioToBankPin(pin) % 8) << 1;
+        if((d->flags & PIN_PMU) || sim_mode)
+                *reg = (*reg & ~(0x3 << write_bit)) | (value << write_bit);        //without write_en
+        else
+                *reg = (0x3 << (16 + write_bit)) | (value << write_bit);         //with write_en
+}
+
 #if 0
 int gpio_clk_disable(int gpio)
 {
@@ -369,307 +752,65 @@ void gpio_clk_enable(void)
 #endif
 int asus_get_pin_mode(int pin)
 {
-        int value, func;
-        int bank, bank_pin;
-        bank = gpioToBank(pin);
-        bank_pin = gpioToBankPin(pin);
-
-        switch(pin)
+        const struct pin_desc *d = pin_desc(pin);
+        int func;
+        if(d == NULL || d->funcs == NULL)
+                return -1;
+        func = d->funcs[iomux_get(d)];
+        if (func == GPIO)
         {
-                //GPIO0
-                case GPIO0_C1 : value =  ((*(pmu+PMU_GPIO0C_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=CLKOUT;          break;
-                                case 2: func=CLK1_27M;        break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                //GPIO5B
-                case GPIO5_B0 :
-                case GPIO5_B1 :
-                case GPIO5_B2 :
-                case GPIO5_B3 :
-                        value = ((*(grf+GRF_GPIO5B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=SERIAL;          break;
-                                case 2: func=TS;              break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                case GPIO5_B4 :
-                case GPIO5_B5 :
-                case GPIO5_B6 :
-                case GPIO5_B7 :
-                        value = ((*(grf+GRF_GPIO5B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=SPI;             break;
-                                case 2: func=TS;              break;
-                                case 3: func=SERIAL;          break;
-                                default: func=-1;             break;
-                        }
-                        break;
-
-                //GPIO5C
-                case GPIO5_C0 :
-                        value = ((*(grf+GRF_GPIO5C_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=SPI;             break;
-                                case 2: func=TS;              break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                case GPIO5_C1 :
-                case GPIO5_C2 :
-                case GPIO5_C3 :
-                        value = ((*(grf+GRF_GPIO5C_IOMUX/4))>>((pin%8)*2)) & 0x00000001;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=TS;              break;
-                                default: func=-1;             break;
-                        }
-                        break;
-
-                //GPIO6A
-                case GPIO6_A0 :
-                case GPIO6_A1 :
-                case GPIO6_A3 :
-                case GPIO6_A4 :
-                        value = ((*(grf+GRF_GPIO6A_IOMUX/4))>>((pin%8)*2)) & 0x00000001;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=I2S;             break;
-                                default: func=-1;             break;
-                        }
-                        break;
-
-                //GPIO7A7
-                case PWM0:        //GPIO7A0
-                        value = ((*(grf+GRF_GPIO7A_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=PWM;             break;
-                                case 2: func=VOP0_PWM;        break;
-                                case 3: func=VOP1_PWM;        break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                case GPIO7_A7 :
-                        value = ((*(grf+GRF_GPIO7A_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=SERIAL;          break;
-                                case 2: func=GPS_MAG;         break;
-                                case 3: func=HSADCT;          break;
-                                default: func=-1;             break;
-                        }
-                        break;
-
-                //GPIO7B
-                case GPIO7_B0 :
-                case GPIO7_B1 :
-                        value = ((*(grf+GRF_GPIO7B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=SERIAL;          break;
-                                case 2: func=GPS_MAG;         break;
-                                case 3: func=HSADCT;          break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                case GPIO7_B2 :
-                        value = ((*(grf+GRF_GPIO7B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=SERIAL;          break;
-                                case 2: func=USB;             break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                //GPIO7C
-                case GPIO7_C1 :
-                case GPIO7_C2 :
-                        value = ((*(grf+GRF_GPIO7CL_IOMUX/4))>>((pin%8)*4)) & 0x00000001;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=I2C;             break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                case GPIO7_C6 :
-                        value = ((*(grf+GRF_GPIO7CH_IOMUX/4))>>(((pin-4)%8)*4)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1:
-                                case 2: func=SERIAL;          break;
-                                case 3: func=PWM;             break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                case GPIO7_C7 :
-                        value = ((*(grf+GRF_GPIO7CH_IOMUX/4))>>(((pin-4)%8)*4)) & 0x00000007;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1:
-                                case 2: func=SERIAL;          break;
-                                case 3: func=PWM;             break;
-                                case 4: func=HDMI;            break;
-                                default: func=-1;             break;
-                        }
-                        break;
-
-                //GPIO8A
-                case GPIO8_A3 :
-                case GPIO8_A6 :
-                case GPIO8_A7 :
-                        value = ((*(grf+GRF_GPIO8A_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=SPI;             break;
-                                case 2: func=SC;              break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                case GPIO8_A4 :
-                case GPIO8_A5 :
-                        value = ((*(grf+GRF_GPIO8A_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=I2C;             break;
-                                case 2: func=SC;              break;
-                                default: func=-1;             break;
-                        }
-                        break;
-
-                //GPIO8B
-                case GPIO8_B0 :
-                case GPIO8_B1 :
-                        value = ((*(grf+GRF_GPIO8B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        switch(value)
-                        {
-                                case 0: func=GPIO;            break;
-                                case 1: func=SPI;             break;
-                                case 2: func=SC;              break;
-                                default: func=-1;             break;
-                        }
-                        break;
-                default:
-                        func=-1; break;
-        }
-       if (func == GPIO)
-       {
-                if (*(gpio0[bank]+GPIO_SWPORTA_DDR_OFFSET/4) & (1<<bank_pin))
+                if (get_gpio_dir(gpioToBank(pin)) & (1<<gpioToBankPin(pin)))
                         func = OUTPUT;
                 else
                         func = INPUT;
         }
-        //printf("\nget_pin_mode: pin=%d, value=%x, func=%x\n",pin, value, func);
         return func;
 }
 
 void asus_set_pinmode_as_gpio(int pin)
 {
-        switch(pin)
+        const struct pin_desc *d = pin_desc(pin);
+        if(d == NULL)
         {
-                //GPIO0
-                case GPIO0_C1 :
-                        *(pmu+PMU_GPIO0C_IOMUX/4) = (*(pmu+PMU_GPIO0C_IOMUX/4) | (0x03<<((pin%8)*2+16))) & (~(0x03<<((pin%8)*2)));
-                        break;
-                //GPIO1D0:act-led
-                case GPIO1_D0 :
-                        break;
-                //GPIO5B
-                case GPIO5_B0 :
-                case GPIO5_B1 :
-                case GPIO5_B2 :
-                case GPIO5_B3 :
-                case GPIO5_B4 :
-                case GPIO5_B5 :
-                case GPIO5_B6 :
-                case GPIO5_B7 :
-                        *(grf+GRF_GPIO5B_IOMUX/4) = (*(grf+GRF_GPIO5B_IOMUX/4) | (0x03<<((pin%8)*2+16))) & (~(0x03<<((pin%8)*2)));
-                        break;
-
-                //GPIO5C
-                case GPIO5_C0 :
-                case GPIO5_C1 :
-                case GPIO5_C2 :
-                case GPIO5_C3 :
-                        *(grf+GRF_GPIO5C_IOMUX/4) =  (*(grf+GRF_GPIO5C_IOMUX/4) | (0x03<<((pin%8)*2+16))) & (~(0x03<<((pin%8)*2)));
-                        break;
-
-                //GPIO6A
-                case GPIO6_A1 :
-                        #ifdef CONFIG_I2S_SHORT
-                        *(grf+GRF_GPIO6A_IOMUX/4) =  (*(grf+GRF_GPIO6A_IOMUX/4) | (0x0f<<((pin%8)*2+16))) & (~(0x0f<<((pin%8)*2)));
-                        *(grf+GRF_GPIO6A_P/4) = ((*(grf+GRF_GPIO6A_P/4) | (0x03<<(((GPIO6_A2)%8)*2+16))) & (~(0x03<<(((GPIO6_A2)%8)*2)))) | (0<<(((GPIO6_A2)%8)*2+1)) | (0<<(((GPIO6_A2)%8)*2));
-                        #else
-                        *(grf+GRF_GPIO6A_IOMUX/4) =  (*(grf+GRF_GPIO6A_IOMUX/4) | (0x03<<((pin%8)*2+16))) & (~(0x03<<((pin%8)*2)));
-                        #endif
-                        break;
-                case GPIO6_A0 :
-                case GPIO6_A3 :
-                case GPIO6_A4 :
-                        *(grf+GRF_GPIO6A_IOMUX/4) =  (*(grf+GRF_GPIO6A_IOMUX/4) | (0x03<<((pin%8)*2+16))) & (~(0x03<<((pin%8)*2)));
-                        break;
-
-                //GPIO7A7
-                case GPIO7_A7 :
-                        *(grf+GRF_GPIO7A_IOMUX/4) =  (*(grf+GRF_GPIO7A_IOMUX/4) | (0x03<<((pin%8)*2+16))) & (~(0x03<<((pin%8)*2)));
-                        break;
-
-                //GPIO7B
-                case GPIO7_B0 :
-                case GPIO7_B1 :
-                case GPIO7_B2 :
-                        *(grf+GRF_GPIO7B_IOMUX/4) =  (*(grf+GRF_GPIO7B_IOMUX/4) | (0x03<<((pin%8)*2+16))) & (~(0x03<<((pin%8)*2)));
-                        break;
-                //GPIO7C
-                case GPIO7_C1 :
-                case GPIO7_C2 :
-                        *(grf+GRF_GPIO7CL_IOMUX/4) = (*(grf+GRF_GPIO7CL_IOMUX/4) | (0x0f<<(16+(pin%8)*4))) & (~(0x0f<<((pin%8)*4)));
-                        break;
-                case GPIO7_C6 :
-                case GPIO7_C7 :
-                        *(grf+GRF_GPIO7CH_IOMUX/4) =  (*(grf+GRF_GPIO7CH_IOMUX/4) | (0x0f<<(16+(pin%8-4)*4))) & (~(0x0f<<((pin%8-4)*4)));
-                        break;
+                printf("wrong gpio\n");
+                return;
+        }
+        iomux_set(d, 0);
+        if(d->flags & PIN_I2S_SHORT)    /* and no pull on the 6A2 end */
+                *(grf+GRF_GPIO6A_P/4) = 0x03<<(((GPIO6_A2)%8)*2+16);
+}
 
-                //GPIO8A
-                case GPIO8_A3 :
-                case GPIO8_A6 :
-                case GPIO8_A7 :
-                case GPIO8_A4 :
-                case GPIO8_A5 :
-                        *(grf+GRF_GPIO8A_IOMUX/4) =  (*(grf+GRF_GPIO8A_IOMUX/4) | (0x03<<((pin%8)*2+16))) & (~(0x03<<((pin%8)*2)));
-                        break;
-                //GPIO8B
-                case GPIO8_B0 :
-                case GPIO8_B1 :
-                        *(grf+GRF_GPIO8B_IOMUX/4) = (*(grf+GRF_GPIO8B_IOMUX/4) | (0x03<<((pin%8)*2+16))) & (~(0x03<<((pin%8)*2)));
-                        break;
-                default:
-                        printf("wrong gpio\n");
-                        break;
-        }        //switch(pin)
+/* Controller channel of a PWM pin, or -1 if it isn't one or isn't in
+ * PWM mode. The iomux is only checked the first time; after that the
+ * state is trusted until the pin's mode is changed again. */
+static int pwm_chan(int pin)
+{
+        int n;
+        switch(pin)
+        {
+                case PWM0: n = 0; break;
+                case PWM2: n = 2; break;
+                case PWM3: n = 3; break;
+                default: return -1;
+        }
+        if(pwm_chans[n].state == PWM_UNKNOWN)
+        {
+                if(asus_get_pin_mode(pin) != PWM)
+                        return -1;
+                pwm_chans[n].period = *PWM_REG(n, PERIOD);
+                pwm_chans[n].state = PWM_MUXED;
+        }
+        return n;
+}
 
+static void pwm_forget(int pin)
+{
+        switch(pin)
+        {
+                case PWM0: pwm_chans[0].state = PWM_UNKNOWN; break;
+                case PWM2: pwm_chans[2].state = PWM_UNKNOWN; break;
+                case PWM3: pwm_chans[3].state = PWM_UNKNOWN; break;
+        }
 }
 
 void asus_set_pin_mode(int pin, int mode)
@@ -679,27 +820,25 @@ void asus_set_pin_mode(int pin, int mode)
                 return;
         bank = gpioToBank(pin);
         bank_pin = gpioToBankPin(pin);
+        pwm_forget(pin);
 
         if(INPUT == mode)
         {
                 asus_set_pinmode_as_gpio(pin);
-                *(gpio0[bank]+GPIO_SWPORTA_DDR_OFFSET/4) &= ~(1<<bank_pin);
+                set_gpio_dir(bank, 1<<bank_pin, 0);
         }
         else if(OUTPUT == mode)
         {
                 asus_set_pinmode_as_gpio(pin);
-                *(gpio0[bank]+GPIO_SWPORTA_DDR_OFFSET/4) |= (1<<bank_pin);
+                set_gpio_dir(bank, 1<<bank_pin, 1);
         } 
         else if(PWM_OUTPUT == mode)
         {
                 //set pin PWMx to pwm mode
-                if(pin == PWM2)
-                {
-                        *(grf+GRF_GPIO7CH_IOMUX/4) =  (*(grf+GRF_GPIO7CH_IOMUX/4) | (0x0f<<(16+(pin%8-4)*4))) | (0x03<<((pin%8-4)*4));
-                }
-                else if(pin == PWM3)
+                if(pin == PWM2 || pin == PWM3)
                 {
-                        *(grf+GRF_GPIO7CH_IOMUX/4) =  (*(grf+GRF_GPIO7CH_IOMUX/4) | (0x0f<<(16+(pin%8-4)*4))) | (0x03<<((pin%8-4)*4));
+                        iomux_set(pin_desc(pin), 3);
+                        pwm_chan(pin);
                 }
                 else
                 {
@@ -709,9 +848,7 @@ void asus_set_pin_mode(int pin, int mode)
         else if(GPIO_CLOCK == mode)
         {
                 if(pin == GPIO0_C1)
-                {
-                        *(pmu+PMU_GPIO0C_IOMUX/4) = (*(pmu+PMU_GPIO0C_IOMUX/4) & (~(0x03<<((pin%8)*2)))) | (0x01<<((pin%8)*2));
-                }
+                        iomux_set(pin_desc(pin), 1);
                 else
                         printf("This pin cannot set as gpio clock\n");
         }
@@ -719,43 +856,23 @@ void asus_set_pin_mode(int pin, int mode)
 
 void asus_digitalWrite(int pin, int value)
 {
-        int bank, bank_pin;
-        int op=0;
-        volatile unsigned* addr;
+        unsigned mask;
         if(!gpio_is_valid(pin))
                 return;
-        bank = gpioToBank(pin);
-        bank_pin = gpioToBankPin(pin);
+        mask = 1<<gpioToBankPin(pin);
+        asus_gpio_update(gpioToBank(pin), mask, value > 0 ? mask : 0);
+}
 
-        addr=gpio0[bank]+GPIO_SWPORTA_DR_OFFSET/4;
-        if(value > 0)
-        {
-                //*(gpio0[bank]+GPIO_SWPORTA_DR_OFFSET/4) |= (1<<bank_pin);
-                op=(1<<bank_pin);
-                __asm__ volatile(
-                "ldr r0,[%0]\n\t"
-                "ldr r1,[%1]\n\t"
-                "orr r0,r1\n\t"
-                "str r0,[%0]\n\t"
-                :"+r" (addr)
-                :"r" (&op)
-                :"r0","r1","memory"
-                );
-        }
-        else
-        {
-                //*(gpio0[bank]+GPIO_SWPORTA_DR_OFFSET/4) &= ~(1<<bank_pin);
-                op=~(1<<bank_pin);
-                __asm__ volatile(
-                "ldr r0,[%0]\n\t"
-                "ldr r1,[%1]\n\t"
-                "and r0,r1\n\t"
-                "str r0,[%0]\n\t"
-                :"+r" (addr)
-                :"r" (&op)
-                :"r0","r1","memory"
-                );
-        }
+/* Set and clear any number of pins of one bank with a single DR update */
+void asus_digitalWriteBank(int bank, unsigned int setMask, unsigned int clrMask)
+{
+        if(bank < 0 || bank >= GPIO_BANK)
+                return;
+        setMask &= bank_valid[bank];
+        clrMask &= bank_valid[bank];
+        if((setMask | clrMask) == 0)
+                return;
+        asus_gpio_update(bank, setMask | clrMask, setMask);
 }
 
 int asus_digitalRead(int pin)
@@ -769,197 +886,302 @@ int asus_digitalRead(int pin)
         return value;
 }
 
-void asus_pullUpDnControl (int pin, int pud)
+/* Input levels of a whole bank, one load of EXT_PORTA */
+unsigned int asus_digitalReadBank(int bank)
 {
-        int bank, bank_pin;
-        int GPIO_P_offset;
-        int write_bit;
+        if(bank < 0 || bank >= GPIO_BANK)
+                return 0;
+        return *(gpio0[bank]+GPIO_EXT_PORTA_OFFSET/4);
+}
+
+/*
+ * Edge latch: the controller detects the edge and holds it in
+ * INT_RAWSTATUS, with the pin masked so no interrupt reaches the kernel.
+ * A whole bank is read with one load and acked through PORTA_EOI, which
+ * clears only the bits written - an edge after the read stays latched.
+ * The controller does one edge per pin, rising or falling.
+ */
+int asus_edge_latch(int pin, int edge)
+{
+        volatile unsigned *base;
+        unsigned mask;
+        int bank, *lock;
         if(!gpio_is_valid(pin))
         {
                 printf("wrong gpio\n");
-                return;
+                return -1;
         }
         bank = gpioToBank(pin);
-        bank_pin = gpioToBankPin(pin);
-        GPIO_P_offset = GET_PULL_OFFSET(bank, bank_pin);
-        if(GPIO_P_offset == -1)
-        {
-                printf("wrong offset\n");
-                return;
-        }
-        write_bit = (bank_pin % 8) << 1;
-        pud = pud_2_tb_format(pud);
-        if(bank == 0)
+        base = gpio0[bank];
+        lock = &int_lock[bank];
+        mask = 1u << gpioToBankPin(pin);
+        if(edge == ASUS_LATCH_OFF)
         {
-                *(pmu+GPIO_P_offset/4) = (*(pmu+GPIO_P_offset/4) & ~(0x3 << write_bit)) | (pud << write_bit);        //without write_en
+                asus_reg_update(base+GPIO_INTEN_OFFSET/4, NULL, lock, mask, 0);
+                asus_reg_update(base+GPIO_INTMASK_OFFSET/4, NULL, lock, mask, 0);
+                asus_edge_latch_ack(bank, mask);
+                return 0;
         }
+        asus_reg_update(base+GPIO_INTEN_OFFSET/4, NULL, lock, mask, 0);
+        asus_reg_update(base+GPIO_INTMASK_OFFSET/4, NULL, lock, mask, mask);
+        asus_reg_update(base+GPIO_INTTYPE_LEVEL_OFFSET/4, NULL, lock, mask, mask);
+        asus_reg_update(base+GPIO_INT_POLARITY_OFFSET/4, NULL, lock, mask,
+                        (edge == ASUS_LATCH_RISING) ? mask : 0);
+        asus_edge_latch_ack(bank, mask);
+        asus_reg_update(base+GPIO_INTEN_OFFSET/4, NULL, lock, mask, mask);
+        return 0;
+}
+
+unsigned int asus_edge_latch_read(int bank)
+{
+        if(bank < 0 || bank >= GPIO_BANK)
+                return 0;
+        return *(gpio0[bank]+GPIO_INT_RAWSTATUS_OFFSET/4);
+}
+
+void asus_edge_latch_ack(int bank, unsigned int mask)
+{
+        if(bank < 0 || bank >= GPIO_BANK || mask == 0)
+                return;
+        if(sim_mode)    /* Memory doesn't clear itself */
+                __atomic_and_fetch(gpio0[bank]+GPIO_INT_RAWSTATUS_OFFSET/4, ~mask, __ATOMIC_SEQ_CST);
         else
-        {
-                *(grf+GPIO_P_offset/4) = (0x3 << (16 + write_bit)) | (pud << write_bit);                             //with write_en
-        }
+                *(gpio0[bank]+GPIO_PORTA_EOF_OFFSET/4) = mask;
 }
 
-int asus_get_pwm_value(int pin)
+/* Hardware debounce of an input, on the controller's debounce clock */
+void asus_set_debounce(int pin, int enable)
 {
-        unsigned int range;
-        unsigned int value;
-        int PWM_PERIOD_OFFSET = -1;
-        int PWM_DUTY_OFFSET = -1;
-        switch (pin)
+        unsigned mask;
+        int bank;
+        if(!gpio_is_valid(pin))
         {
-                case PWM0:
-                        PWM_PERIOD_OFFSET=RK3288_PWM0_PERIOD;
-                        PWM_DUTY_OFFSET=RK3288_PWM0_DUTY;
-                        break;
-                case PWM2:
-                        PWM_PERIOD_OFFSET=RK3288_PWM2_PERIOD;
-                        PWM_DUTY_OFFSET=RK3288_PWM2_DUTY;
-                        break;
-                case PWM3:
-                        PWM_PERIOD_OFFSET=RK3288_PWM3_PERIOD;
-                        PWM_DUTY_OFFSET=RK3288_PWM3_DUTY;
-                        break;
-                default:
-                        break;
+                printf("wrong gpio\n");
+                return;
         }
-        if(asus_get_pin_mode(pin)==PWM && PWM_PERIOD_OFFSET != -1 && PWM_DUTY_OFFSET != -1)
+        bank = gpioToBank(pin);
+        mask = 1u << gpioToBankPin(pin);
+        asus_reg_update(gpio0[bank]+GPIO_DEBOUNCE_OFFSET/4, NULL, &int_lock[bank], mask, enable ? mask : 0);
+}
+
+void asus_pullUpDnControl (int pin, int pud)
+{
+        if(!gpio_is_valid(pin))
         {
-                range = *(pwm+PWM_PERIOD_OFFSET/4);        //Get period
-                value = range - *(pwm+PWM_DUTY_OFFSET/4); //Get duty
-                return value;
+                printf("wrong gpio\n");
+                return;
         }
-        else
-        {
+        pad_set(pin_desc(pin), pin_desc(pin)->pull, pin, pud_2_tb_format(pud));
+}
+
+int asus_get_pwm_value(int pin)
+{
+        int n = pwm_chan(pin);
+        if(n < 0)
                 return -1;
-        }
+        return pwm_chans[n].period - *PWM_REG(n, DUTY);
 }
 
 void asus_set_pwmPeriod(int pin, unsigned int period)
 {
         int pwm_value;
-        int PWM_CTRL_OFFSET = -1;
-        int PWM_PERIOD_OFFSET = -1;
-        switch (pin)
-        {
-                case PWM0:
-                        PWM_CTRL_OFFSET=RK3288_PWM0_CTR;
-                        PWM_PERIOD_OFFSET=RK3288_PWM0_PERIOD;
-                        break;
-                case PWM2:
-                        PWM_CTRL_OFFSET=RK3288_PWM2_CTR;
-                        PWM_PERIOD_OFFSET=RK3288_PWM2_PERIOD;
-                        break;
-                case PWM3:
-                        PWM_CTRL_OFFSET=RK3288_PWM3_CTR;
-                        PWM_PERIOD_OFFSET=RK3288_PWM3_PERIOD;
-                        break;
-                default:
-                        break;
-        }
-        if(asus_get_pin_mode(pin)==PWM && PWM_CTRL_OFFSET != -1 && PWM_PERIOD_OFFSET != -1)
+        int n = pwm_chan(pin);
+        if(n >= 0)
         {
                 pwm_value = asus_get_pwm_value(pin);
-                *(pwm+PWM_CTRL_OFFSET/4) &= ~(1<<0);        //Disable PWM
-                *(pwm+PWM_PERIOD_OFFSET/4) = period;        //Set period PWM
-                *(pwm+PWM_CTRL_OFFSET/4) |= (1<<0);         //Enable PWM
-                if(pwm_value != -1)
-                        asus_pwm_write(pin, pwm_value);
+                *PWM_REG(n, CTR) &= ~(1<<0);        //Disable PWM
+                *PWM_REG(n, PERIOD) = period;       //Set period PWM
+                *PWM_REG(n, CTR) |= (1<<0);         //Enable PWM
+                pwm_chans[n].period = period;
+                asus_pwm_write(pin, pwm_value);
         }
 }
 
+/* All the channels in one commit, so they restart in phase */
+static const int pwm_pins[3] = {PWM0, PWM2, PWM3};
+
 void asus_set_pwmRange(unsigned int range)
 {
-        asus_set_pwmPeriod(PWM0, range);
-        asus_set_pwmPeriod(PWM2, range);
-        asus_set_pwmPeriod(PWM3, range);
+        int i;
+        for(i=0;i<3;i++)
+        {
+                if(pwm_chan(pwm_pins[i]) >= 0)
+                        asus_pwm_stage(pwm_pins[i], range, -1, -1);
+        }
+        asus_pwm_commit();
 }
 
 void asus_set_pwmFrequency(int pin, int divisor)
 {
-        int PWM_CTRL_OFFSET = -1;
-        switch (pin)
-        {
-                case PWM0:
-                        PWM_CTRL_OFFSET=RK3288_PWM0_CTR;
-                        break;
-                case PWM2:
-                        PWM_CTRL_OFFSET=RK3288_PWM2_CTR;
-                        break;
-                case PWM3:
-                        PWM_CTRL_OFFSET=RK3288_PWM3_CTR;
-                        break;
-                default:
-                        break;
-        }
+        int n = pwm_chan(pin);
         if (divisor > 0xff)
                 divisor = 0x100;
         else if(divisor < 2)
                 divisor = 0x02;
-        if(asus_get_pin_mode(pin)==PWM && PWM_CTRL_OFFSET != -1)
+        if(n >= 0)
         {
-                *(pwm+PWM_CTRL_OFFSET/4) &= ~(1<<0);        //Disable PWM
-                *(pwm+PWM_CTRL_OFFSET/4) = (*(pwm+PWM_CTRL_OFFSET/4) & ~(0xff << 16)) | ((0xff & (divisor/2)) << 16) | (1<<9) ;        //PWM div
-                *(pwm+PWM_CTRL_OFFSET/4) |= (1<<0); //Enable PWM
+                *PWM_REG(n, CTR) &= ~(1<<0);        //Disable PWM
+                *PWM_REG(n, CTR) = (*PWM_REG(n, CTR) & ~(0xff << 16)) | ((0xff & (divisor/2)) << 16) | (1<<9) ;        //PWM div
+                *PWM_REG(n, CTR) |= (1<<0); //Enable PWM
         }
 }
 
 
 void asus_set_pwmClock(int divisor)
 {
-        asus_set_pwmFrequency(PWM0, divisor);
-        asus_set_pwmFrequency(PWM2, divisor);
-        asus_set_pwmFrequency(PWM3, divisor);
+        int i;
+        for(i=0;i<3;i++)
+        {
+                if(pwm_chan(pwm_pins[i]) >= 0)
+                        asus_pwm_stage(pwm_pins[i], -1, -1, divisor);
+        }
+        asus_pwm_commit();
 }
 
+/* CTR bits we own: enable, continuous mode, inactive high, left aligned */
+#define PWM_CTR_MASK    ((1<<0)|(3<<1)|(1<<4)|(1<<5))
+#define PWM_CTR_RUN     ((1<<0)|(1<<1)|(1<<4))
+
 void asus_pwm_write(int pin, int value)
 {
-        int mode = 0;
-        unsigned int range;
-        int PWM_CTRL_OFFSET = -1;
-        int PWM_PERIOD_OFFSET = -1;
-        int PWM_DUTY_OFFSET = -1;
-        switch (pin)
+        int n = pwm_chan(pin);
+        volatile unsigned *ctr;
+        if(n < 0)
         {
-                case PWM0:
-                        PWM_CTRL_OFFSET=RK3288_PWM0_CTR;
-                        PWM_PERIOD_OFFSET=RK3288_PWM0_PERIOD;
-                        PWM_DUTY_OFFSET=RK3288_PWM0_DUTY;
-                        break;
-                case PWM2:
-                        PWM_CTRL_OFFSET=RK3288_PWM2_CTR;
-                        PWM_PERIOD_OFFSET=RK3288_PWM2_PERIOD;
-                        PWM_DUTY_OFFSET=RK3288_PWM2_DUTY;
-                        break;
-                case PWM3:
-                        PWM_CTRL_OFFSET=RK3288_PWM3_CTR;
-                        PWM_PERIOD_OFFSET=RK3288_PWM3_PERIOD;
-                        PWM_DUTY_OFFSET=RK3288_PWM3_DUTY;
-                        break;
-                default:
-                        break;
+                printf("please set this pin to pwmmode first\n");
+                return;
         }
-        if(asus_get_pin_mode(pin)==PWM && PWM_CTRL_OFFSET != -1 && PWM_PERIOD_OFFSET != -1 && PWM_DUTY_OFFSET != -1)
+        if(pwm_chans[n].state == PWM_RUNNING)
         {
-                range = *(pwm+PWM_PERIOD_OFFSET/4);
-                *(pwm+PWM_CTRL_OFFSET/4) &= ~(1<<0);        //Disable PWM
-                *(pwm+PWM_DUTY_OFFSET/4) = range - value; //Set duty
-                if(mode == CENTERPWM)
+                *PWM_REG(n, DUTY) = pwm_chans[n].period - value;
+                return;
+        }
+
+        /* First write: set the channel up, unless it already is */
+        ctr = PWM_REG(n, CTR);
+        if((*ctr & PWM_CTR_MASK) == PWM_CTR_RUN)
+                *PWM_REG(n, DUTY) = pwm_chans[n].period - value;
+        else
+        {
+                *ctr &= ~(1<<0);        //Disable PWM
+                *PWM_REG(n, DUTY) = pwm_chans[n].period - value; //Set duty
+                *ctr = (*ctr & ~PWM_CTR_MASK) | PWM_CTR_RUN;    //Enable PWM
+        }
+        pwm_chans[n].state = PWM_RUNNING;
+}
+
+/* Synchronised update: period, duty and clock changes for several
+ * channels are staged, then committed in one pass over the PWM block.
+ * Channels whose period or clock changes, or that aren't running yet,
+ * are all stopped, set up and then started back to back so they come
+ * out in phase. Duty-only changes are plain stores, latched by each
+ * channel at the end of its period. */
+static struct
+{
+        int period;             /* -1: leave as is */
+        int value;
+        int scale;
+} pwm_staged[4];
+static unsigned pwm_staged_chans;
+
+int asus_pwm_stage(int pin, int period, int value, int divisor)
+{
+        int n = pwm_chan(pin);
+        if(n < 0)
+        {
+                printf("please set this pin to pwmmode first\n");
+                return -1;
+        }
+        if(!(pwm_staged_chans & (1<<n)))
+        {
+                pwm_staged[n].period = -1;
+                pwm_staged[n].value = -1;
+                pwm_staged[n].scale = -1;
+                pwm_staged_chans |= 1<<n;
+        }
+        if(period >= 0)
+                pwm_staged[n].period = period;
+        if(value >= 0)
+                pwm_staged[n].value = value;
+        if(divisor >= 0)
+        {
+                if (divisor > 0xff)
+                        divisor = 0x100;
+                else if(divisor < 2)
+                        divisor = 0x02;
+                pwm_staged[n].scale = 0xff & (divisor/2);
+        }
+        return 0;
+}
+
+/* Work out the register writes for what is staged, given the current
+ * contents of the PWM block. Nothing is written. */
+int asus_pwm_plan(volatile unsigned *block, struct asus_pwm_op *ops)
+{
+        unsigned ctr[4], period, old_period, value, restart = 0;
+        int n, i = 0;
+
+#define PWM_OP(n, reg, v)  do { ops[i].offset = 0x10*(n) + RK3288_PWM0_##reg; ops[i].value = (v); i++; } while(0)
+
+        for(n=0;n<4;n++)
+        {
+                if(!(pwm_staged_chans & (1<<n)))
+                        continue;
+                ctr[n] = block[(0x10*n + RK3288_PWM0_CTR)/4];
+                if(pwm_staged[n].period >= 0 || pwm_staged[n].scale >= 0 || (ctr[n] & PWM_CTR_MASK) != PWM_CTR_RUN)
                 {
-                        *(pwm+PWM_CTRL_OFFSET/4) |= (1<<5);
+                        restart |= 1<<n;
+                        ctr[n] &= ~(1<<0);
+                        PWM_OP(n, CTR, ctr[n]);                 //Disable PWM
                 }
-                else
+        }
+        for(n=0;n<4;n++)
+        {
+                if(!(pwm_staged_chans & (1<<n)))
+                        continue;
+                old_period = block[(0x10*n + RK3288_PWM0_PERIOD)/4];
+                period = pwm_staged[n].period >= 0 ? (unsigned)pwm_staged[n].period : old_period;
+                if(pwm_staged[n].period >= 0)
+                        PWM_OP(n, PERIOD, period);
+                if(pwm_staged[n].value >= 0)
+                        PWM_OP(n, DUTY, period - pwm_staged[n].value);
+                else if(period != old_period)           //Keep the value
                 {
-                        *(pwm+PWM_CTRL_OFFSET/4) &= ~(1<<5);
+                        value = old_period - block[(0x10*n + RK3288_PWM0_DUTY)/4];
+                        PWM_OP(n, DUTY, period - value);
                 }
-                *(pwm+PWM_CTRL_OFFSET/4) |= (1<<1);
-                *(pwm+PWM_CTRL_OFFSET/4) &= ~(1<<2);
-                *(pwm+PWM_CTRL_OFFSET/4) |= (1<<4);
-                *(pwm+PWM_CTRL_OFFSET/4) |= (1<<0); //Enable PWM
+                if(pwm_staged[n].scale >= 0)
+                        ctr[n] = (ctr[n] & ~(0xff << 16)) | (pwm_staged[n].scale << 16) | (1<<9);
         }
-        else
+        for(n=0;n<4;n++)
         {
-                printf("please set this pin to pwmmode first\n");
+                if(restart & (1<<n))
+                        PWM_OP(n, CTR, (ctr[n] & ~PWM_CTR_MASK) | PWM_CTR_RUN);        //Enable PWM
+        }
+#undef PWM_OP
+        return i;
+}
+
+void asus_pwm_apply(volatile unsigned *block, const struct asus_pwm_op *ops, int count)
+{
+        int i;
+        for(i=0;i<count;i++)
+                block[ops[i].offset/4] = ops[i].value;
+}
+
+void asus_pwm_commit(void)
+{
+        struct asus_pwm_op ops[ASUS_PWM_MAX_OPS];
+        int n;
+        asus_pwm_apply(pwm, ops, asus_pwm_plan(pwm, ops));
+        for(n=0;n<4;n++)
+        {
+                if(!(pwm_staged_chans & (1<<n)))
+                        continue;
+                pwm_chans[n].period = *PWM_REG(n, PERIOD);
+                pwm_chans[n].state = PWM_RUNNING;
         }
+        pwm_staged_chans = 0;
 }
 
 void asus_pwmToneWrite(int pin, int freq)
@@ -1003,91 +1225,11 @@ void asus_set_gpioClockFreq(int pin, int freq)
 
 int asus_get_pinAlt(int pin)
 {
+        const struct pin_desc *d = pin_desc(pin);
         int alt;
-        int bank, bank_pin;
-        bank = gpioToBank(pin);
-        bank_pin = gpioToBankPin(pin);
-        switch(pin)
-        {
-                //GPIO0
-                case GPIO0_C1 :
-                        alt =  ((*(pmu+PMU_GPIO0C_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-                //GPIO5B
-                case GPIO5_B0 :
-                case GPIO5_B1 :
-                case GPIO5_B2 :
-                case GPIO5_B3 :
-                        alt = ((*(grf+GRF_GPIO5B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-                case GPIO5_B4 :
-                case GPIO5_B5 :
-                case GPIO5_B6 :
-                case GPIO5_B7 :
-                        alt = ((*(grf+GRF_GPIO5B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-
-                //GPIO5C
-                case GPIO5_C0 :
-                        alt = ((*(grf+GRF_GPIO5C_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-                case GPIO5_C1 :
-                case GPIO5_C2 :
-                case GPIO5_C3 :
-                        alt = ((*(grf+GRF_GPIO5C_IOMUX/4))>>((pin%8)*2)) & 0x00000001;
-                        break;
-                //GPIO6A
-                case GPIO6_A0 :
-                case GPIO6_A1 :
-                case GPIO6_A3 :
-                case GPIO6_A4 :
-                        alt = ((*(grf+GRF_GPIO6A_IOMUX/4))>>((pin%8)*2)) & 0x00000001;
-                        break;
-                //GPIO7A7
-                case PWM0:
-                case GPIO7_A7 :
-                        alt = ((*(grf+GRF_GPIO7A_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-
-                //GPIO7B
-                case GPIO7_B0 :
-                case GPIO7_B1 :
-                        alt = ((*(grf+GRF_GPIO7B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-                case GPIO7_B2 :
-                        alt = ((*(grf+GRF_GPIO7B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-                //GPIO7C
-                case GPIO7_C1 :
-                case GPIO7_C2 :
-                        alt = ((*(grf+GRF_GPIO7CL_IOMUX/4))>>((pin%8)*4)) & 0x00000001;
-                        break;
-                case GPIO7_C6 :
-                        alt = ((*(grf+GRF_GPIO7CH_IOMUX/4))>>(((pin-4)%8)*4)) & 0x00000003;
-                        break;
-                case GPIO7_C7 :
-                        alt = ((*(grf+GRF_GPIO7CH_IOMUX/4))>>(((pin-4)%8)*4)) & 0x00000007;
-                        break;
-
-                //GPIO8A
-                case GPIO8_A3 :
-                case GPIO8_A6 :
-                case GPIO8_A7 :
-                        alt = ((*(grf+GRF_GPIO8A_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-                case GPIO8_A4 :
-                case GPIO8_A5 :
-                        alt = ((*(grf+GRF_GPIO8A_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-                //GPIO8B
-                case GPIO8_B0 :
-                case GPIO8_B1 :
-                        alt = ((*(grf+GRF_GPIO8B_IOMUX/4))>>((pin%8)*2)) & 0x00000003;
-                        break;
-                default:
-                        alt=-1;
-                        break;
-        }
+        if(d == NULL || d->funcs == NULL)
+                return -1;
+        alt = iomux_get(d);
 
         //RPi alt ("   GPIO  "), "ALT0", "ALT1", "ALT2", "ALT3", "ALT4", "ALT5"
         //          0      1        2      3        4      5       6       7
@@ -1099,7 +1241,7 @@ int asus_get_pinAlt(int pin)
         }
     if (alt == 0)
     {
-                if (*(gpio0[bank]+GPIO_SWPORTA_DDR_OFFSET/4) & (1<<bank_pin))
+                if (get_gpio_dir(gpioToBank(pin)) & (1<<gpioToBankPin(pin)))
                         alt = FSEL_OUTP;
                 else
                         alt = FSEL_INPT;
@@ -1109,88 +1251,13 @@ int asus_get_pinAlt(int pin)
 
 void SetGpioMode(int pin, int alt)
 {
-        alt = ~alt & 0x3;
-        switch(pin)
+        const struct pin_desc *d = pin_desc(pin);
+        if(d == NULL)
         {
-                //GPIO0
-                case GPIO0_C1 :
-                        *(pmu+PMU_GPIO0C_IOMUX/4) = (*(pmu+PMU_GPIO0C_IOMUX/4) | (0x3 << ((pin % 8)*2))) & (~(alt<<((pin%8)*2)));
-                        break;
-                //GPIO1D0:act-led
-                case GPIO1_D0 :
-                        break;
-                //GPIO5B
-                case GPIO5_B0 :
-                case GPIO5_B1 :
-                case GPIO5_B2 :
-                case GPIO5_B3 :
-                case GPIO5_B4 :
-                case GPIO5_B5 :
-                case GPIO5_B6 :
-                case GPIO5_B7 :
-                        *(grf+GRF_GPIO5B_IOMUX/4) = (*(grf+GRF_GPIO5B_IOMUX/4) | (0x03<<((pin%8)*2+16)) | (0x3 << ((pin % 8)*2))) & (~(alt<<((pin%8)*2)));
-                        break;
-
-                //GPIO5C
-                case GPIO5_C0 :
-                case GPIO5_C1 :
-                case GPIO5_C2 :
-                case GPIO5_C3 :
-                        *(grf+GRF_GPIO5C_IOMUX/4) =  (*(grf+GRF_GPIO5C_IOMUX/4) | (0x03<<((pin%8)*2+16)) | (0x3 << ((pin % 8)*2))) & (~(alt<<((pin%8)*2)));
-                        break;
-
-                //GPIO6A
-                case GPIO6_A1 :
-                        #ifdef CONFIG_I2S_SHORT
-                        *(grf+GRF_GPIO6A_IOMUX/4) =  (*(grf+GRF_GPIO6A_IOMUX/4) | (0x0f<<((pin%8)*2+16)) | (0xf << ((pin % 8)*2))) & (~((alt | (alt<<2))<<((pin%8)*2)));
-                        #else
-                        *(grf+GRF_GPIO6A_IOMUX/4) =  (*(grf+GRF_GPIO6A_IOMUX/4) | (0x03<<((pin%8)*2+16)) | (0x3 << ((pin % 8)*2))) & (~(alt<<((pin%8)*2)));
-                        #endif
-                        break;
-                case GPIO6_A0 :
-                case GPIO6_A3 :
-                case GPIO6_A4 :
-                        *(grf+GRF_GPIO6A_IOMUX/4) =  (*(grf+GRF_GPIO6A_IOMUX/4) | (0x03<<((pin%8)*2+16)) | (0x3 << ((pin % 8)*2))) & (~(alt<<((pin%8)*2)));
-                        break;
-
-                //GPIO7A7
-                case GPIO7_A7 :
-                        *(grf+GRF_GPIO7A_IOMUX/4) =  (*(grf+GRF_GPIO7A_IOMUX/4) | (0x03<<((pin%8)*2+16)) | (0x3 << ((pin % 8)*2))) & (~(alt<<((pin%8)*2)));
-                        break;
-
-                //GPIO7B
-                case GPIO7_B0 :
-                case GPIO7_B1 :
-                case GPIO7_B2 :
-                        *(grf+GRF_GPIO7B_IOMUX/4) =  (*(grf+GRF_GPIO7B_IOMUX/4) | (0x03<<((pin%8)*2+16)) | (0x3 << ((pin % 8)*2))) & (~(alt<<((pin%8)*2)));
-                        break;
-                //GPIO7C
-                case GPIO7_C1 :
-                case GPIO7_C2 :
-                        *(grf+GRF_GPIO7CL_IOMUX/4) = (*(grf+GRF_GPIO7CL_IOMUX/4) | (0x0f<<(16+(pin%8)*4)) | (0x3 << ((pin % 8)*4))) & (~((alt)<<((pin%8)*4)));
-                        break;
-                case GPIO7_C6 :
-                case GPIO7_C7 :
-                        *(grf+GRF_GPIO7CH_IOMUX/4) =  (*(grf+GRF_GPIO7CH_IOMUX/4) | (0x0f<<(16+(pin%8-4)*4)) | (0x3 << ((pin%8-4)*4))) & (~(alt<<((pin%8-4)*4)));
-                        break;
-
-                //GPIO8A
-                case GPIO8_A3 :
-                case GPIO8_A6 :
-                case GPIO8_A7 :
-                case GPIO8_A4 :
-                case GPIO8_A5 :
-                        *(grf+GRF_GPIO8A_IOMUX/4) =  (*(grf+GRF_GPIO8A_IOMUX/4) | (0x03<<((pin%8)*2+16)) | (0x3 << ((pin % 8)*2))) & (~(alt<<((pin%8)*2)));
-                        break;
-                //GPIO8B
-                case GPIO8_B0 :
-                case GPIO8_B1 :
-                        *(grf+GRF_GPIO8B_IOMUX/4) = (*(grf+GRF_GPIO8B_IOMUX/4) | (0x03<<((pin%8)*2+16)) | (0x3 << ((pin % 8)*2))) & (~(alt<<((pin%8)*2)));
-                        break;
-                default:
-                        printf("wrong gpio\n");
-                        break;
+                printf("wrong gpio\n");
+                return;
         }
+        iomux_set(d, alt & 0x3);
 }
 
 void asus_set_pinAlt(int pin, int alt)
@@ -1207,14 +1274,15 @@ void asus_set_pinAlt(int pin, int alt)
                 printf("wrong alt\n");
                 return;
         }
+        pwm_forget(pin);
         SetGpioMode(pin, tb_format_alt);
         if(alt == FSEL_INPT)
         {
-                *(gpio0[bank]+GPIO_SWPORTA_DDR_OFFSET/4) &= ~(1<<bank_pin);
+                set_gpio_dir(bank, 1<<bank_pin, 0);
         }
         else if(alt == FSEL_OUTP)
         {
-                *(gpio0[bank]+GPIO_SWPORTA_DDR_OFFSET/4) |= (1<<bank_pin);
+                set_gpio_dir(bank, 1<<bank_pin, 1);
         }
 }
 
@@ -1222,67 +1290,51 @@ void asus_set_pinAlt(int pin, int alt)
 //drv_type={0:2mA, 1:4mA, 2:8mA, 3:12mA}
 void asus_set_GpioDriveStrength(int pin, int drv_type)
 {
-        int bank, bank_pin;
-        int GPIO_E_offset;
-        int write_bit;
         if(!gpio_is_valid(pin))
         {
                 printf("wrong gpio\n");
                 return;
         }
-        bank = gpioToBank(pin);
-        bank_pin = gpioToBankPin(pin);
-        GPIO_E_offset = GET_DRV_OFFSET(bank, bank_pin);
-        if(GPIO_E_offset == -1)
-        {
-                printf("wrong offset\n");
-                return;
-        }
-        write_bit = (bank_pin % 8) << 1;
-        drv_type &= 0x3;
-        if(bank == 0)
-        {
-                *(pmu+GPIO_E_offset/4) = (*(pmu+GPIO_E_offset/4) & ~(0x3 << write_bit)) | (drv_type << write_bit);        //without write_en
-        }
-        else
-        {
-                *(grf+GPIO_E_offset/4) = (0x3 << (16 + write_bit)) | (drv_type << write_bit);                             //with write_en
-        }
+        pad_set(pin_desc(pin), pin_desc(pin)->drv, pin, drv_type & 0x3);
 }
 
 int asus_get_GpioDriveStrength(int pin)
 {
-        int bank, bank_pin;
-        int GPIO_E_offset;
-        int write_bit;
-        volatile unsigned *reg;
+        const struct pin_desc *d = pin_desc(pin);
         if(!gpio_is_valid(pin))
         {
                 printf("wrong gpio\n");
                 return -1;
         }
-        bank = gpioToBank(pin);
-        bank_pin = gpioToBankPin(pin);
-        reg = (bank == 0) ? pmu : grf;
-        GPIO_E_offset = GET_DRV_OFFSET(bank, bank_pin);
-        if(GPIO_E_offset == -1)
-        {
-                printf("wrong offset\n");
-                return -1;
-        }
-        write_bit = (bank_pin % 8) << 1;
-        return (*(reg+GPIO_E_offset/4) >> write_bit) & 0x3;
+        return (*pin_reg(d, d->drv) >> ((gpioToBankPin(pin) % 8) << 1)) & 0x3;
+}
+
+/* Pin handle support: bank registers of a valid gpio, NULL otherwise */
+volatile unsigned* asus_get_gpio_bank(int pin)
+{
+        if(!gpio_is_valid(pin))
+                return NULL;
+        return gpio0[gpioToBank(pin)];
 }
 
 void asus_cleanup(void)
 {
         int i;
-        for(i=0;i<GPIO_BANK;i++)
+        if(io_window != NULL)
+        {
+                munmap((caddr_t)io_window, io_window_size);
+                io_window = NULL;
+        }
+        else
         {
-            munmap((caddr_t)gpio_map0[i], BLOCK_SIZE);
+                for(i=0;i<GPIO_BANK;i++)
+                {
+                    munmap((caddr_t)gpio_map0[i], BLOCK_SIZE);
+                }
+                munmap((caddr_t)grf_map, BLOCK_SIZE);
+                munmap((caddr_t)pwm_map, BLOCK_SIZE);
+                munmap((caddr_t)pmu_map, BLOCK_SIZE);
+                munmap((caddr_t)cru_map, BLOCK_SIZE);
         }
-        munmap((caddr_t)grf_map, BLOCK_SIZE);
-        munmap((caddr_t)pwm_map, BLOCK_SIZE);
-        munmap((caddr_t)pmu_map, BLOCK_SIZE);
-        munmap((caddr_t)cru_map, BLOCK_SIZE);
+        mapped = 0;
 }
@@ -6,17 +6,44 @@
 int* asus_get_physToGpio         (int rev);
 int* asus_get_pinToGpio          (int rev);
 int  tinker_board_setup          (int rev);
+void asus_set_sim                (const char *file);
+int  asus_is_sim                 (void);
 int  asus_get_pin_mode           (int pin);
 void asus_set_pinmode_as_gpio    (int pin);
 void asus_set_pin_mode           (int pin, int mode);
 void asus_digitalWrite           (int pin, int value);
+void asus_digitalWriteBank       (int bank, unsigned int setMask, unsigned int clrMask);
 int  asus_digitalRead            (int pin);
+unsigned int asus_digitalReadBank (int bank);
+
+/* Edge latch, see asus_edge_latch() */
+#define ASUS_LATCH_OFF          0
+#define ASUS_LATCH_FALLING      1
+#define ASUS_LATCH_RISING       2
+
+int  asus_edge_latch             (int pin, int edge);
+unsigned int asus_edge_latch_read (int bank);
+void asus_edge_latch_ack         (int bank, unsigned int mask);
+void asus_set_debounce           (int pin, int enable);
 void asus_pullUpDnControl        (int pin, int pud);
 void asus_set_pwmPeriod          (int pin, unsigned int period);
 void asus_set_pwmRange           (unsigned int range);
 void asus_set_pwmFrequency       (int pin, int divisor);
 void asus_set_pwmClock           (int divisor);
 void asus_pwm_write              (int pin, int value);
+
+/* One register write of a staged PWM commit */
+struct asus_pwm_op
+{
+        unsigned int offset;            /* In the PWM block */
+        unsigned int value;
+};
+#define ASUS_PWM_MAX_OPS 16
+
+int  asus_pwm_stage              (int pin, int period, int value, int divisor);
+int  asus_pwm_plan               (volatile unsigned *block, struct asus_pwm_op *ops);
+void asus_pwm_apply              (volatile unsigned *block, const struct asus_pwm_op *ops, int count);
+void asus_pwm_commit             (void);
 void asus_pwmToneWrite           (int pin, int freq);
 void asus_set_gpioClockFreq      (int pin, int freq);
 int  asus_get_pinAlt             (int pin);
@@ -25,4 +52,12 @@ void asus_set_GpioDriveStrength  (int pin, int drv_type);
 int  asus_get_GpioDriveStrength  (int pin);
 void asus_cleanup                (void);
 void gpio_clk_enable             (void);
+int  gpio_is_valid               (int gpio);
+int  gpioToBank                  (int gpio);
+int  gpioToBankPin               (int gpio);
+volatile unsigned* asus_get_gpio_bank (int pin);
+void asus_cache_sync             (int bank);
+void asus_set_cached             (int enable);
+void asus_gpio_update            (int bank, unsigned int clrMask, unsigned int xorMask);
+void asus_reg_update             (volatile unsigned *reg, unsigned *shadow, int *lock, unsigned clrMask, unsigned xorMask);
 #endif